@@ -0,0 +1,109 @@
+#include "BenchReport.h"
+
+// Cycle and motion time only say a gait changed, and the CPU time depends
+// on the machine and what else runs on it; neither fails a comparison
+const BenchMetricInfo BENCH_METRIC_INFO[BENCH_METRICS] = {
+    {"cycle_ms",         false},
+    {"motion_ms",        false},
+    {"bus_transactions", true},
+    {"bus_bytes",        true},
+    {"bus_bytes_per_m",  true},
+    {"latency_ms",       true},
+    {"tick_us_mean",     false},
+    {"tick_us_p99",      false},
+    {"tick_us_max",      false},
+};
+
+
+bool saveBenchResults(const char* path, const std::vector<BenchResult>& results) {
+    FILE* output = fopen(path, "w");
+    if (output == NULL) {
+        fprintf(stderr, "ERROR: could not write %s\n", path);
+        return false;
+    }
+    fprintf(output, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        fprintf(output, "{\"routine\": \"%s\", \"cycles\": %d", result.routine.c_str(), result.cycles);
+        for (int metric = 0; metric < BENCH_METRICS; metric++) {
+            if (result.measured[metric]) {
+                fprintf(output, ", \"%s\": %.2f", BENCH_METRIC_INFO[metric].key, result.values[metric]);
+            }
+        }
+        fprintf(output, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(output, "]\n");
+    fclose(output);
+    return true;
+}
+
+bool loadBenchResults(const char* path, std::vector<BenchResult>& results) {
+    FILE* input = fopen(path, "r");
+    if (input == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    results.clear();
+    char line[1024];
+    while (fgets(line, sizeof(line), input) != NULL) {
+        char name[64];
+        const char* routine = strstr(line, "\"routine\": \"");
+        if (routine == NULL || sscanf(routine + 12, "%63[^\"]", name) != 1) {
+            continue;
+        }
+        BenchResult result;
+        result.routine = name;
+        const char* cycles = strstr(line, "\"cycles\": ");
+        result.cycles = cycles != NULL ? atoi(cycles + 10) : 0;
+        for (int metric = 0; metric < BENCH_METRICS; metric++) {
+            char key[40];
+            snprintf(key, sizeof(key), "\"%s\": ", BENCH_METRIC_INFO[metric].key);
+            const char* value = strstr(line, key);
+            result.measured[metric] = value != NULL;
+            result.values[metric] = value != NULL ? strtod(value + strlen(key), NULL) : 0;
+        }
+        results.push_back(result);
+    }
+    fclose(input);
+    return true;
+}
+
+static const BenchResult* findResult(const std::vector<BenchResult>& results, const std::string& routine) {
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].routine == routine) {
+            return &results[i];
+        }
+    }
+    return NULL;
+}
+
+int printBenchResults(FILE* out, const std::vector<BenchResult>& results,
+                      const std::vector<BenchResult>* baseline, double thresholdPercent) {
+    int regressions = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        const BenchResult* before = baseline != NULL ? findResult(*baseline, result.routine) : NULL;
+        fprintf(out, "%s (%d cycle%s)%s\n", result.routine.c_str(), result.cycles, result.cycles == 1 ? "" : "s",
+                baseline != NULL && before == NULL ? ", not in the baseline" : "");
+
+        for (int metric = 0; metric < BENCH_METRICS; metric++) {
+            if (!result.measured[metric]) {
+                continue;
+            }
+            const BenchMetricInfo& info = BENCH_METRIC_INFO[metric];
+            fprintf(out, "  %-18s %10.2f", info.key, result.values[metric]);
+            if (before != NULL && before->measured[metric]) {
+                double was = before->values[metric];
+                double change = was != 0 ? (result.values[metric] - was) * 100 / fabs(was) :
+                                (result.values[metric] != 0 ? 100 : 0);
+                bool worse = info.checked && change > thresholdPercent;
+                fprintf(out, "   was %10.2f  %+7.1f%%%s", was, change, worse ? "  REGRESSED" : "");
+                if (worse) {
+                    regressions++;
+                }
+            }
+            fprintf(out, "\n");
+        }
+    }
+    return regressions;
+}
@@ -0,0 +1,47 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <Arduino.h>
+
+#include <string>
+#include <vector>
+
+enum BenchMetric {
+    BENCH_CYCLE_MS,         // virtual time from one cycle start to the next
+    BENCH_MOTION_MS,        // until the last servo move of the cycle arrives
+    BENCH_BUS_TRANSACTIONS, // servo bus frames per cycle
+    BENCH_BUS_BYTES,        // servo bus bytes per cycle
+    BENCH_BUS_BYTES_PER_M,  // walks only
+    BENCH_LATENCY_MS,       // virtual time from the command to the first servo move
+    BENCH_TICK_US_MEAN,     // host CPU time per control tick
+    BENCH_TICK_US_P99,
+    BENCH_TICK_US_MAX,
+    BENCH_METRICS
+};
+
+struct BenchMetricInfo {
+    const char* key;
+    bool checked;           // more than the baseline is a regression
+};
+
+extern const BenchMetricInfo BENCH_METRIC_INFO[BENCH_METRICS];
+
+struct BenchResult {
+    std::string routine;
+    int cycles;
+    double values[BENCH_METRICS];
+    bool measured[BENCH_METRICS];
+};
+
+// Results go out as a JSON array, one routine per line, so runs from two
+// commits diff cleanly and the file reads back without a JSON library
+bool saveBenchResults(const char* path, const std::vector<BenchResult>& results);
+bool loadBenchResults(const char* path, std::vector<BenchResult>& results);
+
+// Prints the results as a table. With a baseline each value gets its
+// change, and those that got worse by more than thresholdPercent are
+// marked; returns how many were.
+int printBenchResults(FILE* out, const std::vector<BenchResult>& results,
+                      const std::vector<BenchResult>* baseline, double thresholdPercent);
+
+#endif
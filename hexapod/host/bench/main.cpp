@@ -0,0 +1,298 @@
+#include <Arduino.h>
+#include "HostRuntime.h"
+#include "Enums.h"
+#include "Constants.h"
+#include "NetworkServer.h"
+#include "PhasedMotion.h"
+#include "BodySimulator.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Benchmarks of the firmware's gaits and motions on the host:
+//
+//   hexapod_bench [-v] [-b baseline.json] [-r percent] [results.json]
+//
+// Boots the whole firmware against the body simulator, which also
+// answers the foot switches, then runs every routine in turn through the
+// commands a client sends. For each it reports the gait cycle in virtual
+// time, how long the servos take to finish the cycle's moves, servo bus
+// frames and bytes per cycle (per metre for walks), the virtual time from
+// a command to its first servo move, and the host CPU time spent in each
+// control tick. Everything but the CPU time is exact and repeats from run
+// to run.
+//
+// Results are written as JSON when a path is given. Against a baseline
+// from an earlier commit every value gets its change, and the run exits 1
+// when bus traffic or command latency grew by more than the threshold
+// (5% unless given).
+
+// The firmware, from main.cpp
+void setup();
+void controlTick(unsigned long now);
+void onClientCommand(int clientId, const char* command);
+extern PhasedMotion* activeMotion;
+extern volatile RobotMode currentMode;
+extern RobotMode lastTickMode;
+
+struct BenchRoutine {
+    const char* name;
+    const char* gait;       // sent before the command, NULL for none
+    const char* command;    // NULL to stand idle
+    int cycles;             // walk cycles to measure, 0 for a motion that ends by itself
+};
+
+const BenchRoutine BENCH_ROUTINES[] = {
+    {"idle",            NULL,          NULL,        0},
+    {"tripod_forward",  "TRIPOD_GAIT", "FORWARD",   4},
+    {"tripod_backward", "TRIPOD_GAIT", "BACKWARD",  4},
+    {"tripod_left",     "TRIPOD_GAIT", "LEFT",      0},
+    {"tripod_right",    "TRIPOD_GAIT", "RIGHT",     0},
+    {"wave_forward",    "WAVE_GAIT",   "FORWARD",   2},
+    {"wave_backward",   "WAVE_GAIT",   "BACKWARD",  2},
+    {"rotate_90",       "TRIPOD_GAIT", "ROTATE:90", 0},
+    {"lay_down",        NULL,          "LAY_DOWN",  0},
+    {"stand_up",        NULL,          "STAND_UP",  0},
+    {"dance",           NULL,          "DANCE",     0},
+};
+const int BENCH_ROUTINE_COUNT = sizeof(BENCH_ROUTINES) / sizeof(BENCH_ROUTINES[0]);
+
+// The first walk cycle starts from the stance, so it is left out
+const int BENCH_WARMUP_CYCLES = 1;
+const int BENCH_IDLE_TICKS = 500;
+// Commands land mid period, as they do coming off the network
+const unsigned long BENCH_COMMAND_OFFSET_MS = 5;
+const unsigned long BENCH_MAX_MS = 120000;
+const double DEFAULT_THRESHOLD_PERCENT = 5;
+
+// Commands come in as from the serial console
+const int CONSOLE_CLIENT = MAX_CLIENTS;
+
+static BodySimulator body;
+static unsigned long lastTickMs = 0;
+static unsigned long firstMoveMs = 0;
+static bool moved = false;
+static unsigned long tickArrivalMs = 0;     // latest arrival of a move in this tick
+static unsigned long restMs = 0;            // when every move so far has arrived
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_bench [-v] [-b baseline.json] [-r percent] [results.json]\n");
+}
+
+static void onServoCommand(int id, int32_t position, int time) {
+    body.command(id, position, time);
+    if (!moved) {
+        firstMoveMs = millis();
+        moved = true;
+    }
+    tickArrivalMs = max(tickArrivalMs, millis() + time);
+    restMs = max(restMs, millis() + time);
+}
+
+static int onDigitalRead(int pin) {
+    for (int leg = 0; leg < 6; leg++) {
+        if (SWITCH_PINS[leg] == pin) {
+            return body.isFootDown(leg) ? HIGH : LOW;
+        }
+    }
+    return LOW;
+}
+
+// One control period; returns the host CPU time of the tick in us
+static double tick() {
+    unsigned long now = lastTickMs + 1000 / CONTROL_RATE_HZ;
+    hostSetTime(now);
+    body.advanceTo(now);
+    tickArrivalMs = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    controlTick(now);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    lastTickMs = now;
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static bool isAtRest() {
+    return activeMotion == NULL && currentMode == lastTickMode;
+}
+
+static void measureTicks(BenchResult& result, std::vector<double>& tickUs) {
+    if (tickUs.empty()) {
+        return;
+    }
+    std::sort(tickUs.begin(), tickUs.end());
+    double total = 0;
+    for (size_t i = 0; i < tickUs.size(); i++) {
+        total += tickUs[i];
+    }
+    result.values[BENCH_TICK_US_MEAN] = total / tickUs.size();
+    result.values[BENCH_TICK_US_P99] = tickUs[(tickUs.size() - 1) * 99 / 100];
+    result.values[BENCH_TICK_US_MAX] = tickUs.back();
+    result.measured[BENCH_TICK_US_MEAN] = result.measured[BENCH_TICK_US_P99] =
+        result.measured[BENCH_TICK_US_MAX] = true;
+}
+
+static void setMetric(BenchResult& result, BenchMetric metric, double value) {
+    result.values[metric] = value;
+    result.measured[metric] = true;
+}
+
+// Runs one routine from its command until the legs are at rest again.
+// A cycle runs from the tick its motion starts to the tick it ends, the
+// moves back to the stance that follow a walk are not part of it.
+static bool runRoutine(const BenchRoutine& routine, BenchResult& result) {
+    result.routine = routine.name;
+    result.cycles = 0;
+    memset(result.measured, 0, sizeof(result.measured));
+    std::vector<double> tickUs;
+
+    if (routine.command == NULL) {
+        for (int i = 0; i < BENCH_IDLE_TICKS; i++) {
+            tickUs.push_back(tick());
+        }
+        measureTicks(result, tickUs);
+        return true;
+    }
+
+    unsigned long commandMs = lastTickMs + BENCH_COMMAND_OFFSET_MS;
+    hostSetTime(commandMs);
+    moved = false;
+    if (routine.gait != NULL) {
+        onClientCommand(CONSOLE_CLIENT, routine.gait);
+    }
+    onClientCommand(CONSOLE_CLIENT, routine.command);
+
+    int warmup = routine.cycles > 0 ? BENCH_WARMUP_CYCLES : 0;
+    int started = 0;
+    bool stopped = routine.cycles == 0;
+    bool cycleOpen = false;
+    unsigned long cycleStartMs = 0;
+    unsigned long cycleArrivalMs = 0;
+    HostBusStats cycleBus = {0, 0};
+    double totalMs = 0, totalMotionMs = 0, transactions = 0, bytes = 0, distance = 0;
+
+    while ((long)(lastTickMs - commandMs) < (long)BENCH_MAX_MS) {
+        PhasedMotion* motionBefore = activeMotion;
+        int phaseBefore = motionBefore != NULL ? motionBefore->currentPhase() : -1;
+        HostBusStats busBefore = hostBusStats();
+        tickUs.push_back(tick());
+
+        // A walk cycle starts over in the same tick the last one ended
+        bool cycleStarted = activeMotion != NULL &&
+                            (activeMotion != motionBefore || activeMotion->currentPhase() < phaseBefore);
+        if (cycleOpen && (cycleStarted || activeMotion == NULL)) {
+            CycleReport report = body.endCycle();
+            if (started > warmup) {
+                totalMs += lastTickMs - cycleStartMs;
+                totalMotionMs += max(cycleArrivalMs, lastTickMs) - cycleStartMs;
+                transactions += busBefore.transactions - cycleBus.transactions;
+                bytes += busBefore.bytes - cycleBus.bytes;
+                distance += report.forward;
+                result.cycles++;
+            }
+            cycleOpen = false;
+        }
+        if (cycleStarted) {
+            body.beginCycle();
+            cycleOpen = true;
+            cycleStartMs = lastTickMs;
+            cycleArrivalMs = tickArrivalMs;
+            cycleBus = busBefore;
+            // STOP lets the cycle running finish
+            if (!stopped && ++started >= warmup + routine.cycles) {
+                onClientCommand(CONSOLE_CLIENT, "STOP");
+                stopped = true;
+            } else if (stopped) {
+                started++;
+            }
+        } else if (cycleOpen) {
+            cycleArrivalMs = max(cycleArrivalMs, tickArrivalMs);
+        }
+
+        if (stopped && isAtRest()) {
+            break;
+        }
+    }
+    if (!stopped || !isAtRest()) {
+        fprintf(stderr, "ERROR: %s did not finish in %lu ms\n", routine.name, BENCH_MAX_MS);
+        return false;
+    }
+
+    if (result.cycles > 0) {
+        setMetric(result, BENCH_CYCLE_MS, totalMs / result.cycles);
+        setMetric(result, BENCH_MOTION_MS, totalMotionMs / result.cycles);
+        setMetric(result, BENCH_BUS_TRANSACTIONS, transactions / result.cycles);
+        setMetric(result, BENCH_BUS_BYTES, bytes / result.cycles);
+        if (routine.cycles > 0 && fabs(distance) > 1) {
+            setMetric(result, BENCH_BUS_BYTES_PER_M, bytes * 1000 / fabs(distance));
+        }
+    }
+    if (moved) {
+        setMetric(result, BENCH_LATENCY_MS, firstMoveMs - commandMs);
+    }
+    measureTicks(result, tickUs);
+
+    // Let the last moves finish before the next routine
+    while ((long)(restMs - lastTickMs) > 0) {
+        tick();
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* baselinePath = NULL;
+    double thresholdPercent = DEFAULT_THRESHOLD_PERCENT;
+    bool verbose = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            baselinePath = argv[++arg];
+        } else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+            thresholdPercent = atof(argv[++arg]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - arg > 1) {
+        usage();
+        return 2;
+    }
+
+    std::vector<BenchResult> baseline;
+    if (baselinePath != NULL && !loadBenchResults(baselinePath, baseline)) {
+        return 1;
+    }
+
+    hostSetConsole(verbose ? stderr : NULL);
+    body.reset();
+    hostOnServoCommand(onServoCommand);
+    hostOnDigitalRead(onDigitalRead);
+    setup();
+    lastTickMs = millis();
+
+    std::vector<BenchResult> results;
+    for (int i = 0; i < BENCH_ROUTINE_COUNT; i++) {
+        BenchResult result;
+        if (!runRoutine(BENCH_ROUTINES[i], result)) {
+            return 1;
+        }
+        results.push_back(result);
+    }
+
+    if (arg < argc && !saveBenchResults(argv[arg], results)) {
+        return 1;
+    }
+    int regressions = printBenchResults(stdout, results, baselinePath != NULL ? &baseline : NULL, thresholdPercent);
+    if (regressions > 0) {
+        printf("%d value%s REGRESSED by more than %.1f%%\n", regressions, regressions == 1 ? "" : "s",
+               thresholdPercent);
+        return 1;
+    }
+    return 0;
+}
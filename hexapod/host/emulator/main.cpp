@@ -0,0 +1,111 @@
+#include <Arduino.h>
+#include "HostRuntime.h"
+#include "Constants.h"
+#include "NetworkServer.h"
+#include "BodySimulator.h"
+
+#include <signal.h>
+
+// The firmware as a robot on the workstation's network:
+//
+//   hexapod_emulator [-q] [-b percent]
+//
+// Runs the firmware's own setup(), network server and control tick in
+// real time, so clients on port 8080 get the robot's replies, acks,
+// ping echoes and timing. The servos are the ideal ones of the host
+// build, and the foot switches come from the body simulator. The battery
+// reads the given charge (80% unless given). The WebSocket port is below
+// 1024 and needs the right to bind it; line clients work without.
+//
+// The two tasks of the robot take turns on one thread here: the network
+// server waits for clients until the next control period is due. The
+// control loop's own statistics stay empty, GET_CONTROL_STATS reads zero.
+
+// The firmware, from main.cpp
+void setup();
+void controlTick(unsigned long now);
+void superviseWifi();
+void saveParameters();
+extern NetworkServer networkServer;
+
+// BatteryReader's calibration: raw ADC readings at empty and full
+const int BATTERY_EMPTY_READING = 1672;
+const int BATTERY_FULL_READING = 2195;
+const int DEFAULT_BATTERY_PERCENT = 80;
+
+static BodySimulator body;
+static int batteryReading = 0;
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_emulator [-q] [-b percent]\n");
+}
+
+static void onServoCommand(int id, int32_t position, int time) {
+    body.command(id, position, time);
+}
+
+static int onDigitalRead(int pin) {
+    for (int leg = 0; leg < 6; leg++) {
+        if (SWITCH_PINS[leg] == pin) {
+            return body.isFootDown(leg) ? HIGH : LOW;
+        }
+    }
+    return LOW;
+}
+
+static int onAnalogRead(int pin) {
+    return pin == batteryPin ? batteryReading : 0;
+}
+
+int main(int argc, char** argv) {
+    bool quiet = false;
+    int batteryPercent = DEFAULT_BATTERY_PERCENT;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            batteryPercent = atoi(argv[++arg]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    batteryPercent = constrain(batteryPercent, 0, 100);
+    batteryReading = BATTERY_EMPTY_READING + (BATTERY_FULL_READING - BATTERY_EMPTY_READING) * batteryPercent / 100;
+
+    // A client that goes away mid reply must not take the emulator down
+    signal(SIGPIPE, SIG_IGN);
+
+    hostSetConsole(quiet ? NULL : stderr);
+    hostUseWallClock();
+    body.reset();
+    hostOnServoCommand(onServoCommand);
+    hostOnDigitalRead(onDigitalRead);
+    hostOnAnalogRead(onAnalogRead);
+    setup();
+
+    const unsigned long period = 1000 / CONTROL_RATE_HZ;
+    unsigned long nextTickMs = millis();
+    for (;;) {
+        superviseWifi();
+        saveParameters();
+
+        long untilTick = (long)(nextTickMs - millis());
+        if (untilTick > 0) {
+            networkServer.poll(untilTick);
+            continue;
+        }
+
+        unsigned long now = millis();
+        body.advanceTo(now);
+        controlTick(now);
+
+        // Like the control timer, periods that went by during a long
+        // tick are skipped rather than run back to back
+        nextTickMs += period;
+        if ((long)(now - nextTickMs) >= 0) {
+            nextTickMs = now + period;
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#include "ServoTrace.h"
+
+void ServoTrace::clear() {
+    phases.clear();
+    endMs = 0;
+}
+
+void ServoTrace::beginPhase(unsigned long ms, int motionPhase) {
+    TracePhase phase = {ms, motionPhase, std::vector<TraceMove>()};
+    phases.push_back(phase);
+}
+
+void ServoTrace::add(unsigned long ms, int id, int32_t position, int time) {
+    if (phases.empty()) {
+        beginPhase(ms, -1);
+    }
+    TraceMove move = {ms, id, position, time};
+    phases.back().moves.push_back(move);
+}
+
+size_t ServoTrace::moveCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < phases.size(); i++) {
+        count += phases[i].moves.size();
+    }
+    return count;
+}
+
+bool ServoTrace::load(const char* path) {
+    FILE* input = fopen(path, "r");
+    if (input == NULL) {
+        return false;
+    }
+    clear();
+    char line[128];
+    bool ended = false;
+    while (fgets(line, sizeof(line), input) != NULL) {
+        unsigned long ms;
+        int id, time, motionPhase;
+        long position;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "phase %lu %d", &ms, &motionPhase) == 2) {
+            beginPhase(ms, motionPhase);
+        } else if (sscanf(line, "end %lu", &ms) == 1) {
+            endMs = ms;
+            ended = true;
+        } else if (sscanf(line, "%lu %d %ld %d", &ms, &id, &position, &time) == 4) {
+            add(ms, id, position, time);
+        } else {
+            fprintf(stderr, "ERROR: bad line in %s: %s", path, line);
+            fclose(input);
+            return false;
+        }
+    }
+    fclose(input);
+    if (!ended) {
+        fprintf(stderr, "ERROR: %s is cut short\n", path);
+    }
+    return ended;
+}
+
+bool ServoTrace::save(const char* path, const char* routine) const {
+    FILE* output = fopen(path, "w");
+    if (output == NULL) {
+        fprintf(stderr, "ERROR: could not write %s\n", path);
+        return false;
+    }
+    fprintf(output, "# %s\n", routine);
+    for (size_t i = 0; i < phases.size(); i++) {
+        const TracePhase& phase = phases[i];
+        fprintf(output, "phase %lu %d\n", phase.startMs, phase.motionPhase);
+        for (size_t j = 0; j < phase.moves.size(); j++) {
+            const TraceMove& move = phase.moves[j];
+            fprintf(output, "%lu %d %ld %d\n", move.ms, move.id, (long)move.position, move.time);
+        }
+    }
+    fprintf(output, "end %lu\n", endMs);
+    fclose(output);
+    return true;
+}
+
+// When the phase after this one starts, or the routine ends
+static unsigned long phaseEnd(const ServoTrace& trace, size_t index) {
+    const std::vector<TracePhase>& phases = trace.getPhases();
+    return index + 1 < phases.size() ? phases[index + 1].startMs : trace.getEndMs();
+}
+
+static void noteDelta(TraceComparison& comparison, long delta, long toleranceMs) {
+    comparison.maxDeltaMs = max(comparison.maxDeltaMs, labs(delta));
+    if (labs(delta) > toleranceMs) {
+        comparison.matched = false;
+    }
+}
+
+TraceComparison compareTraces(const ServoTrace& golden, const ServoTrace& current, long toleranceMs,
+                              bool verbose, FILE* report) {
+    TraceComparison comparison = {true, 0, 0};
+    const std::vector<TracePhase>& expected = golden.getPhases();
+    const std::vector<TracePhase>& actual = current.getPhases();
+
+    size_t count = min(expected.size(), actual.size());
+    for (size_t i = 0; i < count; i++) {
+        const TracePhase& was = expected[i];
+        const TracePhase& now = actual[i];
+        long startDelta = (long)(now.startMs - was.startMs);
+        long lengthDelta = (long)(phaseEnd(current, i) - now.startMs) - (long)(phaseEnd(golden, i) - was.startMs);
+        noteDelta(comparison, startDelta, toleranceMs);
+        if (verbose || startDelta != 0 || lengthDelta != 0) {
+            fprintf(report, "  phase %lu (motion phase %d) at %lu ms: starts %+ld ms, lasts %+ld ms\n",
+                    (unsigned long)i, was.motionPhase, was.startMs, startDelta, lengthDelta);
+        }
+
+        if (now.motionPhase != was.motionPhase) {
+            fprintf(report, "  phase %lu: was motion phase %d, now %d\n", (unsigned long)i, was.motionPhase,
+                    now.motionPhase);
+            comparison.matched = false;
+            return comparison;
+        }
+        for (size_t j = 0; j < max(was.moves.size(), now.moves.size()); j++) {
+            if (j >= was.moves.size() || j >= now.moves.size()) {
+                fprintf(report, "  phase %lu: was %lu moves, now %lu\n", (unsigned long)i,
+                        (unsigned long)was.moves.size(), (unsigned long)now.moves.size());
+                comparison.matched = false;
+                return comparison;
+            }
+            const TraceMove& a = was.moves[j];
+            const TraceMove& b = now.moves[j];
+            if (a.id != b.id || a.position != b.position || a.time != b.time) {
+                fprintf(report, "  phase %lu move %lu: was servo %d to %ld in %d ms, now servo %d to %ld in %d ms\n",
+                        (unsigned long)i, (unsigned long)j, a.id, (long)a.position, a.time, b.id,
+                        (long)b.position, b.time);
+                comparison.matched = false;
+                return comparison;
+            }
+            noteDelta(comparison, (long)(b.ms - a.ms), toleranceMs);
+        }
+    }
+
+    if (expected.size() != actual.size()) {
+        fprintf(report, "  was %lu phases, now %lu\n", (unsigned long)expected.size(),
+                (unsigned long)actual.size());
+        comparison.matched = false;
+        return comparison;
+    }
+    comparison.endDeltaMs = (long)(current.getEndMs() - golden.getEndMs());
+    noteDelta(comparison, comparison.endDeltaMs, toleranceMs);
+    return comparison;
+}
@@ -0,0 +1,64 @@
+#ifndef SERVO_TRACE_H
+#define SERVO_TRACE_H
+
+#include <Arduino.h>
+
+#include <string>
+#include <vector>
+
+// The servo commands one motion routine sent, split into the phases of
+// the motion that sent them. Times are ms from the start of the routine.
+//
+// On disk, after a "# <routine>" line:
+//
+//   phase <start ms> <motion phase>      one per phase, -1 between motions
+//   <ms> <id> <position> <time>          one per servo move, as hexapod_sim -i reads
+//   end <ms>                             when the routine came to rest
+
+struct TraceMove {
+    unsigned long ms;
+    int id;
+    int32_t position;
+    int time;
+};
+
+struct TracePhase {
+    unsigned long startMs;
+    int motionPhase;
+    std::vector<TraceMove> moves;
+};
+
+class ServoTrace {
+public:
+    ServoTrace() : endMs(0) {}
+
+    void clear();
+    void beginPhase(unsigned long ms, int motionPhase);
+    void add(unsigned long ms, int id, int32_t position, int time);
+    void end(unsigned long ms) { endMs = ms; }
+
+    bool load(const char* path);
+    bool save(const char* path, const char* routine) const;
+
+    const std::vector<TracePhase>& getPhases() const { return phases; }
+    unsigned long getEndMs() const { return endMs; }
+    size_t moveCount() const;
+
+private:
+    std::vector<TracePhase> phases;
+    unsigned long endMs;
+};
+
+struct TraceComparison {
+    bool matched;               // same moves, every time within the tolerance
+    long maxDeltaMs;            // largest phase start or move time delta
+    long endDeltaMs;            // how much longer the routine now takes
+};
+
+// Diffs a run against its golden trace. Any move that differs in servo,
+// position or time ends the comparison; phase timing is reported for every
+// phase up to there, all of them when verbose and otherwise those that moved.
+TraceComparison compareTraces(const ServoTrace& golden, const ServoTrace& current, long toleranceMs,
+                              bool verbose, FILE* report);
+
+#endif
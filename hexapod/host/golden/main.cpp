@@ -0,0 +1,243 @@
+#include <Arduino.h>
+#include "HostRuntime.h"
+#include "Enums.h"
+#include "Constants.h"
+#include "NetworkServer.h"
+#include "PhasedMotion.h"
+#include "ServoShadow.h"
+#include "ServoTrace.h"
+
+#include <sys/stat.h>
+
+// Golden servo traces for the motion routines:
+//
+//   hexapod_golden [-d dir] record [routine...]            write the traces
+//   hexapod_golden [-d dir] [-t ms] [-v] check [routine...]  diff against them
+//   hexapod_golden list
+//
+// The firmware boots as on the robot, then every routine runs in turn
+// through the same commands a client sends, each starting from where the
+// one before left the legs. The foot switches read open, so every phase
+// runs its full scheduled time. Record the traces before a refactor and
+// commit them with it; check then fails on any servo, position or
+// duration change and on timing off by more than the tolerance
+// (0 ms unless given). Exits 1 on a mismatch.
+
+// The firmware, from main.cpp
+void setup();
+void controlTick(unsigned long now);
+void onClientCommand(int clientId, const char* command);
+extern PhasedMotion* activeMotion;
+extern volatile RobotMode currentMode;
+extern RobotMode lastTickMode;
+extern ServoShadow servoShadow;
+
+struct GoldenRoutine {
+    const char* name;
+    const char* gait;       // sent before the command, NULL for none
+    const char* command;
+    int cycles;             // gait cycles before STOP, 0 when it ends by itself
+};
+
+const GoldenRoutine GOLDEN_ROUTINES[] = {
+    {"tripod_forward",  "TRIPOD_GAIT", "FORWARD",  2},
+    {"tripod_backward", "TRIPOD_GAIT", "BACKWARD", 2},
+    {"tripod_left",     "TRIPOD_GAIT", "LEFT",     0},
+    {"tripod_right",    "TRIPOD_GAIT", "RIGHT",    0},
+    {"wave_forward",    "WAVE_GAIT",   "FORWARD",  1},
+    {"wave_backward",   "WAVE_GAIT",   "BACKWARD", 1},
+    {"lay_down",        NULL,          "LAY_DOWN", 0},
+    {"stand_up",        NULL,          "STAND_UP", 0},
+    {"dance",           NULL,          "DANCE",    0},
+};
+const int GOLDEN_ROUTINE_COUNT = sizeof(GOLDEN_ROUTINES) / sizeof(GOLDEN_ROUTINES[0]);
+
+const unsigned long GOLDEN_MAX_MS = 120000;
+const char* const DEFAULT_TRACE_DIR = "host/golden/traces";
+
+// Commands come in as from the serial console
+const int CONSOLE_CLIENT = MAX_CLIENTS;
+
+static ServoTrace* recording = NULL;
+static unsigned long routineStartMs = 0;
+static PhasedMotion* phaseMotion = NULL;
+static int phaseNumber = 0;
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_golden [-d dir] record [routine...]\n"
+                    "       hexapod_golden [-d dir] [-t ms] [-v] check [routine...]\n"
+                    "       hexapod_golden list\n");
+}
+
+// A new phase starts whenever the motion or its phase moves on
+static void onServoCommand(int id, int32_t position, int time) {
+    if (recording == NULL) {
+        return;
+    }
+    unsigned long ms = millis() - routineStartMs;
+    int phase = activeMotion != NULL ? activeMotion->currentPhase() : -1;
+    if (recording->getPhases().empty() || activeMotion != phaseMotion || phase != phaseNumber) {
+        recording->beginPhase(ms, phase);
+        phaseMotion = activeMotion;
+        phaseNumber = phase;
+    }
+    recording->add(ms, id, position, time);
+}
+
+static void tick() {
+    unsigned long now = millis() + 1000 / CONTROL_RATE_HZ;
+    hostSetTime(now);
+    controlTick(now);
+}
+
+// Runs one routine from its command until the legs are at rest again
+static bool runRoutine(const GoldenRoutine& routine, ServoTrace& trace) {
+    trace.clear();
+    recording = &trace;
+    routineStartMs = millis();
+    phaseMotion = NULL;
+
+    if (routine.gait != NULL) {
+        onClientCommand(CONSOLE_CLIENT, routine.gait);
+    }
+    onClientCommand(CONSOLE_CLIENT, routine.command);
+
+    int started = 0;
+    bool stopped = routine.cycles == 0;
+    while (millis() - routineStartMs < GOLDEN_MAX_MS) {
+        PhasedMotion* motionBefore = activeMotion;
+        int phaseBefore = motionBefore != NULL ? motionBefore->currentPhase() : -1;
+        tick();
+
+        // A gait cycle starts over in the same tick the last one ended;
+        // STOP lets the one running finish
+        bool cycleStarted = activeMotion != NULL &&
+                            (activeMotion != motionBefore || activeMotion->currentPhase() < phaseBefore);
+        if (!stopped && cycleStarted && ++started >= routine.cycles) {
+            onClientCommand(CONSOLE_CLIENT, "STOP");
+            stopped = true;
+        }
+        if (stopped && activeMotion == NULL && currentMode == lastTickMode) {
+            unsigned long restMs = millis();
+            for (int id = 0; id < SERVO_COUNT; id++) {
+                if ((long)(servoShadow.arrivalMs(id) - restMs) > 0) {
+                    restMs = servoShadow.arrivalMs(id);
+                }
+            }
+            hostSetTime(restMs);
+            trace.end(restMs - routineStartMs);
+            recording = NULL;
+            return true;
+        }
+    }
+    recording = NULL;
+    fprintf(stderr, "ERROR: %s did not finish in %lu ms\n", routine.name, GOLDEN_MAX_MS);
+    return false;
+}
+
+static bool isSelected(const char* name, char** selected, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(selected[i], name) == 0) {
+            return true;
+        }
+    }
+    return count == 0;
+}
+
+int main(int argc, char** argv) {
+    const char* directory = DEFAULT_TRACE_DIR;
+    long toleranceMs = 0;
+    bool verbose = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+            directory = argv[++arg];
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            toleranceMs = atol(argv[++arg]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (arg >= argc) {
+        usage();
+        return 2;
+    }
+    const char* action = argv[arg++];
+    if (strcmp(action, "list") == 0) {
+        for (int i = 0; i < GOLDEN_ROUTINE_COUNT; i++) {
+            printf("%s\n", GOLDEN_ROUTINES[i].name);
+        }
+        return 0;
+    }
+    bool checking = strcmp(action, "check") == 0;
+    if (!checking && strcmp(action, "record") != 0) {
+        usage();
+        return 2;
+    }
+    for (int i = arg; i < argc; i++) {
+        int known = 0;
+        while (known < GOLDEN_ROUTINE_COUNT && strcmp(argv[i], GOLDEN_ROUTINES[known].name) != 0) {
+            known++;
+        }
+        if (known == GOLDEN_ROUTINE_COUNT) {
+            fprintf(stderr, "ERROR: no routine %s, see hexapod_golden list\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (!checking) {
+        mkdir(directory, 0755);
+    }
+
+    hostSetConsole(verbose ? stderr : NULL);
+    hostOnServoCommand(onServoCommand);
+    setup();
+
+    // Every routine runs, so each starts from the same legs whichever are picked
+    int failed = 0;
+    for (int i = 0; i < GOLDEN_ROUTINE_COUNT; i++) {
+        const GoldenRoutine& routine = GOLDEN_ROUTINES[i];
+        ServoTrace trace;
+        if (!runRoutine(routine, trace)) {
+            return 1;
+        }
+        if (!isSelected(routine.name, argv + arg, argc - arg)) {
+            continue;
+        }
+
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s.trace", directory, routine.name);
+        if (!checking) {
+            if (!trace.save(path, routine.name)) {
+                return 1;
+            }
+            printf("%s: %lu phases, %lu moves in %lu ms\n", routine.name, (unsigned long)trace.getPhases().size(),
+                   (unsigned long)trace.moveCount(), trace.getEndMs());
+            continue;
+        }
+
+        ServoTrace golden;
+        if (!golden.load(path)) {
+            printf("%s: FAILED, no golden trace at %s\n", routine.name, path);
+            failed++;
+            continue;
+        }
+        TraceComparison comparison = compareTraces(golden, trace, toleranceMs, verbose, stdout);
+        printf("%s: %s, %lu moves, max delta %ld ms, ends %+ld ms\n", routine.name,
+               comparison.matched ? "ok" : "FAILED", (unsigned long)trace.moveCount(), comparison.maxDeltaMs,
+               comparison.endDeltaMs);
+        if (!comparison.matched) {
+            failed++;
+        }
+    }
+
+    if (checking && failed > 0) {
+        printf("%d routine%s FAILED\n", failed, failed == 1 ? "" : "s");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "LoadConnection.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+LoadConnection::LoadConnection(const std::string& host, const std::string& port)
+    : host(host), port(port), fd(-1), unexpected(0) {}
+
+LoadConnection::~LoadConnection() {
+    close(NULL);
+}
+
+bool LoadConnection::open() {
+    struct addrinfo hints = {};
+    struct addrinfo* address = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) {
+        return false;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+        freeaddrinfo(address);
+        close(NULL);
+        return false;
+    }
+    freeaddrinfo(address);
+
+    // Joystick updates go out one by one like the app's, not batched
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    line.clear();
+    return true;
+}
+
+void LoadConnection::close(LoadStats* stats) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (stats != NULL) {
+        for (size_t i = 0; i < pending.size(); i++) {
+            stats[pending[i].command].dropped++;
+        }
+    }
+    pending.clear();
+}
+
+bool LoadConnection::send(LoadCommand command, const std::string& text, double nowMs, LoadStats* stats) {
+    if (fd < 0) {
+        return false;
+    }
+    if (::send(fd, text.data(), text.size(), MSG_NOSIGNAL) != (ssize_t)text.size()) {
+        return false;
+    }
+    stats[command].sent++;
+    if (command != LOAD_POSE) {
+        Pending waiting = {command, nowMs};
+        pending.push_back(waiting);
+    }
+    return true;
+}
+
+bool LoadConnection::receive(double nowMs, LoadStats* stats) {
+    char buffer[512];
+    for (;;) {
+        ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length == 0) {
+            return false;
+        }
+        if (length < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        for (ssize_t i = 0; i < length; i++) {
+            char c = buffer[i];
+            if (c == '\0') {
+                reply(true, nowMs, stats);
+            } else if (c == '\n') {
+                if (!line.empty()) {
+                    reply(false, nowMs, stats);
+                }
+                line.clear();
+            } else if (c != '\r') {
+                line += c;
+            }
+        }
+    }
+}
+
+void LoadConnection::reply(bool zeroByte, double nowMs, LoadStats* stats) {
+    // Queue events are pushed on their own, they answer nothing
+    if (!zeroByte && line.compare(0, 6, "EVENT:") == 0) {
+        return;
+    }
+    if (pending.empty()) {
+        unexpected++;
+        return;
+    }
+
+    Pending oldest = pending.front();
+    pending.pop_front();
+    bool expected;
+    switch (oldest.command) {
+        case LOAD_PING:
+            expected = zeroByte;
+            break;
+        case LOAD_BATTERY:
+            expected = !zeroByte && line.compare(0, 8, "BATTERY:") == 0;
+            break;
+        default:
+            expected = !zeroByte && (line == "OK" || line == "ERROR");
+            break;
+    }
+    if (!expected) {
+        unexpected++;
+        stats[oldest.command].dropped++;
+        return;
+    }
+    if (line == "ERROR") {
+        stats[oldest.command].errors++;
+    }
+    stats[oldest.command].answered++;
+    stats[oldest.command].latencyMs.push_back(nowMs - oldest.sentMs);
+}
+
+void LoadConnection::expire(double nowMs, double timeoutMs, LoadStats* stats) {
+    while (!pending.empty() && nowMs - pending.front().sentMs > timeoutMs) {
+        stats[pending.front().command].dropped++;
+        pending.pop_front();
+    }
+}
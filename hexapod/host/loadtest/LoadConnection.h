@@ -0,0 +1,67 @@
+#ifndef LOAD_CONNECTION_H
+#define LOAD_CONNECTION_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// What a load test sends, and what it expects back
+enum LoadCommand {
+    LOAD_PING,          // a zero byte, echoed
+    LOAD_KEEPALIVE,     // PING, acked with OK
+    LOAD_MOVE,          // a mode command, acked with OK
+    LOAD_BATTERY,       // GET_BATTERY, answered with BATTERY:<percent>
+    LOAD_POSE,          // POSE:..., streamed without a reply
+    LOAD_COMMANDS
+};
+
+struct LoadStats {
+    unsigned long sent;
+    unsigned long answered;
+    unsigned long errors;       // answered with ERROR
+    unsigned long dropped;      // no answer within the timeout, or lost with the connection
+    std::vector<double> latencyMs;
+};
+
+// One client connection to the robot. Replies come back in the order the
+// commands went out, so each is matched to the oldest one still waiting.
+class LoadConnection {
+public:
+    LoadConnection(const std::string& host, const std::string& port);
+    ~LoadConnection();
+
+    bool open();
+    // Commands still waiting are counted as dropped
+    void close(LoadStats* stats);
+    bool isOpen() const { return fd >= 0; }
+    int getFd() const { return fd; }
+
+    bool send(LoadCommand command, const std::string& text, double nowMs, LoadStats* stats);
+
+    // Reads what arrived and matches the replies; false once the robot
+    // closed the connection
+    bool receive(double nowMs, LoadStats* stats);
+
+    // Gives up on commands waiting longer than timeoutMs
+    void expire(double nowMs, double timeoutMs, LoadStats* stats);
+
+    size_t waiting() const { return pending.size(); }
+    unsigned long getUnexpected() const { return unexpected; }
+
+private:
+    struct Pending {
+        LoadCommand command;
+        double sentMs;
+    };
+
+    std::string host;
+    std::string port;
+    int fd;
+    std::deque<Pending> pending;
+    std::string line;
+    unsigned long unexpected;   // replies with no command waiting, or of the wrong kind
+
+    void reply(bool zeroByte, double nowMs, LoadStats* stats);
+};
+
+#endif
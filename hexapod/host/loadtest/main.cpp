@@ -0,0 +1,277 @@
+#include "LoadConnection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <poll.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Operator traffic against the robot or hexapod_emulator:
+//
+//   hexapod_load [-c connections] [-r rate] [-b burst] [-d seconds]
+//                [-m mix] [-t timeout ms] [-s seed] host[:port]
+//
+// Every connection sends commands at rate per second, in bursts of burst
+// back to back the way joystick updates come in. Each command is drawn
+// from the mix, weights for ping (zero byte), keepalive (PING), move,
+// battery (GET_BATTERY) and pose (POSE:, no reply); the default is
+// ping:1,keepalive:1,move:2,battery:1,pose:5. A connection the robot
+// closes is opened again. At the end the answer latency percentiles,
+// drops and reconnects are reported; exits 1 if anything was dropped or
+// answered out of turn.
+
+const int DEFAULT_PORT = 8080;
+const double RECONNECT_DELAY_MS = 500;
+const int POLL_SLICE_MS = 5;
+
+const char* const COMMAND_NAMES[LOAD_COMMANDS] = {"ping", "keepalive", "move", "battery", "pose"};
+const int DEFAULT_MIX[LOAD_COMMANDS] = {1, 1, 2, 1, 5};
+
+// Moves keep the robot busy without walking it far from where it stands
+const char* const MOVE_COMMANDS[] = {"FORWARD", "STOP", "LEFT", "STOP", "BACKWARD", "STOP", "RIGHT", "STOP"};
+const int MOVE_COMMAND_COUNT = sizeof(MOVE_COMMANDS) / sizeof(MOVE_COMMANDS[0]);
+
+struct Client {
+    LoadConnection* connection;
+    double nextSendMs;
+    double reopenMs;
+    int moveIndex;
+};
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_load [-c connections] [-r rate] [-b burst] [-d seconds]\n"
+                    "                    [-m mix] [-t timeout ms] [-s seed] host[:port]\n");
+}
+
+static double nowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "ping:1,move:4" style weights; commands left out get none
+static bool parseMix(const char* text, int* mix) {
+    memset(mix, 0, sizeof(int) * LOAD_COMMANDS);
+    std::string spec(text);
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        std::string item = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        size_t colon = item.find(':');
+        int command = 0;
+        while (command < LOAD_COMMANDS && item.compare(0, colon, COMMAND_NAMES[command]) != 0) {
+            command++;
+        }
+        if (colon == std::string::npos || command == LOAD_COMMANDS) {
+            fprintf(stderr, "ERROR: bad mix entry %s\n", item.c_str());
+            return false;
+        }
+        mix[command] = atoi(item.c_str() + colon + 1);
+        start = end == std::string::npos ? spec.size() : end + 1;
+    }
+    int total = 0;
+    for (int i = 0; i < LOAD_COMMANDS; i++) {
+        total += mix[i];
+    }
+    return total > 0;
+}
+
+static std::string commandText(LoadCommand command, Client& client, std::mt19937& random) {
+    switch (command) {
+        case LOAD_PING:
+            return std::string(1, '\0');
+        case LOAD_KEEPALIVE:
+            return "PING\n";
+        case LOAD_MOVE:
+            return std::string(MOVE_COMMANDS[client.moveIndex++ % MOVE_COMMAND_COUNT]) + "\n";
+        case LOAD_BATTERY:
+            return "GET_BATTERY\n";
+        default: {
+            // A small body sway, like a joystick held off center
+            std::uniform_real_distribution<float> sway(-10, 10);
+            char pose[96];
+            snprintf(pose, sizeof(pose), "POSE:%.1f,%.1f,0,%.1f,%.1f,0\n", sway(random), sway(random),
+                     sway(random) / 2, sway(random) / 2);
+            return pose;
+        }
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)(fraction * sorted.size());
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static void printStats(const char* name, LoadStats& stats) {
+    std::sort(stats.latencyMs.begin(), stats.latencyMs.end());
+    printf("%-10s sent %7lu  answered %7lu  dropped %5lu  errors %5lu", name, stats.sent, stats.answered,
+           stats.dropped, stats.errors);
+    if (!stats.latencyMs.empty()) {
+        printf("  ms p50 %.2f p90 %.2f p99 %.2f p99.9 %.2f max %.2f", percentile(stats.latencyMs, 0.5),
+               percentile(stats.latencyMs, 0.9), percentile(stats.latencyMs, 0.99),
+               percentile(stats.latencyMs, 0.999), stats.latencyMs.back());
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int connections = 1;
+    double rate = 20;
+    int burst = 1;
+    double seconds = 10;
+    double timeoutMs = 2000;
+    unsigned int seed = 1;
+    int mix[LOAD_COMMANDS];
+    memcpy(mix, DEFAULT_MIX, sizeof(mix));
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        const char* value = argv[arg + 1];
+        if (strcmp(argv[arg], "-c") == 0) {
+            connections = std::max(1, atoi(value));
+        } else if (strcmp(argv[arg], "-r") == 0) {
+            rate = atof(value);
+        } else if (strcmp(argv[arg], "-b") == 0) {
+            burst = std::max(1, atoi(value));
+        } else if (strcmp(argv[arg], "-d") == 0) {
+            seconds = atof(value);
+        } else if (strcmp(argv[arg], "-m") == 0) {
+            if (!parseMix(value, mix)) {
+                return 2;
+            }
+        } else if (strcmp(argv[arg], "-t") == 0) {
+            timeoutMs = atof(value);
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            seed = strtoul(value, NULL, 10);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - arg != 1 || rate <= 0) {
+        usage();
+        return 2;
+    }
+
+    std::string host(argv[arg]);
+    std::string port = std::to_string(DEFAULT_PORT);
+    size_t colon = host.find(':');
+    if (colon != std::string::npos) {
+        port = host.substr(colon + 1);
+        host = host.substr(0, colon);
+    }
+
+    std::mt19937 random(seed);
+    std::discrete_distribution<int> pick(mix, mix + LOAD_COMMANDS);
+    LoadStats stats[LOAD_COMMANDS] = {};
+    unsigned long reconnects = 0;
+    unsigned long failedOpens = 0;
+
+    // Connections start spread over one burst interval
+    double burstIntervalMs = 1000.0 * burst / rate;
+    double startMs = nowMs();
+    std::vector<Client> clients(connections);
+    for (int i = 0; i < connections; i++) {
+        clients[i].connection = new LoadConnection(host, port);
+        clients[i].nextSendMs = startMs + burstIntervalMs * i / connections;
+        clients[i].reopenMs = 0;
+        clients[i].moveIndex = 0;
+        if (!clients[i].connection->open()) {
+            fprintf(stderr, "ERROR: could not connect to %s:%s\n", host.c_str(), port.c_str());
+            return 1;
+        }
+    }
+
+    double endMs = startMs + seconds * 1000;
+    for (;;) {
+        double now = nowMs();
+        bool sending = now < endMs;
+        size_t waiting = 0;
+        for (int i = 0; i < connections; i++) {
+            waiting += clients[i].connection->waiting();
+        }
+        if (!sending && waiting == 0) {
+            break;
+        }
+        if (!sending && now > endMs + timeoutMs) {
+            break;
+        }
+
+        std::vector<struct pollfd> fds;
+        std::vector<int> owners;
+        for (int i = 0; i < connections; i++) {
+            if (clients[i].connection->isOpen()) {
+                struct pollfd entry = {clients[i].connection->getFd(), POLLIN, 0};
+                fds.push_back(entry);
+                owners.push_back(i);
+            }
+        }
+        poll(fds.data(), fds.size(), POLL_SLICE_MS);
+
+        now = nowMs();
+        for (size_t i = 0; i < fds.size(); i++) {
+            Client& client = clients[owners[i]];
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !client.connection->receive(now, stats)) {
+                client.connection->close(stats);
+                client.reopenMs = now + RECONNECT_DELAY_MS;
+            }
+        }
+
+        for (int i = 0; i < connections; i++) {
+            Client& client = clients[i];
+            LoadConnection& connection = *client.connection;
+            if (!connection.isOpen()) {
+                if (sending && now >= client.reopenMs) {
+                    if (connection.open()) {
+                        reconnects++;
+                    } else {
+                        failedOpens++;
+                        client.reopenMs = now + RECONNECT_DELAY_MS;
+                    }
+                }
+                continue;
+            }
+            connection.expire(now, timeoutMs, stats);
+
+            // A burst that fell behind is sent late, not skipped
+            if (sending && now >= client.nextSendMs) {
+                for (int n = 0; n < burst && connection.isOpen(); n++) {
+                    LoadCommand command = (LoadCommand)pick(random);
+                    if (!connection.send(command, commandText(command, client, random), now, stats)) {
+                        connection.close(stats);
+                        client.reopenMs = now + RECONNECT_DELAY_MS;
+                    }
+                }
+                client.nextSendMs += burstIntervalMs;
+            }
+        }
+    }
+
+    unsigned long unexpected = 0;
+    for (int i = 0; i < connections; i++) {
+        clients[i].connection->expire(nowMs(), 0, stats);
+        unexpected += clients[i].connection->getUnexpected();
+        delete clients[i].connection;
+    }
+
+    printf("%s:%s, %d connection%s at %.1f commands/s in bursts of %d for %.1f s\n", host.c_str(), port.c_str(),
+           connections, connections == 1 ? "" : "s", rate, burst, seconds);
+    LoadStats total = {};
+    for (int i = 0; i < LOAD_COMMANDS; i++) {
+        if (stats[i].sent == 0) {
+            continue;
+        }
+        printStats(COMMAND_NAMES[i], stats[i]);
+        total.sent += stats[i].sent;
+        total.answered += stats[i].answered;
+        total.dropped += stats[i].dropped;
+        total.errors += stats[i].errors;
+        total.latencyMs.insert(total.latencyMs.end(), stats[i].latencyMs.begin(), stats[i].latencyMs.end());
+    }
+    printStats("all", total);
+    printf("reconnects %lu, failed connects %lu, answers out of turn %lu\n", reconnects, failedOpens, unexpected);
+    return total.dropped > 0 || unexpected > 0 ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+#include "CmaEs.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Jacobi sweeps before giving up on an eigen decomposition
+const int JACOBI_MAX_SWEEPS = 50;
+
+
+CmaEs::CmaEs(const Vector& start, double sigma, int populationSize, uint32_t seed)
+    : n(start.size()), mean(start), sigma(sigma), generation(0), random(seed) {
+    lambda = std::max(populationSize, defaultPopulation(n));
+    mu = lambda / 2;
+
+    weights.resize(mu);
+    double sum = 0;
+    for (int i = 0; i < mu; i++) {
+        weights[i] = log(mu + 0.5) - log(i + 1.0);
+        sum += weights[i];
+    }
+    double squares = 0;
+    for (int i = 0; i < mu; i++) {
+        weights[i] /= sum;
+        squares += weights[i] * weights[i];
+    }
+    muEff = 1.0 / squares;
+
+    cc = (4.0 + muEff / n) / (n + 4.0 + 2.0 * muEff / n);
+    cs = (muEff + 2.0) / (n + muEff + 5.0);
+    c1 = 2.0 / ((n + 1.3) * (n + 1.3) + muEff);
+    cmu = std::min(1.0 - c1, 2.0 * (muEff - 2.0 + 1.0 / muEff) / ((n + 2.0) * (n + 2.0) + muEff));
+    damps = 1.0 + 2.0 * std::max(0.0, sqrt((muEff - 1.0) / (n + 1.0)) - 1.0) + cs;
+    chiN = sqrt((double)n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+    pc.assign(n, 0);
+    ps.assign(n, 0);
+    C.assign(n, Vector(n, 0));
+    B.assign(n, Vector(n, 0));
+    D.assign(n, 1);
+    for (int i = 0; i < n; i++) {
+        C[i][i] = 1;
+        B[i][i] = 1;
+    }
+}
+
+int CmaEs::defaultPopulation(int dimensions) {
+    return 4 + (int)(3 * log((double)dimensions));
+}
+
+void CmaEs::sample(std::vector<Vector>& population) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    population.assign(lambda, Vector(n));
+    Vector z(n);
+    for (int k = 0; k < lambda; k++) {
+        for (int i = 0; i < n; i++) {
+            z[i] = D[i] * normal(random);
+        }
+        for (int i = 0; i < n; i++) {
+            double step = 0;
+            for (int j = 0; j < n; j++) {
+                step += B[i][j] * z[j];
+            }
+            population[k][i] = mean[i] + sigma * step;
+        }
+    }
+}
+
+void CmaEs::update(const std::vector<Vector>& population, const Vector& costs) {
+    std::vector<int> order(lambda);
+    for (int k = 0; k < lambda; k++) {
+        order[k] = k;
+    }
+    std::sort(order.begin(), order.end(), [&costs](int a, int b) { return costs[a] < costs[b]; });
+
+    Vector previous = mean;
+    for (int i = 0; i < n; i++) {
+        mean[i] = 0;
+        for (int k = 0; k < mu; k++) {
+            mean[i] += weights[k] * population[order[k]][i];
+        }
+    }
+
+    // Mean step, and the same step whitened by C^-1/2 = B D^-1 B^T
+    Vector step(n), rotated(n, 0), whitened(n, 0);
+    for (int i = 0; i < n; i++) {
+        step[i] = (mean[i] - previous[i]) / sigma;
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            rotated[j] += B[i][j] * step[i];
+        }
+        rotated[j] /= D[j];
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            whitened[i] += B[i][j] * rotated[j];
+        }
+    }
+
+    double psNorm = 0;
+    for (int i = 0; i < n; i++) {
+        ps[i] = (1 - cs) * ps[i] + sqrt(cs * (2 - cs) * muEff) * whitened[i];
+        psNorm += ps[i] * ps[i];
+    }
+    psNorm = sqrt(psNorm);
+    generation++;
+    bool stalled = psNorm / sqrt(1 - pow(1 - cs, 2.0 * generation)) / chiN >= 1.4 + 2.0 / (n + 1);
+    double hsig = stalled ? 0 : 1;
+
+    for (int i = 0; i < n; i++) {
+        pc[i] = (1 - cc) * pc[i] + hsig * sqrt(cc * (2 - cc) * muEff) * step[i];
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            double rankMu = 0;
+            for (int k = 0; k < mu; k++) {
+                const Vector& x = population[order[k]];
+                rankMu += weights[k] * (x[i] - previous[i]) * (x[j] - previous[j]);
+            }
+            rankMu /= sigma * sigma;
+            double rankOne = pc[i] * pc[j] + (1 - hsig) * cc * (2 - cc) * C[i][j];
+            C[i][j] = (1 - c1 - cmu) * C[i][j] + c1 * rankOne + cmu * rankMu;
+            C[j][i] = C[i][j];
+        }
+    }
+
+    sigma *= exp((cs / damps) * (psNorm / chiN - 1));
+    decompose();
+}
+
+// Eigen decomposition of C into B and D with cyclic Jacobi rotations,
+// plenty for the handful of dimensions searched here
+void CmaEs::decompose() {
+    std::vector<Vector> a = C;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            B[i][j] = i == j ? 1 : 0;
+        }
+    }
+
+    for (int sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++) {
+        double offDiagonal = 0;
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                offDiagonal += a[p][q] * a[p][q];
+            }
+        }
+        if (offDiagonal < 1e-20) {
+            break;
+        }
+
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                if (fabs(a[p][q]) < 1e-30) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                double c = 1 / sqrt(t * t + 1);
+                double s = t * c;
+                for (int k = 0; k < n; k++) {
+                    double kp = a[k][p], kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < n; k++) {
+                    double pk = a[p][k], qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < n; k++) {
+                    double kp = B[k][p], kq = B[k][q];
+                    B[k][p] = c * kp - s * kq;
+                    B[k][q] = s * kp + c * kq;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        D[i] = sqrt(std::max(a[i][i], 1e-20));
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef CMA_ES_H
+#define CMA_ES_H
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+typedef std::vector<double> Vector;
+
+// Covariance matrix adaptation evolution strategy, minimizing a cost.
+// Each generation sample() draws a population around the mean, the
+// caller scores it, and update() moves the mean towards the best half
+// and reshapes the search distribution along the steps that paid off.
+// Follows Hansen's tutorial with the default strategy parameters.
+class CmaEs {
+public:
+    CmaEs(const Vector& start, double sigma, int populationSize, uint32_t seed);
+
+    int getPopulationSize() const { return lambda; }
+    const Vector& getMean() const { return mean; }
+    double getSigma() const { return sigma; }
+
+    void sample(std::vector<Vector>& population);
+    void update(const std::vector<Vector>& population, const Vector& costs);
+
+    // Default population for a problem size, 4 + 3 ln(n)
+    static int defaultPopulation(int dimensions);
+
+private:
+    int n;
+    int lambda;
+    int mu;
+    Vector weights;
+    double muEff;
+    double cc, cs, c1, cmu, damps, chiN;
+
+    Vector mean;
+    double sigma;
+    Vector pc;
+    Vector ps;
+    std::vector<Vector> C;
+    std::vector<Vector> B;
+    Vector D;
+    int generation;
+    std::mt19937 random;
+
+    void decompose();
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "GaitOptimizer.h"
+#include "HostRuntime.h"
+#include "SimulatedRobot.h"
+
+#include <atomic>
+#include <thread>
+
+// Start of the search, as a fraction of each range
+const double OPT_START_SIGMA = 0.2;
+
+const SearchDimension TRIPOD_DIMENSIONS[] = {
+    {"coxaForward",  NULL,                    &GaitStride::coxaForward,  10000, 11900},
+    {"coxaBackward", NULL,                    &GaitStride::coxaBackward, 12100, 14500},
+    {"femurLift",    NULL,                    &GaitStride::femurLift,    15000, 19000},
+    {"liftTime",     &GaitTiming::liftTime,   NULL,                      60,    300},
+    {"swingTime",    &GaitTiming::swingTime,  NULL,                      80,    400},
+    {"lowerTime",    &GaitTiming::lowerTime,  NULL,                      60,    300},
+};
+
+const SearchDimension WAVE_DIMENSIONS[] = {
+    {"coxaForward",   NULL,                       &GaitStride::coxaForward,  10000, 11900},
+    {"coxaBackward",  NULL,                       &GaitStride::coxaBackward, 12100, 14500},
+    {"femurLift",     NULL,                       &GaitStride::femurLift,    15000, 19000},
+    {"bodyPush",      NULL,                       &GaitStride::bodyPush,     200,   1500},
+    {"waveLiftTime",  &GaitTiming::waveLiftTime,  NULL,                      50,    250},
+    {"waveSwingTime", &GaitTiming::waveSwingTime, NULL,                      60,    300},
+    {"waveLowerTime", &GaitTiming::waveLowerTime, NULL,                      50,    250},
+    {"waveShiftTime", &GaitTiming::waveShiftTime, NULL,                      50,    250},
+};
+
+
+GaitOptimizer::GaitOptimizer(GaitPattern pattern, int threads, int population, uint32_t seed)
+    : pattern(pattern), threads(max(threads, 1)), population(population), seed(seed) {
+    if (pattern == WAVE) {
+        dimensions = WAVE_DIMENSIONS;
+        dimensionCount = sizeof(WAVE_DIMENSIONS) / sizeof(WAVE_DIMENSIONS[0]);
+    } else {
+        dimensions = TRIPOD_DIMENSIONS;
+        dimensionCount = sizeof(TRIPOD_DIMENSIONS) / sizeof(TRIPOD_DIMENSIONS[0]);
+    }
+    base.timing = defaultGaitTiming();
+    base.stride = defaultGaitStride();
+    best = base;
+    bestScore = evaluate(base);
+}
+
+int& GaitOptimizer::field(GaitCandidate& candidate, const SearchDimension& dimension) {
+    return dimension.timing != NULL ? candidate.timing.*dimension.timing : candidate.stride.*dimension.stride;
+}
+
+int GaitOptimizer::value(const GaitCandidate& candidate, const SearchDimension& dimension) {
+    return dimension.timing != NULL ? candidate.timing.*dimension.timing : candidate.stride.*dimension.stride;
+}
+
+GaitCandidate GaitOptimizer::decode(const Vector& point, float& outside) const {
+    GaitCandidate candidate = base;
+    outside = 0;
+    for (int i = 0; i < dimensionCount; i++) {
+        const SearchDimension& dimension = dimensions[i];
+        double scaled = constrain(point[i], 0.0, 1.0);
+        outside += (point[i] - scaled) * (point[i] - scaled);
+        field(candidate, dimension) = dimension.minimum + (int)lround(scaled * (dimension.maximum - dimension.minimum));
+    }
+    return candidate;
+}
+
+Vector GaitOptimizer::encode(const GaitCandidate& candidate) const {
+    Vector point(dimensionCount);
+    for (int i = 0; i < dimensionCount; i++) {
+        const SearchDimension& dimension = dimensions[i];
+        point[i] = (double)(value(candidate, dimension) - dimension.minimum) / (dimension.maximum - dimension.minimum);
+    }
+    return point;
+}
+
+GaitScore GaitOptimizer::evaluate(const GaitCandidate& candidate) const {
+    hostSetConsole(NULL);
+    SimulatedRobot robot;
+    CycleReport reports[OPT_WARMUP_CYCLES + OPT_MEASURED_CYCLES];
+    robot.runCycles(pattern, WALK_FORWARD, OPT_WARMUP_CYCLES + OPT_MEASURED_CYCLES, 1.0f, candidate.timing,
+                    candidate.stride, reports);
+
+    GaitScore result = {};
+    unsigned long duration = 0;
+    float forward = 0, effort = 0, slip = 0, drift = 0, turn = 0;
+    result.minMargin = reports[OPT_WARMUP_CYCLES].minMargin;
+    for (int i = OPT_WARMUP_CYCLES; i < OPT_WARMUP_CYCLES + OPT_MEASURED_CYCLES; i++) {
+        duration += reports[i].durationMs;
+        forward += reports[i].forward;
+        effort += reports[i].effort;
+        slip += reports[i].slip;
+        drift += reports[i].lateral;
+        turn += reports[i].turn;
+        result.unsupportedMs += reports[i].unsupportedMs;
+        result.minMargin = min(result.minMargin, reports[i].minMargin);
+    }
+
+    result.speed = duration > 0 ? forward * 1000.0f / duration : 0;
+    result.effort = forward > 1.0f ? effort / forward : effort;
+    result.slip = slip / OPT_MEASURED_CYCLES;
+    result.drift = fabs(drift) / OPT_MEASURED_CYCLES;
+    result.turn = fabs(turn) / OPT_MEASURED_CYCLES;
+    result.score = result.speed - OPT_MARGIN_WEIGHT * max(0.0f, OPT_MIN_MARGIN - result.minMargin) -
+                   OPT_EFFORT_WEIGHT * result.effort - OPT_SLIP_WEIGHT * result.slip -
+                   OPT_DRIFT_WEIGHT * result.drift - OPT_TURN_WEIGHT * result.turn -
+                   OPT_UNSUPPORTED_WEIGHT * result.unsupportedMs;
+    return result;
+}
+
+void GaitOptimizer::evaluateAll(const std::vector<GaitCandidate>& candidates, std::vector<GaitScore>& scores) const {
+    scores.resize(candidates.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < candidates.size(); i = next++) {
+            scores[i] = evaluate(candidates[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+}
+
+void GaitOptimizer::run(int generations) {
+    CmaEs search(encode(base), OPT_START_SIGMA, population, seed);
+    std::vector<Vector> points;
+    std::vector<GaitCandidate> candidates;
+    std::vector<float> outside;
+    std::vector<GaitScore> scores;
+    Vector costs;
+
+    for (int generation = 1; generation <= generations; generation++) {
+        search.sample(points);
+        candidates.resize(points.size());
+        outside.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            candidates[i] = decode(points[i], outside[i]);
+        }
+
+        evaluateAll(candidates, scores);
+
+        costs.resize(points.size());
+        int generationBest = 0;
+        for (size_t i = 0; i < points.size(); i++) {
+            costs[i] = -scores[i].score + OPT_BOUNDS_WEIGHT * outside[i];
+            if (costs[i] < costs[generationBest]) {
+                generationBest = i;
+            }
+            if (outside[i] == 0 && scores[i].score > bestScore.score) {
+                best = candidates[i];
+                bestScore = scores[i];
+            }
+        }
+        search.update(points, costs);
+
+        printf("generation %d: best %.1f (%.1f mm/s), overall %.1f (%.1f mm/s), sigma %.3f\n", generation,
+               scores[generationBest].score, scores[generationBest].speed, bestScore.score, bestScore.speed,
+               search.getSigma());
+        fflush(stdout);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef GAIT_OPTIMIZER_H
+#define GAIT_OPTIMIZER_H
+
+#include <Arduino.h>
+#include "Enums.h"
+#include "GaitTiming.h"
+#include "CmaEs.h"
+
+// Cycles run before measuring, so the gait starts from its own stride
+const int OPT_WARMUP_CYCLES = 1;
+const int OPT_MEASURED_CYCLES = 3;
+
+// Score weights, in mm/s of forward speed given up per unit
+const float OPT_MIN_MARGIN = 15.0f;        // mm of stability margin wanted
+const float OPT_MARGIN_WEIGHT = 4.0f;      // per mm below that
+const float OPT_EFFORT_WEIGHT = 4.0f;      // per joint degree turned per mm walked
+const float OPT_SLIP_WEIGHT = 0.5f;        // per mm of slip per cycle
+const float OPT_DRIFT_WEIGHT = 0.5f;       // per mm sideways per cycle
+const float OPT_TURN_WEIGHT = 5.0f;        // per degree of heading lost per cycle
+const float OPT_UNSUPPORTED_WEIGHT = 1.0f; // per ms with fewer than three feet down
+const float OPT_BOUNDS_WEIGHT = 1000.0f;   // per squared range outside the bounds
+
+// One searched parameter, named as in the parameter store
+struct SearchDimension {
+    const char* name;
+    int GaitTiming::* timing;
+    int GaitStride::* stride;
+    int minimum;
+    int maximum;
+};
+
+struct GaitCandidate {
+    GaitTiming timing;
+    GaitStride stride;
+};
+
+struct GaitScore {
+    float score;
+    float speed;            // mm/s forward
+    float minMargin;        // mm
+    float effort;           // joint degrees per mm walked
+    float slip;             // mm per cycle
+    float drift;            // mm sideways per cycle
+    float turn;             // degrees per cycle
+    unsigned long unsupportedMs;
+};
+
+// Searches the stride and move times of one walking gait with CMA-ES over
+// the host simulator, scoring forward speed against stability margin,
+// servo effort and slip. Settle delays are left alone: the simulator has
+// no settling to measure, the robot's AUTO_TUNE does that. Candidates are
+// evaluated on worker threads, each with its own simulated robot, so a
+// run gives the same answer for any number of threads.
+class GaitOptimizer {
+public:
+    GaitOptimizer(GaitPattern pattern, int threads, int population, uint32_t seed);
+
+    // Runs the search, printing a line per generation
+    void run(int generations);
+
+    GaitScore evaluate(const GaitCandidate& candidate) const;
+
+    const GaitCandidate& getBest() const { return best; }
+    const GaitScore& getBestScore() const { return bestScore; }
+
+    const SearchDimension* getDimensions() const { return dimensions; }
+    int getDimensionCount() const { return dimensionCount; }
+
+    // Where a dimension's value lives in a candidate
+    static int& field(GaitCandidate& candidate, const SearchDimension& dimension);
+    static int value(const GaitCandidate& candidate, const SearchDimension& dimension);
+
+private:
+    GaitPattern pattern;
+    int threads;
+    int population;
+    uint32_t seed;
+    const SearchDimension* dimensions;
+    int dimensionCount;
+    GaitCandidate base;
+    GaitCandidate best;
+    GaitScore bestScore;
+
+    // The search runs on every dimension scaled to 0..1
+    GaitCandidate decode(const Vector& point, float& outside) const;
+    Vector encode(const GaitCandidate& candidate) const;
+    void evaluateAll(const std::vector<GaitCandidate>& candidates, std::vector<GaitScore>& scores) const;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include <Arduino.h>
+#include <thread>
+#include "GaitOptimizer.h"
+
+// Offline gait parameter search on the host simulator:
+//
+//   hexapod_optimize [-j threads] [-p population] [-s seed] [-o params.txt] tripod|wave [generations]
+//
+// Prints the best parameter set as SET_PARAM commands, ready to send to
+// the robot, and writes them to the -o file as well.
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_optimize [-j threads] [-p population] [-s seed] [-o params] "
+                    "tripod|wave [generations]\n");
+}
+
+static void printScore(const char* name, const GaitScore& score) {
+    printf("%s: score %.1f, %.1f mm/s, margin %.1f mm, effort %.2f deg/mm, slip %.1f mm, drift %.1f mm, "
+           "turn %.1f deg, unsupported %lu ms\n",
+           name, score.score, score.speed, score.minMargin, score.effort, score.slip, score.drift, score.turn,
+           score.unsupportedMs);
+}
+
+int main(int argc, char** argv) {
+    int threads = std::thread::hardware_concurrency();
+    int population = 0;
+    uint32_t seed = 1;
+    const char* outputPath = NULL;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (arg + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        if (strcmp(argv[arg], "-j") == 0) {
+            threads = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-p") == 0) {
+            population = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            seed = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            outputPath = argv[++arg];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (arg >= argc || (strcmp(argv[arg], "tripod") != 0 && strcmp(argv[arg], "wave") != 0)) {
+        usage();
+        return 2;
+    }
+    GaitPattern pattern = strcmp(argv[arg], "wave") == 0 ? WAVE : TRIPOD;
+    int generations = arg + 1 < argc ? max(atoi(argv[arg + 1]), 1) : 40;
+
+    // Fill every core by default, the population is at least the CMA-ES default
+    if (population <= 0) {
+        population = threads;
+    }
+
+    GaitOptimizer optimizer(pattern, threads, population, seed);
+    GaitScore start = optimizer.getBestScore();
+    printScore("defaults", start);
+    optimizer.run(generations);
+    printScore("best", optimizer.getBestScore());
+
+    FILE* output = NULL;
+    if (outputPath != NULL && (output = fopen(outputPath, "w")) == NULL) {
+        fprintf(stderr, "ERROR: could not write %s\n", outputPath);
+    }
+    for (int i = 0; i < optimizer.getDimensionCount(); i++) {
+        const SearchDimension& dimension = optimizer.getDimensions()[i];
+        int value = GaitOptimizer::value(optimizer.getBest(), dimension);
+        printf("SET_PARAM:%s=%d\n", dimension.name, value);
+        if (output != NULL) {
+            fprintf(output, "SET_PARAM:%s=%d\n", dimension.name, value);
+        }
+    }
+    if (output != NULL) {
+        fclose(output);
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of the Arduino core for the firmware sources to build and
+// run on a workstation. Time, pins and the console are provided by
+// HostPlatform.cpp and steered through HostRuntime.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LOW 0
+#define HIGH 1
+
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+#define radians(deg) ((deg) * 0.017453292519943295)
+#define degrees(rad) ((rad) * 57.29577951308232)
+
+template <typename T>
+T min(T a, T b) {
+    return a < b ? a : b;
+}
+
+template <typename T>
+T max(T a, T b) {
+    return a > b ? a : b;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+int analogRead(int pin);
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+
+typedef enum {
+    ADC_0db,
+    ADC_2_5db,
+    ADC_6db,
+    ADC_11db
+} adc_attenuation_t;
+
+void analogReadResolution(int bits);
+void analogSetPinAttenuation(int pin, adc_attenuation_t attenuation);
+
+class String {
+public:
+    String() {}
+    String(const char* text) : text(text != NULL ? text : "") {}
+    String(const std::string& text) : text(text) {}
+    explicit String(char c) : text(1, c) {}
+    String(int value) : text(std::to_string(value)) {}
+    String(unsigned int value) : text(std::to_string(value)) {}
+    String(long value) : text(std::to_string(value)) {}
+    String(unsigned long value) : text(std::to_string(value)) {}
+    String(double value, int decimals = 2);
+
+    unsigned int length() const { return text.size(); }
+    const char* c_str() const { return text.c_str(); }
+    char charAt(unsigned int index) const { return index < text.size() ? text[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(text.find(c, from)); }
+    int indexOf(const char* part, unsigned int from = 0) const { return found(text.find(part, from)); }
+    int indexOf(const String& part, unsigned int from = 0) const { return found(text.find(part.text, from)); }
+    int lastIndexOf(char c) const { return found(text.rfind(c)); }
+
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void trim();
+    bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+
+    long toInt() const { return strtol(text.c_str(), NULL, 10); }
+    float toFloat() const { return strtof(text.c_str(), NULL); }
+
+    bool reserve(unsigned int size) {
+        text.reserve(size);
+        return true;
+    }
+
+    String& operator+=(const String& other) {
+        text += other.text;
+        return *this;
+    }
+    String& operator+=(const char* other) {
+        text += other;
+        return *this;
+    }
+    String& operator+=(char c) {
+        text += c;
+        return *this;
+    }
+
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator==(const char* other) const { return text == other; }
+    bool operator!=(const String& other) const { return text != other.text; }
+    bool operator!=(const char* other) const { return text != other; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.text + b.text); }
+    friend String operator+(const String& a, const char* b) { return String(a.text + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.text); }
+
+private:
+    std::string text;
+
+    static int found(size_t position) {
+        return position == std::string::npos ? -1 : (int)position;
+    }
+};
+
+// Console output goes to the stream set with hostSetConsole
+class Print {
+public:
+    virtual ~Print() {}
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t* data, size_t length);
+
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value, int decimals = 2) { return printf("%.*f", decimals, value); }
+
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) {
+        return print(value) + println();
+    }
+    size_t println(double value, int decimals) { return print(value, decimals) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    operator bool() const { return true; }
+
+    // Nothing is typed on a host console; tools that want local commands
+    // call the command handler directly
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+#endif
@@ -0,0 +1,279 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include <PID_v1.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+#include <map>
+
+TwoWire Wire;
+WiFiClass WiFi;
+
+static thread_local std::map<std::string, std::string>* storage = NULL;
+
+
+void analogReadResolution(int bits) {}
+
+void analogSetPinAttenuation(int pin, adc_attenuation_t attenuation) {}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodMicros) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    return ESP_FAIL;
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)micros();
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 0;
+}
+
+PID::PID(double* input, double* output, double* setpoint, double kp, double ki, double kd, int direction)
+    : input(input), output(output), setpoint(setpoint), direction(direction), automatic(false),
+      sampleTimeMs(100), outputSum(0), lastInput(0), outMin(0), outMax(255) {
+    SetTunings(kp, ki, kd);
+    lastTime = millis() - sampleTimeMs;
+}
+
+bool PID::Compute() {
+    if (!automatic) {
+        return false;
+    }
+    unsigned long now = millis();
+    if (now - lastTime < sampleTimeMs) {
+        return false;
+    }
+
+    double measured = *input;
+    double error = *setpoint - measured;
+    double change = measured - lastInput;
+    outputSum = constrain(outputSum + ki * error, outMin, outMax);
+    *output = constrain(kp * error + outputSum - kd * change, outMin, outMax);
+    lastInput = measured;
+    lastTime = now;
+    return true;
+}
+
+void PID::SetMode(int mode) {
+    bool enable = mode == AUTOMATIC;
+    if (enable && !automatic) {
+        initialize();
+    }
+    automatic = enable;
+}
+
+void PID::SetOutputLimits(double minimum, double maximum) {
+    if (minimum >= maximum) {
+        return;
+    }
+    outMin = minimum;
+    outMax = maximum;
+    if (automatic) {
+        *output = constrain(*output, outMin, outMax);
+        outputSum = constrain(outputSum, outMin, outMax);
+    }
+}
+
+void PID::SetTunings(double p, double i, double d) {
+    if (p < 0 || i < 0 || d < 0) {
+        return;
+    }
+    double seconds = sampleTimeMs / 1000.0;
+    double sign = direction == REVERSE ? -1 : 1;
+    kp = sign * p;
+    ki = sign * i * seconds;
+    kd = sign * d / seconds;
+}
+
+void PID::SetSampleTime(int newSampleTimeMs) {
+    if (newSampleTimeMs <= 0) {
+        return;
+    }
+    double ratio = (double)newSampleTimeMs / sampleTimeMs;
+    ki *= ratio;
+    kd /= ratio;
+    sampleTimeMs = newSampleTimeMs;
+}
+
+void PID::SetControllerDirection(int newDirection) {
+    if (automatic && newDirection != direction) {
+        kp = -kp;
+        ki = -ki;
+        kd = -kd;
+    }
+    direction = newDirection;
+}
+
+void PID::initialize() {
+    outputSum = constrain(*output, outMin, outMax);
+    lastInput = *input;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    if (storage == NULL) {
+        storage = new std::map<std::string, std::string>();
+    }
+    space = name;
+    return true;
+}
+
+void Preferences::end() {
+    space = NULL;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t length) {
+    if (space == NULL) {
+        return 0;
+    }
+    std::map<std::string, std::string>::const_iterator found = storage->find(std::string(space) + "/" + key);
+    if (found == storage->end() || found->second.size() > length) {
+        return 0;
+    }
+    memcpy(buffer, found->second.data(), found->second.size());
+    return found->second.size();
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (space == NULL) {
+        return 0;
+    }
+    (*storage)[std::string(space) + "/" + key] = std::string((const char*)value, length);
+    return length;
+}
+
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    size_t needed = (slen + 2) / 3 * 4;
+    if (dlen < needed + 1) {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char* out = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t group = src[i] << 16;
+        if (i + 1 < slen) group |= src[i + 1] << 8;
+        if (i + 2 < slen) group |= src[i + 2];
+        *out++ = BASE64_DIGITS[(group >> 18) & 0x3F];
+        *out++ = BASE64_DIGITS[(group >> 12) & 0x3F];
+        *out++ = i + 1 < slen ? BASE64_DIGITS[(group >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < slen ? BASE64_DIGITS[group & 0x3F] : '=';
+    }
+    *out = '\0';
+    *olen = needed;
+    return 0;
+}
+
+int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    uint32_t group = 0;
+    int bits = 0;
+    size_t written = 0;
+    for (size_t i = 0; i < slen; i++) {
+        if (src[i] == '=' || src[i] == '\r' || src[i] == '\n') {
+            continue;
+        }
+        const char* digit = strchr(BASE64_DIGITS, src[i]);
+        if (digit == NULL || src[i] == '\0') {
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+        group = (group << 6) | (digit - BASE64_DIGITS);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (dst != NULL && written < dlen) {
+                dst[written] = (group >> bits) & 0xFF;
+            }
+            written++;
+        }
+    }
+    *olen = written;
+    return dst == NULL || written > dlen ? MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL : 0;
+}
+
+static uint32_t rotateLeft(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+int mbedtls_sha1_ret(const unsigned char* input, size_t length, unsigned char output[20]) {
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // The message, a 1 bit, zeros, then the bit length, in 64 byte blocks
+    size_t total = (length + 9 + 63) / 64 * 64;
+    for (size_t block = 0; block < total; block += 64) {
+        uint32_t words[80];
+        for (int i = 0; i < 16; i++) {
+            uint32_t word = 0;
+            for (int b = 0; b < 4; b++) {
+                size_t at = block + i * 4 + b;
+                uint8_t byte = 0;
+                if (at < length) {
+                    byte = input[at];
+                } else if (at == length) {
+                    byte = 0x80;
+                } else if (at >= total - 8) {
+                    byte = (uint8_t)(((uint64_t)length * 8) >> ((total - 1 - at) * 8));
+                }
+                word = (word << 8) | byte;
+            }
+            words[i] = word;
+        }
+        for (int i = 16; i < 80; i++) {
+            words[i] = rotateLeft(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t next = rotateLeft(a, 5) + f + e + k + words[i];
+            e = d;
+            d = c;
+            c = rotateLeft(b, 30);
+            b = a;
+            a = next;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    for (int i = 0; i < 20; i++) {
+        output[i] = state[i / 4] >> (24 - (i % 4) * 8);
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <Arduino.h>
+#include <lx16a-servo.h>
+#include "HostRuntime.h"
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+
+static thread_local unsigned long nowMs = 0;
+static thread_local ServoCommandHook servoCommandHook = NULL;
+static thread_local PinReadHook pinReadHook = NULL;
+static thread_local PinReadHook analogReadHook = NULL;
+static thread_local bool wallClock = false;
+static thread_local std::chrono::steady_clock::time_point wallOrigin;
+static thread_local FILE* console = stderr;
+static thread_local HostBusStats busStats = {0, 0};
+
+// LX-16A frame: two header bytes, id, length, command, parameters, checksum
+const int BUS_FRAME_BYTES = 6;
+
+
+void hostSetTime(unsigned long ms) {
+    nowMs = ms;
+}
+
+void hostAdvance(unsigned long ms) {
+    nowMs += ms;
+}
+
+void hostUseWallClock() {
+    wallOrigin = std::chrono::steady_clock::now();
+    wallClock = true;
+}
+
+void hostOnServoCommand(ServoCommandHook hook) {
+    servoCommandHook = hook;
+}
+
+HostBusStats hostBusStats() {
+    return busStats;
+}
+
+void hostOnDigitalRead(PinReadHook hook) {
+    pinReadHook = hook;
+}
+
+void hostOnAnalogRead(PinReadHook hook) {
+    analogReadHook = hook;
+}
+
+void hostSetConsole(FILE* stream) {
+    console = stream;
+}
+
+static unsigned long long wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wallOrigin)
+        .count();
+}
+
+unsigned long millis() {
+    return wallClock ? nowMs + wallMicros() / 1000 : nowMs;
+}
+
+unsigned long micros() {
+    return wallClock ? nowMs * 1000 + wallMicros() : nowMs * 1000;
+}
+
+// Waiting in the firmware moves the virtual clock along
+void delay(unsigned long ms) {
+    if (wallClock) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        return;
+    }
+    nowMs += ms;
+}
+
+void delayMicroseconds(unsigned int us) {}
+
+void pinMode(int pin, int mode) {}
+
+int digitalRead(int pin) {
+    return pinReadHook != NULL ? pinReadHook(pin) : LOW;
+}
+
+int analogRead(int pin) {
+    return analogReadHook != NULL ? analogReadHook(pin) : 0;
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh) {
+    return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+String::String(double value, int decimals) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    text = buffer;
+}
+
+String String::substring(unsigned int from) const {
+    return from < text.size() ? String(text.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (to > text.size()) {
+        to = text.size();
+    }
+    return from < to ? String(text.substr(from, to - from)) : String();
+}
+
+void String::trim() {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        text.clear();
+        return;
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    text = text.substr(first, last - first + 1);
+}
+
+size_t Print::write(const uint8_t* data, size_t length) {
+    if (console == NULL) {
+        return length;
+    }
+    return fwrite(data, 1, length, console);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    return write((const uint8_t*)buffer, min((size_t)length, sizeof(buffer) - 1));
+}
+
+LX16AServo::LX16AServo(LX16ABus* bus, int id)
+    : _id(id), from(12000), target(12000), commandMs(0), durationMs(0) {}
+
+void LX16AServo::move_time(int32_t position, uint16_t time) {
+    from = pos_read();
+    target = position;
+    commandMs = millis();
+    durationMs = time;
+    busStats.transactions++;
+    busStats.bytes += BUS_FRAME_BYTES + 4;
+    if (servoCommandHook != NULL) {
+        servoCommandHook(_id, position, time);
+    }
+}
+
+int32_t LX16AServo::pos_read() {
+    busStats.transactions++;
+    busStats.bytes += BUS_FRAME_BYTES + BUS_FRAME_BYTES + 2;
+    unsigned long elapsed = millis() - commandMs;
+    if (durationMs == 0 || elapsed >= durationMs) {
+        return target;
+    }
+    return from + (target - from) * (int32_t)elapsed / durationMs;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* handle, int core) {
+    return pdFAIL;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+void vTaskDelete(TaskHandle_t task) {}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return NULL;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+    return 1;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+struct HostQueue {
+    size_t length;
+    size_t itemSize;
+    std::deque<std::vector<uint8_t> > items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    HostQueue* queue = new HostQueue;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticksToWait) {
+    HostQueue* queue = (HostQueue*)handle;
+    if (queue->items.size() >= queue->length) {
+        return pdFALSE;
+    }
+    const uint8_t* bytes = (const uint8_t*)item;
+    queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t ticksToWait) {
+    HostQueue* queue = (HostQueue*)handle;
+    if (queue->items.empty()) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    return ((HostQueue*)handle)->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t handle) {
+    ((HostQueue*)handle)->items.clear();
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t handle) {
+    delete (HostQueue*)handle;
+}
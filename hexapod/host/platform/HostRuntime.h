@@ -0,0 +1,41 @@
+#ifndef HOST_RUNTIME_H
+#define HOST_RUNTIME_H
+
+#include <Arduino.h>
+
+// Controls for the host build of the firmware. Time is virtual: millis()
+// only moves when a tool advances it, so runs are repeatable and as fast
+// as the workstation allows. All of this state is per thread, letting a
+// tool run independent firmware instances side by side.
+
+void hostSetTime(unsigned long ms);
+void hostAdvance(unsigned long ms);
+
+// From here on the clock runs in real time from where it stood and
+// delays sleep, for a tool that serves real clients. hostSetTime and
+// hostAdvance then shift it.
+void hostUseWallClock();
+
+// Called for every servo move, id is the bus id (1 to 18)
+typedef void (*ServoCommandHook)(int id, int32_t position, int time);
+void hostOnServoCommand(ServoCommandHook hook);
+
+// Servo bus traffic so far, counted as LX-16A frames on the wire: a move
+// is one 10 byte frame, a position read a 6 byte request and 8 byte reply
+struct HostBusStats {
+    unsigned long transactions;
+    unsigned long bytes;
+};
+HostBusStats hostBusStats();
+
+// Answers digitalRead(), for the foot contact switches
+typedef int (*PinReadHook)(int pin);
+void hostOnDigitalRead(PinReadHook hook);
+
+// Answers analogRead(), for the battery voltage; 0 until set
+void hostOnAnalogRead(PinReadHook hook);
+
+// Where Serial output goes, stderr until set, NULL to drop it
+void hostSetConsole(FILE* stream);
+
+#endif
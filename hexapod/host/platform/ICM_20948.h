@@ -0,0 +1,34 @@
+#ifndef HOST_ICM_20948_H
+#define HOST_ICM_20948_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+enum ICM_20948_Status_e {
+    ICM_20948_Stat_Ok,
+    ICM_20948_Stat_Err,
+    ICM_20948_Stat_NoData
+};
+
+// An IMU that never answers: begin() fails and no sample is ever ready.
+// Tools that need orientation feed it through the input log instead.
+class ICM_20948_I2C {
+public:
+    ICM_20948_Status_e status = ICM_20948_Stat_Err;
+
+    ICM_20948_Status_e begin(TwoWire& wire, bool ad0Value) {
+        status = ICM_20948_Stat_Err;
+        return status;
+    }
+    bool dataReady() { return false; }
+    void getAGMT() {}
+
+    float accX() { return 0; }
+    float accY() { return 0; }
+    float accZ() { return 1000; }
+    float gyrX() { return 0; }
+    float gyrY() { return 0; }
+    float gyrZ() { return 0; }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef HOST_PID_V1_H
+#define HOST_PID_V1_H
+
+#include <Arduino.h>
+
+#define AUTOMATIC 1
+#define MANUAL 0
+#define DIRECT 0
+#define REVERSE 1
+
+// The Arduino PID library's controller, same arithmetic: proportional on
+// error, integral clamped to the output limits, derivative on measurement,
+// computed at most once per sample time of millis()
+class PID {
+public:
+    PID(double* input, double* output, double* setpoint, double kp, double ki, double kd, int direction);
+
+    bool Compute();
+    void SetMode(int mode);
+    void SetOutputLimits(double minimum, double maximum);
+    void SetTunings(double kp, double ki, double kd);
+    void SetSampleTime(int sampleTimeMs);
+    void SetControllerDirection(int direction);
+
+private:
+    double* input;
+    double* output;
+    double* setpoint;
+    double kp;
+    double ki;
+    double kd;
+    int direction;
+    bool automatic;
+    unsigned long sampleTimeMs;
+    unsigned long lastTime;
+    double outputSum;
+    double lastInput;
+    double outMin;
+    double outMax;
+
+    void initialize();
+};
+
+#endif
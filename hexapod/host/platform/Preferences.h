@@ -0,0 +1,22 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+
+// Flash key-value storage, kept in memory per thread on the host, so every
+// run starts from the compiled-in defaults
+class Preferences {
+public:
+    Preferences() : space(NULL) {}
+
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    size_t getBytes(const char* key, void* buffer, size_t length);
+    size_t putBytes(const char* key, const void* value, size_t length);
+
+private:
+    const char* space;
+};
+
+#endif
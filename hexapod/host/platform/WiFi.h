@@ -0,0 +1,34 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress {
+public:
+    String toString() const { return "127.0.0.1"; }
+};
+
+// The workstation's own network stands in for the WiFi station, so it is
+// reported connected once begin() has been called
+class WiFiClass {
+public:
+    WiFiClass() : started(false) {}
+
+    bool mode(int mode) { return true; }
+    void setAutoReconnect(bool enabled) {}
+    void begin(const char* ssid, const char* password) { started = true; }
+    bool reconnect() { return started; }
+    int status() { return started ? WL_CONNECTED : WL_DISCONNECTED; }
+    IPAddress localIP() { return IPAddress(); }
+
+private:
+    bool started;
+};
+
+extern WiFiClass WiFi;
+
+#endif
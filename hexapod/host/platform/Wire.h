@@ -0,0 +1,15 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <Arduino.h>
+
+// No I2C bus on the host; devices behind it report themselves missing
+class TwoWire {
+public:
+    void begin() {}
+    void setClock(uint32_t frequency) {}
+};
+
+extern TwoWire Wire;
+
+#endif
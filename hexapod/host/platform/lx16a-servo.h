@@ -0,0 +1,38 @@
+#ifndef HOST_LX16A_SERVO_H
+#define HOST_LX16A_SERVO_H
+
+#include <Arduino.h>
+
+class LX16ABus {
+public:
+    void beginOnePinMode(HardwareSerial* port, int pin) {}
+    void debug(bool enabled) {}
+};
+
+// An ideal servo: it reaches each target linearly over the commanded
+// time. Every command is also handed to the hook set with
+// hostOnServoCommand, which is how the host tools record the stream.
+class LX16AServo {
+public:
+    LX16AServo(LX16ABus* bus, int id);
+
+    void move_time(int32_t position, uint16_t time);
+    int32_t pos_read();
+
+    void stop() {}
+    void disable() {}
+    void enable() {}
+    bool isCommandOk() { return true; }
+    int32_t vin() { return 7400; }
+    int32_t temp() { return 40; }
+
+    uint8_t _id;
+
+private:
+    int32_t from;
+    int32_t target;
+    unsigned long commandMs;
+    uint16_t durationMs;
+};
+
+#endif
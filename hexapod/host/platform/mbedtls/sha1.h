@@ -0,0 +1,8 @@
+#ifndef HOST_MBEDTLS_SHA1_H
+#define HOST_MBEDTLS_SHA1_H
+
+#include <stddef.h>
+
+int mbedtls_sha1_ret(const unsigned char* input, size_t length, unsigned char output[20]);
+
+#endif
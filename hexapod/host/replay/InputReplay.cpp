@@ -0,0 +1,410 @@
+#include "InputReplay.h"
+#include "HostRuntime.h"
+
+#include <mbedtls/base64.h>
+
+// The firmware entry points, from main.cpp
+void setup();
+void controlTick(unsigned long now);
+void onClientCommand(int clientId, const char* command);
+bool restoreKeyframe(const uint8_t* data, size_t length);
+
+const char* EVENT_NAMES[INPUT_EVENT_TYPES] = {
+    "TICK", "CLOCK", "SWITCH", "SERVO_READ", "IMU", "IMU_STATUS", "PARAMS", "BATTERY", "COMMAND", "MOVE",
+    "KEYFRAME"
+};
+
+
+static uint16_t get16(const uint8_t* in) {
+    return in[0] | (in[1] << 8);
+}
+
+static int channelKey(InputEventType type, int channel) {
+    return type * 256 + channel;
+}
+
+InputReplay::InputReplay() : booting(false), nextMove(0), position(0), periodEnd(0), battery(-1) {
+    memset(&header, 0, sizeof(header));
+    memset(&result, 0, sizeof(result));
+}
+
+bool InputReplay::load(const char* path) {
+    FILE* input = fopen(path, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    std::vector<uint8_t> contents;
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        contents.insert(contents.end(), buffer, buffer + length);
+    }
+    fclose(input);
+
+    if (contents.size() >= 4 && memcmp(contents.data(), "HXIN", 4) == 0) {
+        return parse(contents);
+    }
+
+    // A console or socket capture: the INPUT_LOG replies are put back
+    // together by offset, anything else in between is skipped
+    std::vector<uint8_t> dump;
+    contents.push_back('\0');
+    for (char* line = strtok((char*)contents.data(), "\r\n"); line != NULL; line = strtok(NULL, "\r\n")) {
+        char* reply = strstr(line, "INPUT_LOG:");
+        long offset = 0;
+        unsigned long size = 0;
+        int encoded = 0;
+        if (reply == NULL || sscanf(reply, "INPUT_LOG:%ld,%lu,%n", &offset, &size, &encoded) != 2 || offset < 0) {
+            continue;
+        }
+        if (dump.size() < size) {
+            dump.resize(size);
+        }
+        size_t decoded = 0;
+        const unsigned char* text = (const unsigned char*)reply + encoded;
+        if (mbedtls_base64_decode(NULL, 0, &decoded, text, strlen((const char*)text)) ==
+                MBEDTLS_ERR_BASE64_INVALID_CHARACTER ||
+            offset + decoded > dump.size() ||
+            mbedtls_base64_decode(dump.data() + offset, decoded, &decoded, text, strlen((const char*)text)) != 0) {
+            fprintf(stderr, "ERROR: bad INPUT_LOG line at offset %ld\n", offset);
+            return false;
+        }
+    }
+    if (dump.empty()) {
+        fprintf(stderr, "ERROR: %s holds no input log\n", path);
+        return false;
+    }
+    return parse(dump);
+}
+
+bool InputReplay::parse(const std::vector<uint8_t>& dump) {
+    if (dump.size() < sizeof(header) || memcmp(dump.data(), "HXIN", 4) != 0) {
+        fprintf(stderr, "ERROR: not an input log\n");
+        return false;
+    }
+    memcpy(&header, dump.data(), sizeof(header));
+    if (header.version != INPUT_LOG_VERSION) {
+        fprintf(stderr, "ERROR: input log version %d, this build reads %d\n", header.version, INPUT_LOG_VERSION);
+        return false;
+    }
+    if (dump.size() < sizeof(header) + header.length) {
+        fprintf(stderr, "ERROR: input log cut short, %lu of %lu bytes\n",
+                (unsigned long)(dump.size() - sizeof(header)), (unsigned long)header.length);
+        return false;
+    }
+
+    events.clear();
+    channels.clear();
+    moves.clear();
+    keyframes.clear();
+    unsigned long periodMs = header.startMs;
+    const uint8_t* data = dump.data() + sizeof(header);
+    for (size_t at = 0; at < header.length;) {
+        size_t length = inputEventLength(data + at, header.length - at);
+        if (length == 0) {
+            fprintf(stderr, "ERROR: bad event at offset %lu\n", (unsigned long)(sizeof(header) + at));
+            return false;
+        }
+
+        const uint8_t* event = data + at;
+        RecordedInput input;
+        input.type = (InputEventType)event[0];
+        input.channel = 0;
+        input.unchanged = 0;
+        input.offset = sizeof(header) + at;
+        size_t payloadStart = 1;
+        switch (input.type) {
+            case INPUT_TICK:
+                // A run becomes one tick per period, the first one counts them
+                input.unchanged = get16(event + 3);
+                for (int tick = 1, run = input.unchanged; tick < run; tick++) {
+                    periodMs += get16(event + 1);
+                    input.periodMs = periodMs;
+                    events.push_back(input);
+                    input.unchanged = 0;
+                }
+                periodMs += get16(event + 1);
+                payloadStart = length;
+                break;
+            case INPUT_CLOCK:
+            case INPUT_IMU:
+                input.unchanged = get16(event + 1);
+                payloadStart = 3;
+                break;
+            case INPUT_SWITCH:
+            case INPUT_SERVO_READ:
+                input.channel = event[1];
+                input.unchanged = get16(event + 2);
+                payloadStart = 4;
+                break;
+            case INPUT_PARAMS:
+                payloadStart = 2;
+                break;
+            case INPUT_COMMAND:
+                input.channel = event[1];
+                payloadStart = 3;
+                break;
+            case INPUT_SERVO_MOVE:
+                input.channel = event[1];
+                payloadStart = 2;
+                break;
+            case INPUT_KEYFRAME:
+                payloadStart = 3;
+                break;
+            default:
+                break;
+        }
+        input.periodMs = periodMs;
+        input.payload.assign(event + payloadStart, event + length);
+
+        if (input.type == INPUT_SERVO_MOVE) {
+            moves.push_back(events.size());
+        } else if (input.type == INPUT_KEYFRAME) {
+            keyframes.push_back(events.size());
+        } else if (inputChannelIndex(input.type, input.channel) >= 0 || input.type == INPUT_IMU_STATUS ||
+                   input.type == INPUT_PARAMS) {
+            Channel& channel = channels[channelKey(input.type, input.channel)];
+            channel.events.push_back(events.size());
+        }
+        events.push_back(input);
+        at += length;
+    }
+
+    // Ticks dropped off a wrapped log took the time with them; keyframes
+    // tell it again
+    InputKeyframe keyframe;
+    if (header.wrapped && !keyframes.empty() &&
+        parseInputKeyframe(events[keyframes[0]].payload.data(), events[keyframes[0]].payload.size(), keyframe)) {
+        unsigned long shift = keyframe.nowMs - events[keyframes[0]].periodMs;
+        for (size_t i = 0; i < events.size(); i++) {
+            events[i].periodMs += shift;
+        }
+    }
+    return true;
+}
+
+void InputReplay::list(FILE* out) const {
+    fprintf(out, "# input log v%d, %lu bytes from %lu ms%s\n", header.version, (unsigned long)header.length,
+            (unsigned long)header.startMs, header.wrapped ? ", wrapped: the start is lost" : "");
+    for (size_t i = 0; i < events.size(); i++) {
+        const RecordedInput& input = events[i];
+        const uint8_t* payload = input.payload.data();
+        if (input.type == INPUT_TICK && input.unchanged == 0) {
+            continue;
+        }
+        fprintf(out, "%8lu %-10s", input.periodMs, EVENT_NAMES[input.type]);
+        switch (input.type) {
+            case INPUT_TICK:
+                if (input.unchanged > 1) {
+                    fprintf(out, " x %u", input.unchanged);
+                }
+                break;
+            case INPUT_CLOCK:
+                fprintf(out, " +%u ms", get16(payload));
+                break;
+            case INPUT_SWITCH:
+                fprintf(out, " %d = %d", input.channel, payload[0]);
+                break;
+            case INPUT_SERVO_READ:
+                fprintf(out, " %d = %d", input.channel, (int16_t)get16(payload));
+                break;
+            case INPUT_IMU: {
+                float sample[4];
+                memcpy(sample, payload, sizeof(sample));
+                fprintf(out, " yaw %.2f pitch %.2f roll %.2f rate %.2f", sample[0], sample[1], sample[2], sample[3]);
+                break;
+            }
+            case INPUT_IMU_STATUS:
+                fprintf(out, " %s", payload[0] ? "connected" : "missing");
+                break;
+            case INPUT_PARAMS:
+                fprintf(out, " %lu bytes", (unsigned long)input.payload.size());
+                break;
+            case INPUT_BATTERY:
+                fprintf(out, " %d%%", payload[0]);
+                break;
+            case INPUT_COMMAND:
+                fprintf(out, " [%d] %.*s", input.channel, (int)input.payload.size(), (const char*)payload);
+                break;
+            case INPUT_SERVO_MOVE:
+                fprintf(out, " %d -> %d in %d ms", input.channel, get16(payload), get16(payload + 2));
+                break;
+            case INPUT_KEYFRAME:
+                fprintf(out, " %lu bytes", (unsigned long)input.payload.size());
+                break;
+            default:
+                break;
+        }
+        if (input.unchanged > 0 && input.type != INPUT_TICK) {
+            fprintf(out, " (after %u)", input.unchanged);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+ReplayResult InputReplay::run() {
+    memset(&result, 0, sizeof(result));
+    for (std::map<int, Channel>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        it->second.next = 0;
+        it->second.reads = 0;
+    }
+    nextMove = 0;
+    battery = -1;
+    position = 0;
+    periodEnd = 0;
+    while (periodEnd < events.size() && events[periodEnd].type != INPUT_TICK) {
+        periodEnd++;
+    }
+
+    // Boot as the robot did, or pick up at the oldest keyframe, then step
+    // through the recording
+    size_t first = 0;
+    size_t keyframe = 0;
+    setInputPlayback(this);
+    if (header.wrapped) {
+        keyframe = keyframes[0];
+        if (!startFromKeyframe(keyframe, first)) {
+            setInputPlayback(NULL);
+            return result;
+        }
+    } else {
+        result.startMs = header.startMs;
+        hostSetTime(header.startMs);
+        setup();
+    }
+
+    for (size_t i = first; i < events.size() && !result.diverged; i++) {
+        const RecordedInput& input = events[i];
+        if (i < keyframe && input.type != INPUT_TICK) {
+            // Already in the keyframe's state
+            continue;
+        }
+        if (input.type == INPUT_COMMAND) {
+            std::string command((const char*)input.payload.data(), input.payload.size());
+            onClientCommand(input.channel, command.c_str());
+            result.commands++;
+        } else if (input.type == INPUT_BATTERY) {
+            battery = input.payload[0];
+        } else if (input.type == INPUT_TICK) {
+            if (nextMove < moves.size() && moves[nextMove] < i) {
+                const RecordedInput& missed = events[moves[nextMove]];
+                diverge("at %lu ms the robot moved servo %d to %d in %d ms, the replay did not",
+                        missed.periodMs, missed.channel, get16(missed.payload.data()),
+                        get16(missed.payload.data() + 2));
+                break;
+            }
+            position = i;
+            for (periodEnd = i + 1; periodEnd < events.size() && events[periodEnd].type != INPUT_TICK;) {
+                periodEnd++;
+            }
+            hostSetTime(input.periodMs);
+            controlTick(input.periodMs);
+            result.ticks++;
+        }
+    }
+
+    setInputPlayback(NULL);
+    return result;
+}
+
+bool InputReplay::startFromKeyframe(size_t index, size_t& first) {
+    InputKeyframe keyframe;
+    if (!parseInputKeyframe(events[index].payload.data(), events[index].payload.size(), keyframe)) {
+        diverge("the keyframe at offset %lu is malformed", (unsigned long)events[index].offset);
+        return false;
+    }
+
+    // A boot with none of the recorded inputs brings everything up, the
+    // keyframe then puts the robot's state in
+    booting = true;
+    hostSetTime(keyframe.nowMs);
+    setup();
+    booting = false;
+    if (!restoreKeyframe(keyframe.state, keyframe.stateLength)) {
+        diverge("the keyframe at %lu ms is from another build", keyframe.nowMs);
+        return false;
+    }
+    restoreInputChannels(keyframe);
+
+    for (std::map<int, Channel>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        Channel& channel = it->second;
+        while (channel.next < channel.events.size() && channel.events[channel.next] < index) {
+            channel.next++;
+        }
+        int tap = inputChannelIndex((InputEventType)(it->first / 256), it->first % 256);
+        channel.reads = tap >= 0 ? keyframe.unchanged[tap] : 0;
+    }
+    while (nextMove < moves.size() && moves[nextMove] < index) {
+        nextMove++;
+    }
+    battery = keyframe.battery;
+
+    // The keyframe was logged as its control period started
+    for (first = index; first > 0 && events[first].type != INPUT_TICK;) {
+        first--;
+    }
+    result.fromKeyframe = true;
+    result.startMs = keyframe.nowMs;
+    return true;
+}
+
+int InputReplay::replay(InputEventType type, int channel, uint8_t* payload, int size) {
+    std::map<int, Channel>::iterator found = channels.find(channelKey(type, channel));
+    if (booting || found == channels.end() || found->second.next >= found->second.events.size()) {
+        return -1;
+    }
+    Channel& recorded = found->second;
+    const RecordedInput& input = events[recorded.events[recorded.next]];
+    if (recorded.reads < input.unchanged) {
+        recorded.reads++;
+        return -1;
+    }
+    recorded.next++;
+    recorded.reads = 0;
+    memcpy(payload, input.payload.data(), min((size_t)size, input.payload.size()));
+    return input.payload.size();
+}
+
+void InputReplay::replayMove(int id, int32_t target, int time) {
+    if (result.diverged || booting) {
+        return;
+    }
+    if (nextMove >= moves.size()) {
+        result.movesAfterEnd++;
+        return;
+    }
+
+    const RecordedInput& recorded = events[moves[nextMove]];
+    int recordedTarget = get16(recorded.payload.data());
+    int recordedTime = get16(recorded.payload.data() + 2);
+    if (moves[nextMove] > periodEnd) {
+        diverge("at %lu ms the replay moved servo %d to %ld in %d ms, the robot only at %lu ms",
+                events[position].periodMs, id, (long)target, time, recorded.periodMs);
+    } else if (recorded.channel != id || recordedTarget != target || recordedTime != time) {
+        diverge("at %lu ms the replay moved servo %d to %ld in %d ms, the robot servo %d to %d in %d ms",
+                recorded.periodMs, id, (long)target, time, recorded.channel, recordedTarget, recordedTime);
+    } else {
+        result.movesMatched++;
+    }
+    nextMove++;
+}
+
+int InputReplay::batteryPercentage() {
+    // Logged at the read itself, which in the recording comes a little
+    // after the period started
+    for (size_t i = position + 1; i < periodEnd; i++) {
+        if (events[i].type == INPUT_BATTERY) {
+            return events[i].payload[0];
+        }
+    }
+    return battery;
+}
+
+void InputReplay::diverge(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(result.divergence, sizeof(result.divergence), format, args);
+    va_end(args);
+    result.diverged = true;
+}
@@ -0,0 +1,86 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include <Arduino.h>
+#include "InputLog.h"
+
+#include <map>
+#include <vector>
+
+struct RecordedInput {
+    InputEventType type;
+    int channel;                // switch index, servo id or client id
+    uint16_t unchanged;         // reads of the channel since its last event, ticks in a run
+    unsigned long periodMs;     // start of the control period it fell in
+    size_t offset;              // in the dump, for the listing
+    std::vector<uint8_t> payload;
+};
+
+struct ReplayResult {
+    unsigned long ticks;
+    unsigned long commands;
+    unsigned long movesMatched;
+    unsigned long movesAfterEnd;    // made past the end of the recording
+    bool fromKeyframe;
+    unsigned long startMs;          // of the boot or keyframe it started from
+    bool diverged;
+    char divergence[160];
+};
+
+// Runs the firmware's own setup() and control tick on the host against a
+// recorded input log. Every tap of the control code gets the value the
+// robot read, commands go in between the periods they arrived in, and
+// each servo move is checked against the one the robot made.
+//
+// Commands race the control task on the robot; here one that landed
+// inside a period takes effect at the next. The heading hold PID reads
+// the clock on its own, so a late period can move its sample by one tick.
+// Both show up as a divergence rather than passing silently.
+//
+// A wrapped log starts from its oldest keyframe instead: the firmware
+// boots with no inputs, takes the keyframe's state and goes on from the
+// control period it was logged in.
+class InputReplay : public InputPlayback {
+public:
+    InputReplay();
+
+    // Reads a binary dump or a capture of INPUT_LOG reply lines
+    bool load(const char* path);
+
+    // From boot, or from a keyframe once the boot was dropped
+    bool canReplay() const { return header.wrapped == 0 || !keyframes.empty(); }
+    const InputLogHeader& getHeader() const { return header; }
+    const std::vector<RecordedInput>& getEvents() const { return events; }
+
+    void list(FILE* out) const;
+    ReplayResult run();
+
+    int replay(InputEventType type, int channel, uint8_t* payload, int size);
+    void replayMove(int id, int32_t position, int time);
+    int batteryPercentage();
+
+private:
+    struct Channel {
+        std::vector<size_t> events;
+        size_t next;
+        uint32_t reads;
+    };
+
+    InputLogHeader header;
+    std::vector<RecordedInput> events;
+    std::map<int, Channel> channels;
+    std::vector<size_t> moves;
+    std::vector<size_t> keyframes;
+    bool booting;               // setup() before a keyframe, nothing is replayed
+    size_t nextMove;
+    size_t position;            // tick being run
+    size_t periodEnd;           // the tick after it
+    int battery;
+    ReplayResult result;
+
+    bool parse(const std::vector<uint8_t>& dump);
+    bool startFromKeyframe(size_t index, size_t& first);
+    void diverge(const char* format, ...);
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include <Arduino.h>
+#include "HostRuntime.h"
+#include "InputReplay.h"
+
+#include <lwip/sockets.h>
+#include <mbedtls/base64.h>
+#include <netdb.h>
+
+// Field recordings on the host:
+//
+//   hexapod_replay -p <robot>[:port] log.bin   pull the input log off the robot
+//   hexapod_replay -l log.bin                   list the recorded events
+//   hexapod_replay [-v] log.bin                 replay and diff the servo moves
+//
+// A log can also be a capture of the INPUT_LOG replies, e.g. from the
+// serial console. A log that wrapped replays from its oldest keyframe;
+// one that wrapped before any keyframe was logged can only be listed.
+// Exits 1 when the replay diverges from the recording.
+
+const int DEFAULT_PORT = 8080;
+const int PULL_TIMEOUT_MS = 3000;
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_replay -p robot[:port] log\n"
+                    "       hexapod_replay -l log\n"
+                    "       hexapod_replay [-v] log\n");
+}
+
+// Reads one reply line, false on timeout or a closed connection
+static bool readLine(int fd, std::string& line) {
+    line.clear();
+    for (;;) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(fd, &readSet);
+        struct timeval timeout = {PULL_TIMEOUT_MS / 1000, (PULL_TIMEOUT_MS % 1000) * 1000};
+        char c;
+        if (select(fd + 1, &readSet, NULL, NULL, &timeout) <= 0 || recv(fd, &c, 1, 0) != 1) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        if (c != '\r') {
+            line += c;
+        }
+    }
+}
+
+static int pull(const char* robot, const char* path) {
+    std::string host(robot);
+    std::string port = std::to_string(DEFAULT_PORT);
+    size_t colon = host.find(':');
+    if (colon != std::string::npos) {
+        port = host.substr(colon + 1);
+        host = host.substr(0, colon);
+    }
+
+    struct addrinfo hints = {};
+    struct addrinfo* address = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) {
+        fprintf(stderr, "ERROR: unknown host %s\n", host.c_str());
+        return 1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+        fprintf(stderr, "ERROR: could not connect to %s:%s\n", host.c_str(), port.c_str());
+        freeaddrinfo(address);
+        return 1;
+    }
+    freeaddrinfo(address);
+
+    FILE* output = fopen(path, "w");
+    if (output == NULL) {
+        fprintf(stderr, "ERROR: could not write %s\n", path);
+        close(fd);
+        return 1;
+    }
+
+    // The pieces are kept as the robot sent them; load() puts them together
+    unsigned long offset = 0;
+    unsigned long size = 1;
+    while (offset < size) {
+        char request[48];
+        int length = snprintf(request, sizeof(request), "GET_INPUT_LOG:%lu\n", offset);
+        std::string line;
+        if (send(fd, request, length, 0) != length) {
+            break;
+        }
+        do {
+            if (!readLine(fd, line)) {
+                fprintf(stderr, "ERROR: no reply at offset %lu\n", offset);
+                fclose(output);
+                close(fd);
+                return 1;
+            }
+        } while (line.compare(0, 10, "INPUT_LOG:") != 0);
+
+        unsigned long replyOffset = 0;
+        int encoded = 0;
+        if (sscanf(line.c_str(), "INPUT_LOG:%lu,%lu,%n", &replyOffset, &size, &encoded) != 2 ||
+            replyOffset != offset || line.size() == (size_t)encoded) {
+            break;
+        }
+        size_t decoded = 0;
+        mbedtls_base64_decode(NULL, 0, &decoded, (const unsigned char*)line.c_str() + encoded, line.size() - encoded);
+        fprintf(output, "%s\n", line.c_str());
+        offset += decoded;
+        fprintf(stderr, "\r%lu / %lu bytes", offset, size);
+    }
+    fprintf(stderr, "\n");
+    fclose(output);
+    close(fd);
+    return offset >= size ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "-p") == 0) {
+        return pull(argv[2], argv[3]);
+    }
+
+    bool listing = argc == 3 && strcmp(argv[1], "-l") == 0;
+    bool verbose = argc == 3 && strcmp(argv[1], "-v") == 0;
+    if (argc != 2 && !listing && !verbose) {
+        usage();
+        return 2;
+    }
+
+    InputReplay replay;
+    if (!replay.load(argv[argc - 1])) {
+        return 1;
+    }
+    if (listing) {
+        replay.list(stdout);
+        return 0;
+    }
+    if (!replay.canReplay()) {
+        fprintf(stderr, "ERROR: the log wrapped before a keyframe was logged, it can only be listed (-l)\n");
+        return 1;
+    }
+
+    hostSetConsole(verbose ? stderr : NULL);
+    ReplayResult result = replay.run();
+    if (result.fromKeyframe) {
+        printf("from the keyframe at %lu ms: ", result.startMs);
+    }
+    printf("replayed %lu ticks and %lu commands, %lu servo moves matched", result.ticks, result.commands,
+           result.movesMatched);
+    if (result.movesAfterEnd > 0) {
+        printf(", %lu made after the recording ended", result.movesAfterEnd);
+    }
+    printf("\n");
+    if (result.diverged) {
+        printf("DIVERGED %s\n", result.divergence);
+        return 1;
+    }
+    return 0;
+}
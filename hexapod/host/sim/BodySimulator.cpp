@@ -0,0 +1,218 @@
+#include "BodySimulator.h"
+#include "Constants.h"
+
+
+BodySimulator::BodySimulator() {
+    reset();
+}
+
+void BodySimulator::reset() {
+    for (int base = 0; base < 18; base += 3) {
+        int32_t stance[3] = {COXA_DEFAULT, FEMUR_DOWN, TIBIA_DOWN};
+        for (int joint = 0; joint < 3; joint++) {
+            joints[base + joint].position = stance[joint];
+            joints[base + joint].target = stance[joint];
+            joints[base + joint].rate = 0;
+        }
+    }
+    timeMs = 0;
+    x = 0;
+    y = 0;
+    heading = 0;
+    placeFeet();
+    beginCycle();
+}
+
+void BodySimulator::command(int id, int32_t position, int time) {
+    Joint& joint = joints[id - 1];
+    float travel = fabs(position - joint.position);
+    float duration = max((float)time, travel / SERVO_MAX_SPEED);
+    joint.target = position;
+    joint.rate = duration > 0 ? travel / duration : travel;
+}
+
+void BodySimulator::advanceTo(unsigned long ms) {
+    while ((long)(ms - timeMs) > 0) {
+        int elapsed = min((long)SIM_STEP_MS, (long)(ms - timeMs));
+        step(elapsed);
+    }
+}
+
+void BodySimulator::step(int ms) {
+    BodyPoint before[6];
+    bool wasDown[6];
+    for (int leg = 0; leg < 6; leg++) {
+        before[leg] = feet[leg];
+        wasDown[leg] = down[leg];
+    }
+
+    for (int id = 0; id < 18; id++) {
+        Joint& joint = joints[id];
+        float remaining = joint.target - joint.position;
+        float move = min(joint.rate * ms, (float)fabs(remaining));
+        joint.position += remaining > 0 ? move : -move;
+        cycleEffort += move / 100.0f;
+    }
+    timeMs += ms;
+    placeFeet();
+
+    // Feet down before and after are pinned to the ground: find the body
+    // rotation and shift that keeps them closest to where they were
+    float beforeX = 0, beforeY = 0, afterX = 0, afterY = 0;
+    int pinned = 0;
+    for (int leg = 0; leg < 6; leg++) {
+        if (wasDown[leg] && down[leg]) {
+            beforeX += before[leg].x;
+            beforeY += before[leg].y;
+            afterX += feet[leg].x;
+            afterY += feet[leg].y;
+            pinned++;
+        }
+    }
+
+    if (pinned >= 2) {
+        beforeX /= pinned;
+        beforeY /= pinned;
+        afterX /= pinned;
+        afterY /= pinned;
+
+        float cross = 0, dot = 0;
+        for (int leg = 0; leg < 6; leg++) {
+            if (wasDown[leg] && down[leg]) {
+                float ax = feet[leg].x - afterX, ay = feet[leg].y - afterY;
+                float bx = before[leg].x - beforeX, by = before[leg].y - beforeY;
+                cross += ax * by - ay * bx;
+                dot += ax * bx + ay * by;
+            }
+        }
+        float turn = atan2(cross, dot);
+        float c = cos(turn), s = sin(turn);
+        float shiftX = beforeX - (c * afterX - s * afterY);
+        float shiftY = beforeY - (s * afterX + c * afterY);
+
+        float residual = 0;
+        for (int leg = 0; leg < 6; leg++) {
+            if (wasDown[leg] && down[leg]) {
+                float dx = c * feet[leg].x - s * feet[leg].y + shiftX - before[leg].x;
+                float dy = s * feet[leg].x + c * feet[leg].y + shiftY - before[leg].y;
+                residual += sqrt(dx * dx + dy * dy);
+            }
+        }
+        cycleSlip += residual / pinned;
+
+        x += cos(heading) * shiftX - sin(heading) * shiftY;
+        y += sin(heading) * shiftX + cos(heading) * shiftY;
+        heading += turn;
+    }
+
+    int standing = 0;
+    for (int leg = 0; leg < 6; leg++) {
+        if (down[leg]) standing++;
+    }
+    if (standing < 3) {
+        cycleUnsupportedMs += ms;
+    }
+    cycleMargin = min(cycleMargin, supportMargin());
+}
+
+void BodySimulator::placeFeet() {
+    float lowest = 0;
+    for (int leg = 0; leg < 6; leg++) {
+        int base = leg * 3;
+        FootPosition foot = legForward(base, lround(joints[base].position), lround(joints[base + 1].position),
+                                       lround(joints[base + 2].position));
+        feet[leg] = legToBody(base, foot);
+        if (leg == 0 || feet[leg].z < lowest) {
+            lowest = feet[leg].z;
+        }
+    }
+    for (int leg = 0; leg < 6; leg++) {
+        down[leg] = feet[leg].z <= lowest + SIM_CONTACT_BAND;
+    }
+}
+
+// Signed distance from the body center to the edge of the convex hull of
+// the feet that are down, negative when the center is outside it
+float BodySimulator::supportMargin() const {
+    int points[6];
+    int pointCount = 0;
+    for (int leg = 0; leg < 6; leg++) {
+        if (down[leg]) points[pointCount++] = leg;
+    }
+    if (pointCount == 0) {
+        return -1000.0f;
+    }
+
+    // Gift wrapping, counterclockwise from the rearmost foot
+    int hull[6];
+    int count = 0;
+    int start = 0;
+    for (int i = 1; i < pointCount; i++) {
+        if (feet[points[i]].x < feet[points[start]].x) start = i;
+    }
+    int current = start;
+    do {
+        hull[count++] = points[current];
+        int next = (current + 1) % pointCount;
+        for (int i = 0; i < pointCount; i++) {
+            const BodyPoint& a = feet[points[current]];
+            const BodyPoint& b = feet[points[next]];
+            const BodyPoint& p = feet[points[i]];
+            if ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) < 0) {
+                next = i;
+            }
+        }
+        current = next;
+    } while (current != start && count < pointCount);
+
+    // Inside a proper polygon the margin is the distance to the nearest
+    // edge line; otherwise minus the distance to the nearest edge
+    bool inside = count >= 3;
+    float edgeMargin = 1e9f;
+    float outsideMargin = 1e9f;
+    for (int i = 0; i < count; i++) {
+        const BodyPoint& a = feet[hull[i]];
+        const BodyPoint& b = feet[hull[(i + 1) % count]];
+        float ex = b.x - a.x, ey = b.y - a.y;
+        float lengthSq = max(ex * ex + ey * ey, 1e-6f);
+        float side = (ex * -a.y - ey * -a.x) / sqrt(lengthSq);
+        if (side < 0) {
+            inside = false;
+        }
+        edgeMargin = min(edgeMargin, side);
+
+        float along = constrain((-a.x * ex - a.y * ey) / lengthSq, 0.0f, 1.0f);
+        float dx = a.x + ex * along, dy = a.y + ey * along;
+        outsideMargin = min(outsideMargin, (float)sqrt(dx * dx + dy * dy));
+    }
+    return inside ? edgeMargin : -outsideMargin;
+}
+
+void BodySimulator::beginCycle() {
+    cycleStartMs = timeMs;
+    cycleX = x;
+    cycleY = y;
+    cycleHeading = heading;
+    cycleMargin = supportMargin();
+    cycleSlip = 0;
+    cycleEffort = 0;
+    cycleUnsupportedMs = 0;
+}
+
+CycleReport BodySimulator::endCycle() {
+    CycleReport report;
+    float dx = x - cycleX, dy = y - cycleY;
+    report.durationMs = timeMs - cycleStartMs;
+    report.forward = cos(cycleHeading) * dx + sin(cycleHeading) * dy;
+    report.lateral = -sin(cycleHeading) * dx + cos(cycleHeading) * dy;
+    report.turn = degrees(heading - cycleHeading);
+    float seconds = report.durationMs / 1000.0f;
+    report.speed = seconds > 0 ? sqrt(dx * dx + dy * dy) / seconds : 0;
+    report.turnRate = seconds > 0 ? report.turn / seconds : 0;
+    report.minMargin = cycleMargin;
+    report.slip = cycleSlip;
+    report.effort = cycleEffort;
+    report.unsupportedMs = cycleUnsupportedMs;
+    beginCycle();
+    return report;
+}
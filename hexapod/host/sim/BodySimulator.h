@@ -0,0 +1,94 @@
+#ifndef BODY_SIMULATOR_H
+#define BODY_SIMULATOR_H
+
+#include <Arduino.h>
+#include "LegKinematics.h"
+
+// Time step of the body model
+const int SIM_STEP_MS = 2;
+
+// Feet this close to the lowest one count as on the ground
+const float SIM_CONTACT_BAND = 3.0f;
+
+// What one gait cycle did to the body
+struct CycleReport {
+    unsigned long durationMs;
+    float forward;          // mm along the heading at the start of the cycle
+    float lateral;          // mm to the left of it
+    float turn;             // degrees, counterclockwise
+    float speed;            // mm/s over the ground
+    float turnRate;         // degrees/s
+    float minMargin;        // mm from the body center to the support polygon edge
+    float slip;             // mm the stance feet slid against each other
+    float effort;           // degrees turned, summed over all joints
+    unsigned long unsupportedMs;    // time with fewer than three feet down
+};
+
+// Quasi-static model of the body on flat ground, fed with servo commands.
+// Joints slew linearly towards their targets, no faster than the servo
+// can turn. The body rests on its lowest feet and stays level. Each step
+// the feet that stayed down are taken to be fixed to the ground, and the
+// body motion is the rigid transform that best keeps them there; what is
+// left over is counted as slip.
+//
+// Turns are not modelled faithfully: the leg model puts the rotate stance
+// pose (FEMUR_STANCE_ROTATE, TIBIA_STANCE_ROTATE) above the hip, so the
+// lifted tripod is taken as the one on the ground and turn reports come
+// out with the wrong sign and a large slip.
+class BodySimulator {
+public:
+    BodySimulator();
+
+    // All joints at the standing pose, body at the origin facing +x
+    void reset();
+
+    // Servo move at the current time, id is the bus id (1 to 18)
+    void command(int id, int32_t position, int time);
+
+    // Runs the model up to the given time
+    void advanceTo(unsigned long ms);
+
+    unsigned long getTime() const { return timeMs; }
+
+    // Foot contact switch of a leg (leg base / 3)
+    bool isFootDown(int leg) const { return down[leg]; }
+
+    void beginCycle();
+    CycleReport endCycle();
+
+    float getX() const { return x; }
+    float getY() const { return y; }
+    float getHeading() const { return degrees(heading); }
+
+private:
+    struct Joint {
+        float position;
+        float target;
+        float rate;         // centidegrees per ms
+    };
+
+    Joint joints[18];
+    BodyPoint feet[6];
+    bool down[6];
+    unsigned long timeMs;
+
+    // Body on the ground plane, heading in radians
+    float x;
+    float y;
+    float heading;
+
+    unsigned long cycleStartMs;
+    float cycleX;
+    float cycleY;
+    float cycleHeading;
+    float cycleMargin;
+    float cycleSlip;
+    float cycleEffort;
+    unsigned long cycleUnsupportedMs;
+
+    void step(int ms);
+    void placeFeet();
+    float supportMargin() const;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "SimulatedRobot.h"
+#include "Constants.h"
+#include "HostRuntime.h"
+
+thread_local SimulatedRobot* SimulatedRobot::active = NULL;
+
+
+SimulatedRobot::SimulatedRobot()
+    : shadow(joints), tripodGait(bus, shadow, terrain, pose), waveGait(bus, shadow, terrain, pose),
+      trace(NULL), cyclesRun(0) {
+    joints.begin(&bus);
+    reset();
+}
+
+SimulatedRobot::~SimulatedRobot() {
+    if (active == this) {
+        active = NULL;
+        hostOnServoCommand(NULL);
+        hostOnDigitalRead(NULL);
+    }
+}
+
+void SimulatedRobot::reset() {
+    hostSetTime(0);
+    body.reset();
+    terrain.reset();
+    pose.reset();
+    cyclesRun = 0;
+
+    int32_t stance[3] = {COXA_DEFAULT, FEMUR_DOWN, TIBIA_DOWN};
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        shadow.move(id, stance[id % 3], 0);
+    }
+}
+
+bool SimulatedRobot::runCycles(GaitPattern pattern, GaitMotion motion, int cycles, float speed,
+                               const GaitTiming& timing, const GaitStride& stride, CycleReport* reports) {
+    Gait* gait = pattern == WAVE ? (Gait*)&waveGait : (Gait*)&tripodGait;
+    if (!gait->supports(motion)) {
+        return false;
+    }
+
+    active = this;
+    hostOnServoCommand(onServoCommand);
+    hostOnDigitalRead(onDigitalRead);
+
+    const unsigned long period = 1000 / CONTROL_RATE_HZ;
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        gait->setMotion(motion);
+        gait->setSpeed(speed);
+        gait->setTiming(timing);
+        gait->setStride(stride);
+        gait->start();
+
+        body.beginCycle();
+        for (;;) {
+            unsigned long now = millis();
+            body.advanceTo(now);
+            if (gait->update(now)) {
+                break;
+            }
+            hostAdvance(period);
+        }
+        reports[cycle] = body.endCycle();
+
+        cyclesRun++;
+        if (trace != NULL) {
+            fprintf(trace, "# cycle %d\n", cyclesRun);
+        }
+    }
+    return true;
+}
+
+void SimulatedRobot::onServoCommand(int id, int32_t position, int time) {
+    active->body.command(id, position, time);
+    if (active->trace != NULL) {
+        fprintf(active->trace, "%lu %d %ld %d\n", millis(), id, (long)position, time);
+    }
+}
+
+int SimulatedRobot::onDigitalRead(int pin) {
+    for (int leg = 0; leg < 6; leg++) {
+        if (SWITCH_PINS[leg] == pin) {
+            return active->body.isFootDown(leg) ? HIGH : LOW;
+        }
+    }
+    return LOW;
+}
@@ -0,0 +1,54 @@
+#ifndef SIMULATED_ROBOT_H
+#define SIMULATED_ROBOT_H
+
+#include <Arduino.h>
+#include <lx16a-servo.h>
+#include "Enums.h"
+#include "GaitTiming.h"
+#include "ServoShadow.h"
+#include "TerrainMap.h"
+#include "PoseController.h"
+#include "TripodGait.h"
+#include "WaveGait.h"
+#include "BodySimulator.h"
+
+// The firmware gaits running on the host. Their servo commands are
+// played into a BodySimulator, and the foot contact switches they read
+// come back from it. Each instance belongs to the thread that uses it.
+class SimulatedRobot {
+public:
+    SimulatedRobot();
+    ~SimulatedRobot();
+
+    // Back to the standing pose at the origin, with a fresh terrain map
+    void reset();
+
+    // Every servo command is also written here as "<ms> <id> <position>
+    // <time>", with a "# cycle <n>" line after each cycle
+    void setTrace(FILE* stream) { trace = stream; }
+
+    // Runs whole cycles of a gait and reports each one. Returns false
+    // when the gait can not do the motion.
+    bool runCycles(GaitPattern pattern, GaitMotion motion, int cycles, float speed,
+                   const GaitTiming& timing, const GaitStride& stride, CycleReport* reports);
+
+    const BodySimulator& getBody() const { return body; }
+
+private:
+    LX16ABus bus;
+    JointArena joints;
+    ServoShadow shadow;
+    TerrainMap terrain;
+    PoseController pose;
+    TripodGait tripodGait;
+    WaveGait waveGait;
+    BodySimulator body;
+    FILE* trace;
+    int cyclesRun;
+
+    static thread_local SimulatedRobot* active;
+    static void onServoCommand(int id, int32_t position, int time);
+    static int onDigitalRead(int pin);
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include <Arduino.h>
+#include "HostRuntime.h"
+#include "BodySimulator.h"
+#include "SimulatedRobot.h"
+
+// Host side body simulator. Either runs the firmware gaits directly:
+//
+//   hexapod_sim [-v] [-o trace.txt] tripod|wave forward|backward|left|right [cycles] [speed]
+//
+// or replays a recorded servo command stream, one "<ms> <id> <position>
+// <time>" per line with "#" lines marking the end of each cycle:
+//
+//   hexapod_sim [-v] -i trace.txt
+//
+// Prints what every cycle did to the body and a summary at the end. The
+// leg model is only anchored at the walking stance, so turning cycles,
+// which stand on FEMUR/TIBIA_STANCE_ROTATE, come out rough at best.
+
+const int SIM_MAX_CYCLES = 100;
+
+static void usage() {
+    fprintf(stderr, "usage: hexapod_sim [-v] [-o trace] tripod|wave forward|backward|left|right [cycles] [speed]\n"
+                    "       hexapod_sim [-v] -i trace\n");
+}
+
+static void printCycle(int number, const CycleReport& report) {
+    printf("cycle %d: %lu ms, forward %.1f mm, lateral %.1f mm, turn %.1f deg, speed %.1f mm/s, "
+           "margin %.1f mm, slip %.1f mm, effort %.0f deg, unsupported %lu ms\n",
+           number, report.durationMs, report.forward, report.lateral, report.turn, report.speed,
+           report.minMargin, report.slip, report.effort, report.unsupportedMs);
+}
+
+static void printSummary(const char* name, const CycleReport* reports, int count) {
+    if (count == 0) {
+        printf("%s: no cycles\n", name);
+        return;
+    }
+    unsigned long duration = 0, unsupported = 0;
+    float forward = 0, lateral = 0, turn = 0, slip = 0, margin = reports[0].minMargin;
+    for (int i = 0; i < count; i++) {
+        duration += reports[i].durationMs;
+        forward += reports[i].forward;
+        lateral += reports[i].lateral;
+        turn += reports[i].turn;
+        slip += reports[i].slip;
+        unsupported += reports[i].unsupportedMs;
+        margin = min(margin, reports[i].minMargin);
+    }
+    float seconds = duration / 1000.0f;
+    printf("%s: %d cycles in %lu ms, stride %.1f mm, %.1f mm/s, turn %.1f deg/cycle (%.1f deg/s), "
+           "drift %.1f mm, min margin %.1f mm, slip %.1f mm/cycle, unsupported %lu ms\n",
+           name, count, duration, forward / count, forward / seconds, turn / count, turn / seconds,
+           lateral, margin, slip / count, unsupported);
+}
+
+static int replayTrace(const char* path) {
+    FILE* input = fopen(path, "r");
+    if (input == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", path);
+        return 1;
+    }
+
+    BodySimulator body;
+    static CycleReport reports[SIM_MAX_CYCLES];
+    int count = 0;
+    bool pending = false;
+    char line[128];
+    while (fgets(line, sizeof(line), input) != NULL && count < SIM_MAX_CYCLES) {
+        unsigned long ms;
+        int id, time;
+        long position;
+        if (line[0] == '#') {
+            if (pending) {
+                reports[count] = body.endCycle();
+                printCycle(count + 1, reports[count]);
+                count++;
+                pending = false;
+            }
+        } else if (sscanf(line, "%lu %d %ld %d", &ms, &id, &position, &time) == 4 && id >= 1 && id <= 18) {
+            body.advanceTo(ms);
+            body.command(id, position, time);
+            pending = true;
+        }
+    }
+    fclose(input);
+
+    if (pending && count < SIM_MAX_CYCLES) {
+        // Let the last moves finish before closing the cycle
+        body.advanceTo(body.getTime() + 1000);
+        reports[count] = body.endCycle();
+        printCycle(count + 1, reports[count]);
+        count++;
+    }
+    printSummary(path, reports, count);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* tracePath = NULL;
+    const char* inputPath = NULL;
+    bool verbose = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+            tracePath = argv[++arg];
+        } else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+            inputPath = argv[++arg];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    hostSetConsole(verbose ? stderr : NULL);
+
+    if (inputPath != NULL) {
+        return replayTrace(inputPath);
+    }
+    if (argc - arg < 2) {
+        usage();
+        return 2;
+    }
+
+    GaitPattern pattern;
+    if (strcmp(argv[arg], "tripod") == 0) {
+        pattern = TRIPOD;
+    } else if (strcmp(argv[arg], "wave") == 0) {
+        pattern = WAVE;
+    } else {
+        usage();
+        return 2;
+    }
+
+    static const char* const MOTIONS[] = {"forward", "backward", "left", "right"};
+    int motion = 0;
+    while (motion < 4 && strcmp(argv[arg + 1], MOTIONS[motion]) != 0) {
+        motion++;
+    }
+    if (motion == 4) {
+        usage();
+        return 2;
+    }
+
+    int cycles = argc - arg > 2 ? constrain(atoi(argv[arg + 2]), 1, SIM_MAX_CYCLES) : 4;
+    float speed = argc - arg > 3 ? atof(argv[arg + 3]) : 1.0f;
+
+    FILE* trace = NULL;
+    if (tracePath != NULL && (trace = fopen(tracePath, "w")) == NULL) {
+        fprintf(stderr, "ERROR: could not write %s\n", tracePath);
+        return 1;
+    }
+
+    SimulatedRobot robot;
+    robot.setTrace(trace);
+    static CycleReport reports[SIM_MAX_CYCLES];
+    if (!robot.runCycles(pattern, (GaitMotion)motion, cycles, speed, defaultGaitTiming(), defaultGaitStride(),
+                         reports)) {
+        fprintf(stderr, "ERROR: %s gait can not %s\n", argv[arg], argv[arg + 1]);
+        return 1;
+    }
+    if (trace != NULL) {
+        fclose(trace);
+    }
+
+    for (int i = 0; i < cycles; i++) {
+        printCycle(i + 1, reports[i]);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s %s", argv[arg], argv[arg + 1]);
+    printSummary(name, reports, cycles);
+    return 0;
+}
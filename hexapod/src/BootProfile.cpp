@@ -0,0 +1,46 @@
+#include "BootProfile.h"
+
+static const char* STAGE_NAMES[BOOT_STAGE_COUNT] = {
+    "servos", "imu", "settle", "calibrate", "wifi"
+};
+
+
+BootProfile::BootProfile() : readyMs(0) {
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        startMs[i] = 0;
+        endMs[i] = 0;
+        started[i] = false;
+        finished[i] = false;
+    }
+}
+
+void BootProfile::start(BootStage stage) {
+    startMs[stage] = millis();
+    started[stage] = true;
+}
+
+void BootProfile::finish(BootStage stage) {
+    endMs[stage] = millis();
+    finished[stage] = true;
+}
+
+void BootProfile::markReady() {
+    readyMs = millis();
+}
+
+int BootProfile::format(char* buffer, size_t size) const {
+    int length = snprintf(buffer, size, "ready=%lu", readyMs);
+    for (int i = 0; i < BOOT_STAGE_COUNT && length < (int)size; i++) {
+        if (!started[i]) {
+            continue;
+        }
+        if (finished[i]) {
+            length += snprintf(buffer + length, size - length, ";%s=%lu-%lu",
+                               STAGE_NAMES[i], startMs[i], endMs[i]);
+        } else {
+            length += snprintf(buffer + length, size - length, ";%s=%lu-",
+                               STAGE_NAMES[i], startMs[i]);
+        }
+    }
+    return length;
+}
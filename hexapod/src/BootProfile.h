@@ -0,0 +1,41 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <Arduino.h>
+
+// Boot stages run partly in parallel, so each one keeps its own start and
+// end time. Every stage is only ever written by the task running it.
+enum BootStage {
+    BOOT_SERVOS,
+    BOOT_IMU,
+    BOOT_SETTLE,
+    BOOT_CALIBRATE,
+    BOOT_WIFI,
+    BOOT_STAGE_COUNT
+};
+
+class BootProfile {
+public:
+    BootProfile();
+
+    void start(BootStage stage);
+    void finish(BootStage stage);
+    bool isFinished(BootStage stage) const { return finished[stage]; }
+
+    // Actuation is up and commands are taken from here on
+    void markReady();
+    unsigned long getReadyMs() const { return readyMs; }
+
+    // "ready=<ms>;servos=<start>-<end>;..." in ms since boot, stages that
+    // have not finished yet show as <start>-
+    int format(char* buffer, size_t size) const;
+
+private:
+    volatile unsigned long startMs[BOOT_STAGE_COUNT];
+    volatile unsigned long endMs[BOOT_STAGE_COUNT];
+    volatile bool started[BOOT_STAGE_COUNT];
+    volatile bool finished[BOOT_STAGE_COUNT];
+    volatile unsigned long readyMs;
+};
+
+#endif
@@ -5,8 +5,6 @@ const char* PASSWORD = "krolika123";
 
 const int batteryPin = 33;
 
-const int OVERLAP_DELAY = 50;
-
 const int32_t COXA_FORWARD  = 11500;
 const int32_t COXA_BACKWARD = 13500;
 const int32_t COXA_DEFAULT  = 12000;
@@ -41,13 +39,117 @@ const int FAST_LOWER_TIME = 100;
 const int FAST_PUSH_TIME  = 100;
 const int FAST_DELAY      = 30;
 
-const int32_t LEFT_SIDE_COXA_OFFSET  = 200;
-const int32_t RIGHT_SIDE_COXA_OFFSET = -75;
-
-
 const int32_t COXA_ROTATE_FORWARD  = 15000;
 const int32_t COXA_ROTATE_BACKWARD = 9000;
 
 const int ROTATE_MOVE_TIME  = 350;
 const int ROTATE_LIFT_TIME  = 240;
 const int ROTATE_LOWER_TIME = 260;
+
+// Starting estimate for a full rotate cycle, refined from the IMU
+const float ROTATE_DEGREES_PER_CYCLE = 30.0f;
+const float ROTATE_TOLERANCE         = 2.0f;
+const float ROTATE_MIN_STEP          = 0.15f;
+const int ROTATE_EXTRA_STEPS         = 3;
+
+const int CONTROL_RATE_HZ = 100;
+
+// LX-16A at 7.4 V: 0.16 s per 60 degrees, in centidegrees per ms
+const float SERVO_MAX_SPEED = 37.5f;
+const float MIN_SPEED_SCALE = 0.25f;
+const float MAX_SPEED_SCALE = 2.0f;
+
+const int32_t POSITION_TOLERANCE   = 150;
+const int POSTURE_ARRIVAL_PERCENT  = 80;
+const int POSTURE_STALL_MARGIN     = 300;
+const int POSTURE_READS_PER_TICK   = 2;
+
+// Heading hold: coxa centidegrees of stride trim per degree of yaw error
+const double HEADING_KP         = 40.0;
+const double HEADING_KI         = 8.0;
+const double HEADING_KD         = 0.0;
+const int32_t HEADING_MAX_TRIM  = 600;
+const float HEADING_DEADBAND    = 1.0f;
+
+// Terrain adaptation, heights in femur centidegrees
+const int32_t TERRAIN_PRESHAPE_MARGIN = 300;
+const int32_t TERRAIN_PROBE_RANGE     = 800;
+const int TERRAIN_PROBE_TIME          = 160;
+const int32_t TERRAIN_MAX_REACH       = 1200;
+const int32_t TERRAIN_MAX_HEIGHT      = 2500;
+const float TERRAIN_GAIN              = 0.6f;
+const int TERRAIN_CONTACT_TICKS       = 2;
+const int TERRAIN_MISS_LIMIT          = 4;
+
+// Leg geometry in mm and degrees, the standing pose is the reference
+const float COXA_LENGTH        = 45.0f;
+const float FEMUR_LENGTH       = 75.0f;
+const float TIBIA_LENGTH       = 125.0f;
+const float FEMUR_STANCE_ANGLE = 0.0f;
+const float TIBIA_STANCE_ANGLE = 90.0f;
+// Hip distance ahead of the body centre, by leg base / 3
+const float LEG_MOUNT_X[6]     = {80.0f, 0.0f, -80.0f, 80.0f, 0.0f, -80.0f};
+// Hip distance left of the centre line, and the neutral coxa direction
+// counterclockwise from straight ahead
+const float LEG_MOUNT_Y[6]     = {-60.0f, -60.0f, -60.0f, 60.0f, 60.0f, 60.0f};
+const float LEG_MOUNT_ANGLE[6] = {-90.0f, -90.0f, -90.0f, 90.0f, 90.0f, 90.0f};
+
+// Stair climbing, heights in mm
+const int STAIR_ORDER[6]            = {0, 9, 3, 12, 6, 15};
+const float STAIR_CLEARANCE         = 25.0f;
+const float STAIR_SEARCH_HEIGHT     = 70.0f;
+const float STAIR_PRESHAPE_MARGIN   = 8.0f;
+const float STAIR_PROBE_DEPTH       = 60.0f;
+const float STAIR_EDGE_HEIGHT       = 20.0f;
+const float STAIR_LEVEL_TOLERANCE   = 10.0f;
+const float STAIR_MAX_BODY_PITCH    = 20.0f;
+const float STAIR_PITCH_ALARM       = 12.0f;
+const int32_t STAIR_PUSH_DELTA      = 400;
+const int STAIR_LIFT_TIME           = 250;
+const int STAIR_SWING_TIME          = 300;
+const int STAIR_LOWER_TIME          = 250;
+const int STAIR_PROBE_TIME          = 450;
+const int STAIR_SHIFT_TIME          = 300;
+const int STAIR_HOLD_TIME           = 200;
+const int STAIR_HOLD_RETRIES        = 10;
+
+// Gait timing auto-tune
+const int TUNE_CYCLES         = 6;
+const int TUNE_READS_PER_TICK = 3;
+const int TUNE_MIN_SAMPLES    = 12;
+const int TUNE_SAFETY_MS      = 8;
+const int TUNE_MAX_MARGIN     = 200;
+
+// Body pose, offsets in mm and angles in degrees from the standing pose
+const float BODY_POSE_MAX_SHIFT   = 40.0f;
+const float BODY_POSE_MAX_HEIGHT  = 35.0f;
+const float BODY_POSE_MAX_TILT    = 15.0f;
+const float BODY_POSE_SPEED       = 80.0f;
+const float BODY_POSE_TURN_RATE   = 40.0f;
+const int BODY_POSE_MOVE_TIME     = 30;
+const int BODY_POSE_LEGS_PER_TICK = 2;
+
+// Distance the body covers per gait cycle for queued walks, in strokes of
+// the active stride (legStroke between its coxa ends). From hexapod_sim
+// <gait> forward/backward at the default stride: tripod 82 mm, wave
+// 43 mm and five legs 35 mm per cycle on a 41.5 mm stroke.
+const float TRIPOD_CYCLE_STROKES   = 1.97f;
+const float WAVE_CYCLE_STROKES     = 1.04f;
+const float FIVE_LEG_CYCLE_STROKES = 0.85f;
+
+// Leg faults. A settled joint is read back every few ticks; a servo that
+// stops answering or sits off its target, or a foot that stops finding
+// the ground for whole cycles, takes its leg out of the gait.
+const int FAULT_CHECK_TICKS              = 5;
+const int FAULT_SETTLE_MS                = 150;
+const int32_t FAULT_TRACKING_TOLERANCE   = 1200;
+const int FAULT_TRACKING_LIMIT           = 3;
+const int FAULT_READ_LIMIT               = 3;
+const int FAULT_CONTACT_CYCLES           = 3;
+// Lean away from a lost leg in mm, so the body stays inside every four
+// leg support polygon of the five-leg gait, and its speed cap
+const float FIVE_LEG_BODY_SHIFT  = 35.0f;
+const float FIVE_LEG_SPEED_SCALE = 0.6f;
+
+// Stillness after the boot stance arrives, before measuring gyro bias
+const int BOOT_SETTLE_MS = 300;
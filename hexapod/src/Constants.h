@@ -44,10 +44,6 @@ extern const int FAST_DELAY;
 
 extern const int FEMUR_STANCE_ROTATE;
 extern const int TIBIA_STANCE_ROTATE;
-extern const int OVERLAP_DELAY;
-
-extern const int32_t LEFT_SIDE_COXA_OFFSET;
-extern const int32_t RIGHT_SIDE_COXA_OFFSET;
 
 extern const int32_t COXA_ROTATE_FORWARD;
 extern const int32_t COXA_ROTATE_BACKWARD;
@@ -56,4 +52,91 @@ extern const int ROTATE_MOVE_TIME;
 extern const int ROTATE_LIFT_TIME;
 extern const int ROTATE_LOWER_TIME;
 
+extern const float ROTATE_DEGREES_PER_CYCLE;
+extern const float ROTATE_TOLERANCE;
+extern const float ROTATE_MIN_STEP;
+extern const int ROTATE_EXTRA_STEPS;
+
+extern const int CONTROL_RATE_HZ;
+
+extern const float SERVO_MAX_SPEED;
+extern const float MIN_SPEED_SCALE;
+extern const float MAX_SPEED_SCALE;
+
+extern const int32_t POSITION_TOLERANCE;
+extern const int POSTURE_ARRIVAL_PERCENT;
+extern const int POSTURE_STALL_MARGIN;
+extern const int POSTURE_READS_PER_TICK;
+
+extern const double HEADING_KP;
+extern const double HEADING_KI;
+extern const double HEADING_KD;
+extern const int32_t HEADING_MAX_TRIM;
+extern const float HEADING_DEADBAND;
+
+extern const int32_t TERRAIN_PRESHAPE_MARGIN;
+extern const int32_t TERRAIN_PROBE_RANGE;
+extern const int TERRAIN_PROBE_TIME;
+extern const int32_t TERRAIN_MAX_REACH;
+extern const int32_t TERRAIN_MAX_HEIGHT;
+extern const float TERRAIN_GAIN;
+extern const int TERRAIN_CONTACT_TICKS;
+extern const int TERRAIN_MISS_LIMIT;
+
+extern const float COXA_LENGTH;
+extern const float FEMUR_LENGTH;
+extern const float TIBIA_LENGTH;
+extern const float FEMUR_STANCE_ANGLE;
+extern const float TIBIA_STANCE_ANGLE;
+extern const float LEG_MOUNT_X[6];
+extern const float LEG_MOUNT_Y[6];
+extern const float LEG_MOUNT_ANGLE[6];
+
+extern const int STAIR_ORDER[6];
+extern const float STAIR_CLEARANCE;
+extern const float STAIR_SEARCH_HEIGHT;
+extern const float STAIR_PRESHAPE_MARGIN;
+extern const float STAIR_PROBE_DEPTH;
+extern const float STAIR_EDGE_HEIGHT;
+extern const float STAIR_LEVEL_TOLERANCE;
+extern const float STAIR_MAX_BODY_PITCH;
+extern const float STAIR_PITCH_ALARM;
+extern const int32_t STAIR_PUSH_DELTA;
+extern const int STAIR_LIFT_TIME;
+extern const int STAIR_SWING_TIME;
+extern const int STAIR_LOWER_TIME;
+extern const int STAIR_PROBE_TIME;
+extern const int STAIR_SHIFT_TIME;
+extern const int STAIR_HOLD_TIME;
+extern const int STAIR_HOLD_RETRIES;
+
+extern const int TUNE_CYCLES;
+extern const int TUNE_READS_PER_TICK;
+extern const int TUNE_MIN_SAMPLES;
+extern const int TUNE_SAFETY_MS;
+extern const int TUNE_MAX_MARGIN;
+
+extern const float BODY_POSE_MAX_SHIFT;
+extern const float BODY_POSE_MAX_HEIGHT;
+extern const float BODY_POSE_MAX_TILT;
+extern const float BODY_POSE_SPEED;
+extern const float BODY_POSE_TURN_RATE;
+extern const int BODY_POSE_MOVE_TIME;
+extern const int BODY_POSE_LEGS_PER_TICK;
+
+extern const float TRIPOD_CYCLE_STROKES;
+extern const float WAVE_CYCLE_STROKES;
+extern const float FIVE_LEG_CYCLE_STROKES;
+
+extern const int FAULT_CHECK_TICKS;
+extern const int FAULT_SETTLE_MS;
+extern const int32_t FAULT_TRACKING_TOLERANCE;
+extern const int FAULT_TRACKING_LIMIT;
+extern const int FAULT_READ_LIMIT;
+extern const int FAULT_CONTACT_CYCLES;
+extern const float FIVE_LEG_BODY_SHIFT;
+extern const float FIVE_LEG_SPEED_SCALE;
+
+extern const int BOOT_SETTLE_MS;
+
 #endif
@@ -0,0 +1,96 @@
+#include "ControlLoop.h"
+
+
+ControlLoop::ControlLoop(int rateHz)
+    : periodMicros(1000000 / rateHz), callback(NULL), taskHandle(NULL),
+      timer(NULL), lastStartMicros(0) {
+    resetStats();
+}
+
+bool ControlLoop::begin(ControlTickCallback tickCallback, int core, int priority) {
+    callback = tickCallback;
+
+    if (xTaskCreatePinnedToCore(taskEntry, "ControlTask", CONTROL_TASK_STACK, this,
+                                priority, &taskHandle, core) != pdPASS) {
+        Serial.println("ERROR: could not create control task");
+        return false;
+    }
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = timerCallback;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "control";
+
+    if (esp_timer_create(&timerArgs, &timer) != ESP_OK ||
+        esp_timer_start_periodic(timer, periodMicros) != ESP_OK) {
+        Serial.println("ERROR: could not start control timer");
+        return false;
+    }
+
+    Serial.printf("Control loop running at %lu Hz on core %d\n",
+                  (unsigned long)(1000000 / periodMicros), core);
+    return true;
+}
+
+void ControlLoop::timerCallback(void* arg) {
+    ControlLoop* loop = (ControlLoop*)arg;
+    xTaskNotifyGive(loop->taskHandle);
+}
+
+void ControlLoop::taskEntry(void* arg) {
+    ((ControlLoop*)arg)->run();
+}
+
+void ControlLoop::run() {
+    for (;;) {
+        // Every timer period adds one notification; more than one pending
+        // means whole ticks were lost behind a long one
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (pending > 1) {
+            stats.missedTicks += pending - 1;
+        }
+
+        int64_t start = esp_timer_get_time();
+        if (lastStartMicros != 0) {
+            int64_t jitter = (start - lastStartMicros) - (int64_t)periodMicros;
+            if (jitter < 0) jitter = -jitter;
+            if (pending == 1 && (uint32_t)jitter > stats.maxJitterMicros) {
+                stats.maxJitterMicros = jitter;
+            }
+        }
+        lastStartMicros = start;
+
+        callback(millis());
+
+        uint32_t elapsed = esp_timer_get_time() - start;
+        stats.ticks++;
+        stats.lastTickMicros = elapsed;
+        if (elapsed > stats.maxTickMicros) {
+            stats.maxTickMicros = elapsed;
+        }
+        if (elapsed > periodMicros) {
+            stats.overruns++;
+        }
+    }
+}
+
+ControlLoopStats ControlLoop::getStats() {
+    ControlLoopStats copy;
+    copy.ticks = stats.ticks;
+    copy.overruns = stats.overruns;
+    copy.missedTicks = stats.missedTicks;
+    copy.lastTickMicros = stats.lastTickMicros;
+    copy.maxTickMicros = stats.maxTickMicros;
+    copy.maxJitterMicros = stats.maxJitterMicros;
+    return copy;
+}
+
+void ControlLoop::resetStats() {
+    stats.ticks = 0;
+    stats.overruns = 0;
+    stats.missedTicks = 0;
+    stats.lastTickMicros = 0;
+    stats.maxTickMicros = 0;
+    stats.maxJitterMicros = 0;
+}
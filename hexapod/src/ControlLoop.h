@@ -0,0 +1,53 @@
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+const int CONTROL_TASK_STACK = 8192;
+
+typedef void (*ControlTickCallback)(unsigned long nowMs);
+
+struct ControlLoopStats {
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long missedTicks;
+    uint32_t lastTickMicros;
+    uint32_t maxTickMicros;
+    uint32_t maxJitterMicros;
+};
+
+// Fixed-rate control task. A periodic esp_timer notifies a task pinned to
+// its own core, which runs one tick per period and keeps count of ticks
+// that ran past their deadline or were skipped entirely.
+class ControlLoop {
+public:
+    ControlLoop(int rateHz);
+
+    bool begin(ControlTickCallback callback, int core, int priority);
+
+    ControlLoopStats getStats();
+    void resetStats();
+
+    uint32_t getPeriodMicros() const {
+        return periodMicros;
+    }
+
+    TaskHandle_t getTaskHandle() const {
+        return taskHandle;
+    }
+
+private:
+    uint32_t periodMicros;
+    ControlTickCallback callback;
+    TaskHandle_t taskHandle;
+    esp_timer_handle_t timer;
+    int64_t lastStartMicros;
+    volatile ControlLoopStats stats;
+
+    static void timerCallback(void* arg);
+    static void taskEntry(void* arg);
+    void run();
+};
+
+#endif
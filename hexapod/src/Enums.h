@@ -6,6 +6,13 @@ enum Direction {
     RIGHT
 };
 
+enum GaitMotion {
+    WALK_FORWARD,
+    WALK_BACKWARD,
+    TURN_LEFT,
+    TURN_RIGHT
+};
+
 enum GaitPattern {
     TRIPOD,
     WAVE,
@@ -22,5 +29,8 @@ enum RobotMode {
     STAND_UP,
     DANCE,
     BALANCE,
-    NONE
+    NONE,
+    ROTATE_TO_ANGLE,
+    STAIRCASE,
+    AUTO_TUNE
 };
@@ -0,0 +1,49 @@
+#include "FiveLegGait.h"
+#include "Constants.h"
+
+// The wave step, every leg shifting the body after each touchdown
+constexpr StepPhase FIVE_LEG_WALK_STEP[] = {
+    {PHASE_LIFT,  false, &GaitTiming::waveLiftTime,  &GaitTiming::waveDelay},
+    {PHASE_SWING, false, &GaitTiming::waveSwingTime, &GaitTiming::waveDelay},
+    {PHASE_LOWER, false, &GaitTiming::waveLowerTime, &GaitTiming::waveDelay},
+    {PHASE_PROBE, false, NULL,                       NULL},
+    {PHASE_SHIFT, false, &GaitTiming::waveShiftTime, &GaitTiming::waveDelay},
+};
+
+// Turning plants the leg at the turning stance instead of probing
+constexpr StepPhase FIVE_LEG_TURN_STEP[] = {
+    {PHASE_LIFT,  false, &GaitTiming::rotateLiftTime,  &GaitTiming::waveDelay},
+    {PHASE_SWING, false, &GaitTiming::rotateSwingTime, &GaitTiming::waveDelay},
+    {PHASE_PLANT, false, &GaitTiming::rotatePlantTime, &GaitTiming::waveDelay},
+    {PHASE_SHIFT, false, &GaitTiming::waveShiftTime,   &GaitTiming::rotateLowerDelay},
+};
+
+
+FiveLegGait::FiveLegGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+                         PoseController& bodyPose)
+    : Gait(bus, servoShadow, terrainMap, bodyPose), lostLeg(-1) {
+    walk = {"Leg", FIVE_LEG_WALK_STEP, countOf(FIVE_LEG_WALK_STEP), groups, 0};
+    turn = {"Leg", FIVE_LEG_TURN_STEP, countOf(FIVE_LEG_TURN_STEP), groups, 0};
+}
+
+void FiveLegGait::setLostLeg(int leg) {
+    lostLeg = leg;
+    idleLegs = leg >= 0 ? 1 << leg : 0;
+
+    // The remaining legs in WAVE_ORDER
+    uint8_t count = 0;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        if (WAVE_ORDER[i] / JOINTS_PER_LEG != leg && count < LEG_COUNT - 1) {
+            groups[count++] = legBit(WAVE_ORDER[i]);
+        }
+    }
+    walk.groupCount = count;
+    turn.groupCount = count;
+}
+
+const GaitDescription* FiveLegGait::describe(GaitMotion candidate) const {
+    if (lostLeg < 0) {
+        return NULL;
+    }
+    return isTurn(candidate) ? &turn : &walk;
+}
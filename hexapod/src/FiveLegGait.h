@@ -0,0 +1,29 @@
+#ifndef FIVE_LEG_GAIT_H
+#define FIVE_LEG_GAIT_H
+
+#include "Gait.h"
+
+// Wave gait over the five legs left after one was lost: one leg swings
+// while the other four hold the body, so it stays statically stable with
+// the body leaned away from the gap. It also turns, in the same order,
+// as the tripod can not without the lost leg. The lost leg is left alone.
+class FiveLegGait : public Gait {
+public:
+    FiveLegGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+                PoseController& bodyPose);
+
+    // Leg base / 3, or -1 to walk on none; only set between cycles
+    void setLostLeg(int leg);
+    int getLostLeg() const { return lostLeg; }
+
+protected:
+    const GaitDescription* describe(GaitMotion candidate) const override;
+
+private:
+    int lostLeg;
+    uint8_t groups[LEG_COUNT - 1];
+    GaitDescription walk;
+    GaitDescription turn;
+};
+
+#endif
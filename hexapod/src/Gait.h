@@ -4,35 +4,282 @@
 #include <Arduino.h>
 #include <lx16a-servo.h>
 #include <Constants.h>
+#include "Enums.h"
+#include "PhasedMotion.h"
+#include "ServoShadow.h"
+#include "TerrainMap.h"
+#include "PoseController.h"
+#include "GaitTiming.h"
+#include "GaitTable.h"
+#include "InputLog.h"
+#include "Logger.h"
 
 
 
-class Gait {
+class Gait : public PhasedMotion {
 public:
 
-    Gait(LX16ABus& bus, LX16AServo** servoArray)
-        : servoBus(bus), servos(servoArray) {}
+    Gait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap, PoseController& bodyPose)
+        : servoBus(bus), shadow(servoShadow), terrain(terrainMap), pose(bodyPose),
+          motion(WALK_FORWARD), strideTrim(0), speed(1.0f), turnAmplitude(1.0f), timing(defaultGaitTiming()),
+          stride(defaultGaitStride()), slowestMoveMs(0), touchdownLegs(0), idleLegs(0) {}
 
     virtual ~Gait() {}
 
-    virtual void move() {}
-    
-    virtual void moveBackward() {}
+    // Cadence multiplier, clamped to MIN/MAX_SPEED_SCALE. Also takes
+    // effect with the next cycle.
+    void setSpeed(float scale) {
+        speed = constrain(scale, MIN_SPEED_SCALE, MAX_SPEED_SCALE);
+    }
+
+    float getSpeed() const { return speed; }
+
+    // Phase move times and settle delays, normally from the parameter store
+    void setTiming(const GaitTiming& values) {
+        timing = values;
+    }
+
+    void setStride(const GaitStride& values) {
+        stride = values;
+    }
+
+    void setMotion(GaitMotion nextMotion) {
+        motion = nextMotion;
+        // Forget touchdowns left over from a cycle that was cut short
+        touchdownLegs = 0;
+        slowestMoveMs = 0;
+    }
+
+    // Stride asymmetry in coxa centidegrees, positive steers the body
+    // counterclockwise. Also takes effect with the next cycle.
+    void setStrideTrim(int32_t trim) {
+        strideTrim = trim;
+    }
+
+    // Fraction of the full turning stride, for the partial last step of
+    // a planned turn. Takes effect when the next cycle is started.
+    void setTurnAmplitude(float amplitude) {
+        turnAmplitude = constrain(amplitude, 0.0f, 1.0f);
+    }
+
+    virtual bool supports(GaitMotion candidate) {
+        return describe(candidate) != NULL;
+    }
+
+    // The step phase the current motion runs as the given phase, NULL
+    // past the end or for gaits without a table
+    const StepPhase* stepAt(int phase) const {
+        const GaitDescription* gait = describe(motion);
+        if (gait == NULL || phase < 0 || phase >= gaitPhaseCount(*gait)) {
+            return NULL;
+        }
+        return &gait->phases[phase % gait->phaseCount];
+    }
 
 
     protected:
     LX16ABus& servoBus;
-    LX16AServo** servos;
+    ServoShadow& shadow;
+    TerrainMap& terrain;
+    PoseController& pose;
+    GaitMotion motion;
+    int32_t strideTrim;
+    float speed;
+    float turnAmplitude;
+    GaitTiming timing;
+    GaitStride stride;
+    int slowestMoveMs;
+    uint8_t touchdownLegs;
+    uint8_t contactTicks[6];
+    uint8_t idleLegs;           // left out of every phase, bit per leg
 
     
+    // Table of the gait for a motion, NULL if the gait can not do it
+    virtual const GaitDescription* describe(GaitMotion candidate) const {
+        return NULL;
+    }
+
     bool isRightSide(int base) {
-        return base == 0 || base == 3 || base == 6;
+        return RIGHT_LEG_BITS & legBit(base);
+    }
+
+    // Lengthens one side's stride and shortens the other by half the
+    // trim; forwardLeg is set for the side that swings to coxaForward
+    int32_t trimStride(int32_t coxa, bool forwardLeg) {
+        int32_t extend = (forwardLeg ? strideTrim : -strideTrim) / 2;
+        int32_t middle = (stride.coxaForward + stride.coxaBackward) / 2;
+        return coxa > middle ? coxa + extend : coxa - extend;
+    }
+
+    // Coxa target at the swing or push end of the stride
+    template <GaitMotion M>
+    int32_t strideEnd(bool forwardLeg, bool swing) {
+        bool toForward = forwardLeg == swing;
+        if (isTurn(M)) {
+            int32_t end = toForward ? COXA_ROTATE_FORWARD : COXA_ROTATE_BACKWARD;
+            return COXA_DEFAULT + (int32_t)((end - COXA_DEFAULT) * turnAmplitude);
+        }
+        return trimStride(toForward ? stride.coxaForward : stride.coxaBackward, forwardLeg);
+    }
+
+    // Coxa of a stance leg after a body shift. Walking moves it by the
+    // stride's body push; turning covers the turn stride in the given
+    // number of shifts, so the body turns as far per cycle as with the
+    // tripod.
+    template <GaitMotion M>
+    int32_t shiftStance(int base, bool forwardLeg, int shifts) {
+        int32_t coxa = shadow.unposedTarget(base);
+        if (!isTurn(M)) {
+            int32_t shift = forwardLeg ? stride.bodyPush : -stride.bodyPush;
+            return constrain(coxa + shift, (int32_t)stride.coxaForward, (int32_t)stride.coxaBackward);
+        }
+        int32_t pushEnd = strideEnd<M>(forwardLeg, false);
+        int32_t swingEnd = strideEnd<M>(forwardLeg, true);
+        int32_t shift = (pushEnd - swingEnd) / max(shifts, 1);
+        return constrain(coxa + shift, min(pushEnd, swingEnd), max(pushEnd, swingEnd));
+    }
+
+    template <GaitMotion M>
+    int32_t stanceFemur(int base) {
+        return isTurn(M) ? FEMUR_STANCE_ROTATE : terrain.stanceFemur(base);
+    }
+
+    template <GaitMotion M>
+    int32_t stanceTibia() {
+        return isTurn(M) ? TIBIA_STANCE_ROTATE : TIBIA_DOWN;
+    }
+
+    // Steps the current motion through the gait's table. Each motion gets
+    // its own instance, so the mirroring folds to constants.
+    int runPhase(int phase) override {
+        switch (motion) {
+            case WALK_FORWARD:  return runStep<WALK_FORWARD>(phase);
+            case WALK_BACKWARD: return runStep<WALK_BACKWARD>(phase);
+            case TURN_LEFT:     return runStep<TURN_LEFT>(phase);
+            case TURN_RIGHT:    return runStep<TURN_RIGHT>(phase);
+        }
+        return -1;
+    }
+
+    template <GaitMotion M>
+    int runStep(int phase) {
+        const GaitDescription* gait = describe(M);
+        if (gait == NULL) {
+            return -1;
+        }
+        // Touchdowns not seen by the end of a probe are misses
+        const StepPhase* step = stepAt(phase);
+        if (step == NULL || step->action != PHASE_PROBE) {
+            finishTouchdown();
+        }
+        if (step == NULL) {
+            return -1;
+        }
+        if (step->action == PHASE_PROBE) {
+            return probeLegs();
+        }
+
+        int groupIndex = phase / gait->phaseCount;
+        uint8_t group = gait->groups[groupIndex];
+        logStep(M, *gait, *step, groupIndex);
+
+        int time = timing.*step->moveTime;
+        for (int leg = 0; leg < 6; leg++) {
+            int base = leg * 3;
+            uint8_t bit = 1 << leg;
+            bool forwardLeg = forwardSwingLegs<M>() & bit;
+            if (idleLegs & bit) {
+                continue;
+            }
+
+            if (group & bit) {
+                switch (step->action) {
+                    case PHASE_LIFT:
+                        moveLeg(base, shadow.unposedTarget(base), stride.femurLift, TIBIA_UP, time);
+                        break;
+                    case PHASE_SWING:
+                        moveLeg(base, strideEnd<M>(forwardLeg, true), stride.femurLift, TIBIA_UP, time);
+                        break;
+                    case PHASE_LOWER:
+                        lowerLeg(base, shadow.unposedTarget(base), time);
+                        break;
+                    case PHASE_PLANT:
+                        moveLeg(base, shadow.unposedTarget(base), stanceFemur<M>(base), stanceTibia<M>(), time);
+                        break;
+                    default:
+                        break;
+                }
+            } else if (step->action == PHASE_SWING && step->pushOthers) {
+                moveLeg(base, strideEnd<M>(forwardLeg, false), stanceFemur<M>(base), stanceTibia<M>(), time);
+            } else if (step->action == PHASE_SHIFT) {
+                int32_t coxa = shiftStance<M>(base, forwardLeg, gait->groupCount - 1);
+                moveLeg(base, coxa, stanceFemur<M>(base), stanceTibia<M>(), time);
+            }
+        }
+
+        return phaseTime(time, step->delay != NULL ? timing.*step->delay : 0);
     }
 
+    void logStep(GaitMotion running, const GaitDescription& gait, const StepPhase& step, int groupIndex) {
+        static const char* const VERBS[] = {"Lifting", "Swinging", "Lowering", "Probing", "Planting",
+                                            "Shifting body after"};
+        static const char* const SUFFIXES[] = {"", " (backward)", " (turning left)", " (turning right)"};
+
+        // Single legs are named by their base, groups by their number
+        uint8_t group = gait.groups[groupIndex];
+        int label = groupIndex + 1;
+        if ((group & (group - 1)) == 0) {
+            for (label = 0; !(group & legBit(label)); label += 3) {}
+        }
+        logPrintf("%s %s %d%s", VERBS[step.action], gait.groupName, label, SUFFIXES[running]);
+    }
+
+    // Phase times are given for 1x speed and scaled here. A move is never
+    // made faster than the servo can turn, and the phase waits for the
+    // slowest one.
+    int scaleTime(int time) {
+        return (int)(time / speed + 0.5f);
+    }
+
+    void moveJoint(int id, int32_t target, int time, int32_t unposed = -1) {
+        int duration = scaleTime(time);
+        if (shadow.isKnown(id)) {
+            int32_t travel = abs(target - shadow.estimate(id, inputClock()));
+            duration = max(duration, (int)ceil(travel / SERVO_MAX_SPEED));
+        }
+        slowestMoveMs = max(slowestMoveMs, duration);
+        shadow.move(id, target, duration, unposed);
+    }
+
+    // Targets are for the standing body, the body pose is laid over them
+    // here. A foot the pose would put out of reach is placed unposed.
     void moveLeg(int base, int32_t coxa, int32_t femur, int32_t tibia, int time = MOVE_TIME) {
-        servos[base]->move_time(coxa, time);
-        servos[base+1]->move_time(femur, time);
-        servos[base+2]->move_time(tibia, time);
+        JointTargets targets = {coxa, femur, tibia};
+        JointTargets posed;
+        pose.apply(base, targets, posed);
+        moveJoint(base, posed.coxa, time, coxa);
+        moveJoint(base+1, posed.femur, time, femur);
+        moveJoint(base+2, posed.tibia, time, tibia);
+    }
+
+    // Stops a leg's femur and tibia where they are now and returns that
+    // position without the pose
+    JointTargets freezeLeg(int base, unsigned long now) {
+        JointTargets posed = {shadow.estimate(base, now), shadow.estimate(base + 1, now),
+                              shadow.estimate(base + 2, now)};
+        JointTargets targets;
+        pose.remove(base, posed, targets);
+        shadow.move(base + 1, posed.femur, 0, targets.femur);
+        shadow.move(base + 2, posed.tibia, 0, targets.tibia);
+        return targets;
+    }
+
+    // What a phase returns: its move time, stretched to the slowest move
+    // actually commanded, plus the settle delay
+    int phaseTime(int moveTime, int delay) {
+        int duration = max(scaleTime(moveTime), slowestMoveMs) + scaleTime(delay);
+        slowestMoveMs = 0;
+        return duration;
     }
 
     int getSwitchIndex(int legBase) {
@@ -52,210 +299,81 @@ public:
         if (switchIndex < 0) return false;
         
         int switchPin = SWITCH_PINS[switchIndex];
-        int reading = digitalRead(switchPin);
+        int reading = inputSwitch(switchIndex, digitalRead(switchPin));
         return reading == 1;
     }
 
-    bool readSwitchDebounced(int legBase, int debounceCount = 5) {
-        int switchIndex = getSwitchIndex(legBase);
-        if (switchIndex < 0) return false;
-        
-        int switchPin = SWITCH_PINS[switchIndex];
-        int pressedCount = 0;
-        
-        for (int i = 0; i < debounceCount; i++) {
-            if (digitalRead(switchPin) == 1) {
-                pressedCount++;
-            }
-            if (i < debounceCount - 1) {
-                delay(2);
-            }
+    // Lowers a swing leg fast to just above its ground estimate and starts
+    // watching its switch. Legs whose switch is already closed while still
+    // lifted can not be trusted this step and are placed blind.
+    void lowerLeg(int base, int32_t coxa, int time) {
+        int leg = base / 3;
+        moveLeg(base, coxa, terrain.preshapeFemur(base), TIBIA_DOWN, time);
+        contactTicks[leg] = 0;
+        if (terrain.isSwitchTrusted(base) && !isLegOnGround(base)) {
+            touchdownLegs |= 1 << leg;
         }
-        
-        return pressedCount >= (debounceCount * 3 / 5);
     }
 
-    bool lowerLegUntilGrounded(int legBase, int32_t targetCoxa, int timeout = 3000) {
-        const int32_t STEP_SIZE = 100;
-        const int STEP_DELAY = 30;
-        
-        unsigned long startTime = millis();
-        
-        int32_t currentFemur = servos[legBase+1]->pos_read();
-        int32_t currentTibia = servos[legBase+2]->pos_read();
-        
-        servos[legBase]->move_time(targetCoxa, 150);
-        
-        Serial.print("Adaptively lowering leg ");
-        Serial.print(legBase);
-        Serial.print(" from femur=");
-        Serial.print(currentFemur);
-        Serial.print(", tibia=");
-        Serial.println(currentTibia);
-        
-        while ((millis() - startTime < timeout)) {
-            if (readSwitchDebounced(legBase)) {
-                Serial.print("Leg ");
-                Serial.print(legBase);
-                Serial.print(" grounded at femur=");
-                Serial.print(currentFemur);
-                Serial.print(", tibia=");
-                Serial.println(currentTibia);
-                return true;
-            }
-            
-            int32_t nextFemur = currentFemur - STEP_SIZE;
-            int32_t nextTibia = currentTibia - STEP_SIZE;
-            
-            if (nextFemur < FEMUR_DOWN) nextFemur = FEMUR_DOWN;
-            if (nextTibia < TIBIA_DOWN) nextTibia = TIBIA_DOWN;
-            
-            if (nextFemur == FEMUR_DOWN && nextTibia == TIBIA_DOWN && 
-                currentFemur == FEMUR_DOWN && currentTibia == TIBIA_DOWN) {
-                Serial.print("Leg ");
-                Serial.print(legBase);
-                Serial.println(" reached full extension without ground contact");
-                return false;
-            }
-            
-            servos[legBase+1]->move_time(nextFemur, STEP_DELAY);
-            servos[legBase+2]->move_time(nextTibia, STEP_DELAY);
-            
-            currentFemur = nextFemur;
-            currentTibia = nextTibia;
-            
-            delay(STEP_DELAY);
-        }
-        
-        Serial.print("Timeout lowering leg ");
-        Serial.println(legBase);
-        return false;
-    }
-    
-    void lowerTripodAdaptively(const int* tripodLegs) {
-        Serial.print("Adaptively lowering tripod: legs ");
-        for (int i = 0; i < 3; i++) {
-            Serial.print(tripodLegs[i]);
-            if (i < 2) Serial.print(", ");
-        }
-        Serial.println();
-        
-        bool allGrounded[3] = {false, false, false};
-        int32_t currentFemur[3];
-        int32_t currentTibia[3];
-        
-        for (int i = 0; i < 3; i++) {
-            int leg = tripodLegs[i];
-            currentFemur[i] = servos[leg+1]->pos_read();
-            currentTibia[i] = servos[leg+2]->pos_read();
+    // Slowly extends the legs that have not touched down yet
+    int probeLegs() {
+        if (touchdownLegs == 0) {
+            return 0;
         }
-        
-        const int32_t STEP_SIZE = 100;
-        const int STEP_DELAY = 30;
-        const int MAX_STEPS = 50;
-        
-        for (int step = 0; step < MAX_STEPS; step++) {
-            bool allDone = true;
-            
-            for (int i = 0; i < 3; i++) {
-                if (allGrounded[i]) continue;
-                
-                int leg = tripodLegs[i];
-                
-                if (readSwitchDebounced(leg)) {
-                    allGrounded[i] = true;
-                    Serial.print("Leg ");
-                    Serial.print(leg);
-                    Serial.print(" grounded at step ");
-                    Serial.println(step);
-                    continue;
-                }
-                
-                allDone = false;
-                
-                int32_t nextFemur = currentFemur[i] - STEP_SIZE;
-                int32_t nextTibia = currentTibia[i] - STEP_SIZE;
-                
-                if (nextFemur < FEMUR_DOWN) nextFemur = FEMUR_DOWN;
-                if (nextTibia < TIBIA_DOWN) nextTibia = TIBIA_DOWN;
-                
-                servos[leg+1]->move_time(nextFemur, STEP_DELAY);
-                servos[leg+2]->move_time(nextTibia, STEP_DELAY);
-                
-                currentFemur[i] = nextFemur;
-                currentTibia[i] = nextTibia;
+        for (int leg = 0; leg < 6; leg++) {
+            if (!(touchdownLegs & (1 << leg))) {
+                continue;
+            }
+            // Only the femur extends, the others move just to keep the pose
+            int base = leg * 3;
+            JointTargets targets = {shadow.unposedTarget(base), terrain.probeFemur(base),
+                                    shadow.unposedTarget(base + 2)};
+            JointTargets posed;
+            pose.apply(base, targets, posed);
+            if (posed.coxa != shadow.target(base)) {
+                moveJoint(base, posed.coxa, TERRAIN_PROBE_TIME, targets.coxa);
             }
-            
-            if (allDone) {
-                Serial.println("All legs in tripod grounded!");
-                return;
+            moveJoint(base + 1, posed.femur, TERRAIN_PROBE_TIME, targets.femur);
+            if (posed.tibia != shadow.target(base + 2)) {
+                moveJoint(base + 2, posed.tibia, TERRAIN_PROBE_TIME, targets.tibia);
             }
-            
-            delay(STEP_DELAY);
         }
-        
-        for (int i = 0; i < 3; i++) {
-            if (!allGrounded[i]) {
-                Serial.print("Warning: Leg ");
-                Serial.print(tripodLegs[i]);
-                Serial.print(" did not make ground contact - switch reading: ");
-                int switchIndex = getSwitchIndex(tripodLegs[i]);
-                Serial.println(digitalRead(SWITCH_PINS[switchIndex]));
+        return phaseTime(TERRAIN_PROBE_TIME, 0);
+    }
+
+    // Legs still waiting at the end of the probe found no ground
+    void finishTouchdown() {
+        for (int leg = 0; leg < 6; leg++) {
+            if (touchdownLegs & (1 << leg)) {
+                logPrintf("Leg %d found no ground", leg * 3);
+                terrain.recordMiss(leg * 3, shadow.unposedTarget(leg * 3 + 1));
             }
         }
+        touchdownLegs = 0;
     }
-    
-    void waitForTripodGrounded(const int* tripodLegs, int timeout = 3000) {
-        unsigned long startTime = millis();
-        bool allGrounded = false;
-        
-        Serial.print("Waiting for legs ");
-        for (int i = 0; i < 3; i++) {
-            Serial.print(tripodLegs[i]);
-            if (i < 2) Serial.print(", ");
+
+    // Freezes each lowering leg where its switch closes; the phase ends
+    // early once every watched leg is down
+    bool phaseSettled(unsigned long now) override {
+        if (touchdownLegs == 0) {
+            return false;
         }
-        Serial.println(" to touch ground...");
-        
-        while (!allGrounded && (millis() - startTime < timeout)) {
-            allGrounded = true;
-            for (int i = 0; i < 3; i++) {
-                int leg = tripodLegs[i];
-                if (!readSwitchDebounced(leg, 5)) {
-                    allGrounded = false;
-                    int switchIndex = getSwitchIndex(leg);
-                    int reading = digitalRead(SWITCH_PINS[switchIndex]);
-                    Serial.print("Leg ");
-                    Serial.print(leg);
-                    Serial.print(" (pin ");
-                    Serial.print(SWITCH_PINS[switchIndex]);
-                    Serial.print("): ");
-                    Serial.print(reading);
-                    Serial.println(reading == 1 ? " [PRESSED]" : " [NOT PRESSED]");
-                    break;
-                }
+        for (int leg = 0; leg < 6; leg++) {
+            if (!(touchdownLegs & (1 << leg))) {
+                continue;
             }
-            if (!allGrounded) {
-                delay(30);
+            int base = leg * 3;
+            if (!isLegOnGround(base)) {
+                contactTicks[leg] = 0;
+                continue;
             }
-        }
-        
-        if (!allGrounded) {
-            Serial.println("Warning: Timeout waiting for tripod to ground");
-            for (int i = 0; i < 3; i++) {
-                int leg = tripodLegs[i];
-                int switchIndex = getSwitchIndex(leg);
-                int reading = digitalRead(SWITCH_PINS[switchIndex]);
-                Serial.print("Leg ");
-                Serial.print(leg);
-                Serial.print(" (pin ");
-                Serial.print(SWITCH_PINS[switchIndex]);
-                Serial.print("): ");
-                Serial.print(reading);
-                Serial.println(reading == 1 ? " [PRESSED]" : " [NOT PRESSED]");
+            if (++contactTicks[leg] < TERRAIN_CONTACT_TICKS) {
+                continue;
             }
-        } else {
-            Serial.println("All legs grounded!");
+            terrain.recordTouchdown(base, freezeLeg(base, now).femur);
+            touchdownLegs &= ~(1 << leg);
         }
+        return touchdownLegs == 0;
     }
 };
 
@@ -0,0 +1,69 @@
+#ifndef GAIT_TABLE_H
+#define GAIT_TABLE_H
+
+#include <Arduino.h>
+#include "Enums.h"
+#include "GaitTiming.h"
+
+// Gaits are described as data: one step is a short list of phases acting
+// on a group of legs, and the gait repeats that step for each group in
+// turn. Forward, backward and turning variants all run from the same
+// description, mirrored per motion by the templates below.
+
+// What a phase does with its step group
+enum PhaseAction : uint8_t {
+    PHASE_LIFT,     // raise off the ground, coxa stays
+    PHASE_SWING,    // carry to the far end of the stride
+    PHASE_LOWER,    // lower onto the terrain estimate and watch for contact
+    PHASE_PROBE,    // extend the legs that have not touched down yet
+    PHASE_PLANT,    // put straight down at stance, no probing
+    PHASE_SHIFT     // every other leg pushes a little to move the body
+};
+
+struct StepPhase {
+    PhaseAction action;
+    bool pushOthers;            // the other legs drive the stride meanwhile
+    int GaitTiming::* moveTime; // unused for the probe
+    int GaitTiming::* delay;    // settle margin, NULL for none
+};
+
+struct GaitDescription {
+    const char* groupName;
+    const StepPhase* phases;
+    uint8_t phaseCount;
+    const uint8_t* groups;      // legs of each step, bit per leg base / 3
+    uint8_t groupCount;
+};
+
+constexpr uint8_t legBit(int base) {
+    return 1 << (base / 3);
+}
+
+const uint8_t ALL_LEG_BITS = 0x3F;
+const uint8_t RIGHT_LEG_BITS = legBit(0) | legBit(3) | legBit(6);
+
+template <typename T, size_t N>
+constexpr uint8_t countOf(const T (&)[N]) {
+    return N;
+}
+
+constexpr int gaitPhaseCount(const GaitDescription& gait) {
+    return gait.phaseCount * gait.groupCount;
+}
+
+constexpr bool isTurn(GaitMotion motion) {
+    return motion == TURN_LEFT || motion == TURN_RIGHT;
+}
+
+// Legs the motion swings towards the coxa forward end (coxaForward of the
+// stride for walking, COXA_ROTATE_FORWARD for turning). Walking forward that is the
+// right side; walking backward mirrors it, and turning swings every leg
+// the same way.
+template <GaitMotion M>
+constexpr uint8_t forwardSwingLegs() {
+    return M == WALK_FORWARD ? RIGHT_LEG_BITS :
+           M == WALK_BACKWARD ? ALL_LEG_BITS & ~RIGHT_LEG_BITS :
+           M == TURN_RIGHT ? ALL_LEG_BITS : 0;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef GAIT_TIMING_H
+#define GAIT_TIMING_H
+
+#include "Constants.h"
+
+// Move time and settle delay of each kind of gait phase, in ms at 1x
+// speed. The defaults are the hand-tuned constants; the auto-tuner replaces
+// the delays with margins measured on the robot, and the move times can be
+// loaded from the offline optimizer.
+struct GaitTiming {
+    int liftTime;
+    int swingTime;
+    int lowerTime;
+    int waveLiftTime;
+    int waveSwingTime;
+    int waveLowerTime;
+    int waveShiftTime;
+    int rotateLiftTime;
+    int rotateSwingTime;
+    int rotatePlantTime;
+
+    int liftDelay;
+    int swingDelay;
+    int lowerDelay;
+    int rotateLowerDelay;
+    int waveDelay;
+};
+
+inline GaitTiming defaultGaitTiming() {
+    GaitTiming timing;
+    timing.liftTime = LIFT_TIME;
+    timing.swingTime = MOVE_TIME;
+    timing.lowerTime = LOWER_TIME;
+    timing.waveLiftTime = FAST_LIFT_TIME;
+    timing.waveSwingTime = FAST_MOVE_TIME;
+    timing.waveLowerTime = FAST_LOWER_TIME;
+    timing.waveShiftTime = FAST_PUSH_TIME;
+    timing.rotateLiftTime = ROTATE_LIFT_TIME;
+    timing.rotateSwingTime = ROTATE_MOVE_TIME;
+    timing.rotatePlantTime = ROTATE_LOWER_TIME;
+    timing.liftDelay = SHORT_DELAY;
+    timing.swingDelay = SHORT_DELAY;
+    timing.lowerDelay = SHORT_DELAY;
+    timing.rotateLowerDelay = 100;
+    timing.waveDelay = FAST_DELAY;
+    return timing;
+}
+
+// Stride of the walking gaits in servo centidegrees. The coxa ends are the
+// front of the stride for the right legs and the back for the left ones.
+struct GaitStride {
+    int coxaForward;
+    int coxaBackward;
+    int femurLift;      // femur of a swinging leg
+    int bodyPush;       // coxa shift of each wave gait body shift
+};
+
+inline GaitStride defaultGaitStride() {
+    GaitStride stride;
+    stride.coxaForward = COXA_FORWARD;
+    stride.coxaBackward = COXA_BACKWARD;
+    stride.femurLift = FEMUR_UP;
+    stride.bodyPush = BODY_PUSH_DELTA;
+    return stride;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "GaitTuner.h"
+#include "Constants.h"
+
+
+GaitTuner::GaitTuner(ServoShadow& shadow, const bool* legContact)
+    : shadow(shadow), legContact(legContact), tickMoveCount(0), pendingCount(0), readCursor(0),
+      contactLegs(0), contactCategory(TUNE_NONE) {
+    begin();
+}
+
+void GaitTuner::begin() {
+    pendingCount = 0;
+    contactLegs = 0;
+    for (int i = 0; i < TUNE_CATEGORY_COUNT; i++) {
+        sampleCount[i] = 0;
+    }
+}
+
+TuneCategory GaitTuner::categoryOf(const StepPhase* step) {
+    if (step == NULL || step->delay == NULL) {
+        return TUNE_NONE;
+    }
+    if (step->delay == &GaitTiming::liftDelay) return TUNE_LIFT;
+    if (step->delay == &GaitTiming::swingDelay) return TUNE_SWING;
+    if (step->delay == &GaitTiming::lowerDelay) return TUNE_LOWER;
+    if (step->delay == &GaitTiming::rotateLowerDelay) return TUNE_ROTATE_LOWER;
+    return TUNE_WAVE;
+}
+
+void GaitTuner::beforeTick() {
+    tickMoveCount = shadow.getMoveCount();
+}
+
+void GaitTuner::addSample(int category, long lateMs) {
+    if (sampleCount[category] >= TUNE_MAX_SAMPLES) {
+        return;
+    }
+    samples[category][sampleCount[category]++] = (int16_t)constrain(lateMs, -1000L, 1000L);
+}
+
+// Joints still on the way when the next phase starts were at least this
+// late, and feet that never touched down count as late as the phase
+void GaitTuner::flushPending(unsigned long now) {
+    for (int i = 0; i < pendingCount; i++) {
+        addSample(pending[i].category, (long)(now - shadow.arrivalMs(pending[i].id)));
+    }
+    pendingCount = 0;
+
+    for (int leg = 0; leg < 6; leg++) {
+        if (contactLegs & (1 << leg)) {
+            addSample(contactCategory, (long)(now - contactDueMs[leg]));
+        }
+    }
+    contactLegs = 0;
+}
+
+void GaitTuner::readPending(unsigned long now) {
+    // Visit each entry pending at the start of the pass once; a removal
+    // swaps the last entry into slot i, so that slot is looked at again
+    int visits = pendingCount;
+    int i = pendingCount > 0 ? readCursor % pendingCount : 0;
+    int reads = 0;
+    for (int n = 0; n < visits && pendingCount > 0 && reads < TUNE_READS_PER_TICK; n++) {
+        if (i >= pendingCount) {
+            i = 0;
+        }
+        int id = pending[i].id;
+
+        // No point reading before the joint could possibly be there
+        unsigned long commandMs = shadow.arrivalMs(id) - (unsigned long)shadow.duration(id);
+        if (now - commandMs < (unsigned long)(shadow.duration(id) * POSTURE_ARRIVAL_PERCENT / 100)) {
+            i++;
+            continue;
+        }
+        reads++;
+
+        int32_t position = shadow.read(id);
+        int32_t error = position - shadow.target(id);
+        if (position < 0 || error > POSITION_TOLERANCE || error < -POSITION_TOLERANCE) {
+            i++;
+            continue;
+        }
+
+        addSample(pending[i].category, (long)(now - shadow.arrivalMs(id)));
+        pending[i] = pending[--pendingCount];
+    }
+    readCursor = i;
+}
+
+void GaitTuner::afterTick(TuneCategory started, unsigned long now) {
+    if (started != TUNE_NONE) {
+        flushPending(now);
+
+        for (int id = 0; id < SERVO_COUNT; id++) {
+            if (shadow.sequence(id) <= tickMoveCount) {
+                continue;
+            }
+            pending[pendingCount].id = id;
+            pending[pendingCount].category = started;
+            pendingCount++;
+
+            // Lowering femurs are also timed to touchdown
+            bool lowering = started == TUNE_LOWER || started == TUNE_ROTATE_LOWER || started == TUNE_WAVE;
+            if (lowering && id % 3 == 1 && shadow.target(id) < FEMUR_UP && !legContact[id / 3]) {
+                contactLegs |= 1 << (id / 3);
+                contactDueMs[id / 3] = shadow.arrivalMs(id);
+                contactCategory = started;
+            }
+        }
+    }
+
+    for (int leg = 0; leg < 6; leg++) {
+        if ((contactLegs & (1 << leg)) && legContact[leg]) {
+            addSample(contactCategory, (long)(now - contactDueMs[leg]));
+            contactLegs &= ~(1 << leg);
+        }
+    }
+
+    readPending(now);
+}
+
+int GaitTuner::margin(int category, int current) const {
+    int count = sampleCount[category];
+    if (count < TUNE_MIN_SAMPLES) {
+        return current;
+    }
+
+    int16_t sorted[TUNE_MAX_SAMPLES];
+    memcpy(sorted, samples[category], count * sizeof(int16_t));
+    // Insertion sort, there are at most a few dozen samples
+    for (int i = 1; i < count; i++) {
+        int16_t value = sorted[i];
+        int j = i - 1;
+        for (; j >= 0 && sorted[j] > value; j--) {
+            sorted[j + 1] = sorted[j];
+        }
+        sorted[j + 1] = value;
+    }
+
+    int late = sorted[(count * 9) / 10];
+    return constrain(late + TUNE_SAFETY_MS, 0, TUNE_MAX_MARGIN);
+}
+
+GaitTiming GaitTuner::result(const GaitTiming& current) const {
+    // Move times are not measured here, they stay as they are
+    GaitTiming tuned = current;
+    tuned.liftDelay = margin(TUNE_LIFT, current.liftDelay);
+    tuned.swingDelay = margin(TUNE_SWING, current.swingDelay);
+    tuned.lowerDelay = margin(TUNE_LOWER, current.lowerDelay);
+    tuned.rotateLowerDelay = margin(TUNE_ROTATE_LOWER, current.rotateLowerDelay);
+    tuned.waveDelay = margin(TUNE_WAVE, current.waveDelay);
+    return tuned;
+}
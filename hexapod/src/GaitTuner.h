@@ -0,0 +1,74 @@
+#ifndef GAIT_TUNER_H
+#define GAIT_TUNER_H
+
+#include <Arduino.h>
+#include "GaitTiming.h"
+#include "GaitTable.h"
+#include "ServoShadow.h"
+
+enum TuneCategory {
+    TUNE_NONE = -1,
+    TUNE_LIFT,
+    TUNE_SWING,
+    TUNE_LOWER,
+    TUNE_ROTATE_LOWER,
+    TUNE_WAVE,
+    TUNE_CATEGORY_COUNT
+};
+
+const int TUNE_MAX_SAMPLES = 96;
+
+// Measures how late joints really arrive and feet really touch down
+// compared to the commanded move times, while gait cycles run. Every
+// joint commanded when a phase starts is read back sparsely near the end
+// of its move, and lowering legs are timed to their switch closing. The
+// margins that result are the 90th percentile lateness plus a small
+// safety allowance.
+class GaitTuner {
+public:
+    GaitTuner(ServoShadow& shadow, const bool* legContact);
+
+    void begin();
+
+    // Bracket each control tick while tuning; category says what kind of
+    // phase the gait started during the tick, TUNE_NONE if it did not
+    void beforeTick();
+    void afterTick(TuneCategory started, unsigned long now);
+
+    // The tuned timing, keeping the current margin where a category got
+    // too few samples
+    GaitTiming result(const GaitTiming& current) const;
+
+    int getSampleCount(TuneCategory category) const { return sampleCount[category]; }
+
+    // Which margin a gait phase settles with, TUNE_NONE if it has none
+    static TuneCategory categoryOf(const StepPhase* step);
+
+private:
+    struct PendingJoint {
+        int8_t id;
+        int8_t category;
+    };
+
+    ServoShadow& shadow;
+    const bool* legContact;
+
+    uint32_t tickMoveCount;
+    PendingJoint pending[SERVO_COUNT];
+    int pendingCount;
+    int readCursor;
+
+    uint8_t contactLegs;
+    int8_t contactCategory;
+    unsigned long contactDueMs[6];
+
+    int16_t samples[TUNE_CATEGORY_COUNT][TUNE_MAX_SAMPLES];
+    int sampleCount[TUNE_CATEGORY_COUNT];
+
+    void addSample(int category, long lateMs);
+    void flushPending(unsigned long now);
+    void readPending(unsigned long now);
+    int margin(int category, int current) const;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "HeadingHold.h"
+#include "Constants.h"
+
+
+HeadingHold::HeadingHold()
+    : enabled(false), input(0), output(0), setpoint(0), target(0), error(0),
+      pid(&input, &output, &setpoint, HEADING_KP, HEADING_KI, HEADING_KD, DIRECT) {
+    pid.SetOutputLimits(-HEADING_MAX_TRIM, HEADING_MAX_TRIM);
+    pid.SetSampleTime(1000 / CONTROL_RATE_HZ);
+}
+
+void HeadingHold::setEnabled(bool enable) {
+    enabled = enable;
+    if (!enabled) {
+        pid.SetMode(MANUAL);
+    }
+}
+
+void HeadingHold::begin(float yaw) {
+    target = yaw;
+    error = 0;
+    input = 0;
+    output = 0;
+    // Switching back to automatic restarts the integral from zero
+    pid.SetMode(MANUAL);
+    if (enabled) {
+        pid.SetMode(AUTOMATIC);
+    }
+}
+
+void HeadingHold::update(float yaw) {
+    if (!enabled) {
+        return;
+    }
+
+    // Positive when the body has turned clockwise off the heading
+    error = target - yaw;
+    if (error > 180) error -= 360;
+    if (error < -180) error += 360;
+
+    // The drift is fed as the measurement against a zero setpoint, so the
+    // trim comes out steering back the other way
+    input = error < HEADING_DEADBAND && error > -HEADING_DEADBAND ? 0 : -error;
+    pid.Compute();
+}
+
+int32_t HeadingHold::getTrim() const {
+    return enabled ? (int32_t)output : 0;
+}
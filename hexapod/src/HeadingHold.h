@@ -0,0 +1,42 @@
+#ifndef HEADING_HOLD_H
+#define HEADING_HOLD_H
+
+#include <Arduino.h>
+#include <PID_v1.h>
+
+
+// Keeps a walk on the heading it started with. The yaw error runs through
+// a PID whose output is a stride trim in coxa centidegrees: positive
+// lengthens the right side strides, steering the body counterclockwise.
+// The integral term absorbs the robot's own left/right bias, which used
+// to be hand-tuned as per-side coxa offsets.
+class HeadingHold {
+public:
+    HeadingHold();
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled; }
+
+    // Holds the given yaw from now on and clears the accumulated trim
+    void begin(float yaw);
+
+    // Called every control tick while walking
+    void update(float yaw);
+
+    float getTarget() const { return target; }
+    float getError() const { return error; }
+
+    // Trim to apply to the next gait cycle, 0 when disabled
+    int32_t getTrim() const;
+
+private:
+    bool enabled;
+    double input;
+    double output;
+    double setpoint;
+    float target;
+    float error;
+    PID pid;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "ImuReader.h"
+#include "InputLog.h"
+
+const float GYRO_WEIGHT = 0.98f;
+const float RAD_TO_DEGREES = 57.29578f;
+
+
+ImuReader::ImuReader()
+    : connected(false), yaw(0), pitch(0), roll(0), yawRate(0),
+      gyroBiasZ(0), lastUpdateMicros(0) {}
+
+bool ImuReader::begin(TwoWire& wire, int ad0Value) {
+    icm.begin(wire, ad0Value);
+    connected = inputImuStatus(icm.status == ICM_20948_Stat_Ok);
+    lastUpdateMicros = micros();
+    return connected;
+}
+
+void ImuReader::calibrate(int samples) {
+    if (!connected) {
+        return;
+    }
+
+    float sum = 0;
+    int taken = 0;
+    for (int i = 0; i < samples; i++) {
+        if (icm.dataReady()) {
+            icm.getAGMT();
+            sum += icm.gyrZ();
+            taken++;
+        }
+        delay(2);
+    }
+    if (taken > 0) {
+        gyroBiasZ = sum / taken;
+    }
+    yaw = 0;
+    lastUpdateMicros = micros();
+}
+
+void ImuReader::restore(bool isConnected, const float* sample) {
+    connected = isConnected;
+    yaw = sample[0];
+    pitch = sample[1];
+    roll = sample[2];
+    yawRate = sample[3];
+}
+
+bool ImuReader::update() {
+    if (!connected) {
+        return false;
+    }
+    bool ready = icm.dataReady();
+    if (ready) {
+        integrate();
+    }
+
+    // A replay hands the recorded sample back in place of this one
+    float sample[4] = {yaw, pitch, roll, yawRate};
+    if (!inputImu(ready, sample)) {
+        return false;
+    }
+    yaw = sample[0];
+    pitch = sample[1];
+    roll = sample[2];
+    yawRate = sample[3];
+    return true;
+}
+
+void ImuReader::integrate() {
+    icm.getAGMT();
+
+    unsigned long now = micros();
+    float dt = (now - lastUpdateMicros) / 1000000.0f;
+    lastUpdateMicros = now;
+
+    yawRate = icm.gyrZ() - gyroBiasZ;
+    yaw += yawRate * dt;
+    if (yaw > 180) yaw -= 360;
+    if (yaw < -180) yaw += 360;
+
+    float ax = icm.accX();
+    float ay = icm.accY();
+    float az = icm.accZ();
+    float accelPitch = atan2(-ax, sqrt(ay * ay + az * az)) * RAD_TO_DEGREES;
+    float accelRoll = atan2(ay, az) * RAD_TO_DEGREES;
+
+    pitch = GYRO_WEIGHT * (pitch + icm.gyrY() * dt) + (1 - GYRO_WEIGHT) * accelPitch;
+    roll = GYRO_WEIGHT * (roll + icm.gyrX() * dt) + (1 - GYRO_WEIGHT) * accelRoll;
+}
@@ -0,0 +1,48 @@
+#ifndef IMU_READER_H
+#define IMU_READER_H
+
+#include <Arduino.h>
+#include "ICM_20948.h"
+
+
+// Body orientation from the ICM-20948. Yaw is integrated from the bias
+// corrected z gyro, pitch and roll blend the gyro with the gravity vector.
+class ImuReader {
+public:
+    ImuReader();
+
+    bool begin(TwoWire& wire, int ad0Value);
+
+    // Averages the gyro while the robot stands still to find its bias
+    void calibrate(int samples = 200);
+
+    // Reads a new sample when one is ready, returns false otherwise
+    bool update();
+
+    bool isConnected() const { return connected; }
+
+    float getYaw() const { return yaw; }
+    float getPitch() const { return pitch; }
+    float getRoll() const { return roll; }
+    float getYawRate() const { return yawRate; }
+
+    void resetYaw() { yaw = 0; }
+
+    // Orientation from a keyframe of the input log: yaw, pitch, roll, yaw rate
+    void restore(bool isConnected, const float* sample);
+
+private:
+    ICM_20948_I2C icm;
+    bool connected;
+    float yaw;
+    float pitch;
+    float roll;
+    float yawRate;
+    float gyroBiasZ;
+    unsigned long lastUpdateMicros;
+
+    // Folds a new sample into the orientation
+    void integrate();
+};
+
+#endif
@@ -0,0 +1,442 @@
+#include "InputLog.h"
+#include "ServoShadow.h"
+
+// Channel indexes, in the order keyframes hold them
+const int CLOCK_CHANNEL = 0;
+const int SWITCH_CHANNELS = 1;
+const int SERVO_CHANNELS = SWITCH_CHANNELS + LEG_COUNT;
+const int IMU_CHANNEL = SERVO_CHANNELS + SERVO_COUNT;
+const int CHANNEL_COUNT = INPUT_CHANNEL_COUNT;
+
+// Keyframe payload: clock, battery, then per channel its last value and
+// count, then the control state
+const size_t KEYFRAME_CHANNELS_AT = 5;
+const size_t KEYFRAME_STATE_AT = KEYFRAME_CHANNELS_AT + CHANNEL_COUNT * 6;
+const uint8_t UNKNOWN_BATTERY = 0xFF;
+
+const int32_t UNKNOWN_VALUE = INT32_MIN;
+const uint16_t MAX_UNCHANGED = 0xFFFF;
+
+struct ChannelState {
+    int32_t last;
+    uint16_t unchanged;
+};
+
+static uint8_t* ring = NULL;
+static size_t head = 0;         // where the next event goes
+static size_t tail = 0;         // oldest event
+static size_t used = 0;
+static bool wrapped = false;
+static bool recording = false;
+static uint32_t startMs = 0;
+static portMUX_TYPE ringLock = portMUX_INITIALIZER_UNLOCKED;
+
+static ChannelState channels[CHANNEL_COUNT];
+static unsigned long periodStartMs = 0;
+static unsigned long lastTickMs = 0;
+static int lastBattery = -1;
+static InputPlayback* playback = NULL;
+
+// The last tick event, while nothing was logged after it
+static size_t tickRunAt = 0;
+static bool tickRunOpen = false;
+static uint16_t tickRunMs = 0;
+static uint16_t tickRunCount = 0;
+
+static unsigned long lastKeyframeMs = 0;
+static bool loggedSinceKeyframe = false;
+
+
+static uint8_t* put16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+    return out + 2;
+}
+
+static uint16_t get16(const uint8_t* in) {
+    return in[0] | (in[1] << 8);
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t value) {
+    return put16(put16(out, value & 0xFFFF), value >> 16);
+}
+
+static uint32_t get32(const uint8_t* in) {
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+static uint8_t ringByte(size_t offset) {
+    return ring[(tail + offset) % INPUT_LOG_SIZE];
+}
+
+// Length of an event from its first three bytes; parameter blobs carry
+// their length in the second, commands in the third, keyframes in the
+// second and third
+static size_t lengthOf(const uint8_t* start) {
+    switch (start[0]) {
+        case INPUT_TICK:        return 5;
+        case INPUT_CLOCK:       return 5;
+        case INPUT_SWITCH:      return 5;
+        case INPUT_SERVO_READ:  return 6;
+        case INPUT_IMU:         return 3 + 4 * sizeof(float);
+        case INPUT_IMU_STATUS:  return 2;
+        case INPUT_PARAMS:      return 2 + start[1];
+        case INPUT_BATTERY:     return 2;
+        case INPUT_COMMAND:     return 3 + start[2];
+        case INPUT_SERVO_MOVE:  return 6;
+        case INPUT_KEYFRAME:    return 3 + get16(start + 1);
+        default:                return 0;
+    }
+}
+
+size_t inputEventLength(const uint8_t* data, size_t available) {
+    uint8_t start[3] = {0, 0, 0};
+    memcpy(start, data, min(available, sizeof(start)));
+    size_t length = lengthOf(start);
+    return length <= available ? length : 0;
+}
+
+// Drops the oldest events until length bytes fit; under the lock
+static void makeRoom(size_t length) {
+    while (used + length > (size_t)INPUT_LOG_SIZE) {
+        uint8_t oldest[3] = {ringByte(0), ringByte(1), ringByte(2)};
+        size_t dropped = lengthOf(oldest);
+        tail = (tail + dropped) % INPUT_LOG_SIZE;
+        used -= dropped;
+        wrapped = true;
+    }
+}
+
+static void write(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        ring[head] = data[i];
+        head = (head + 1) % INPUT_LOG_SIZE;
+    }
+    used += length;
+}
+
+// Appends one event, dropping the oldest ones to make room
+static void append(const uint8_t* event, size_t length) {
+    portENTER_CRITICAL(&ringLock);
+    if (recording) {
+        makeRoom(length);
+        write(event, length);
+        tickRunOpen = false;
+        loggedSinceKeyframe = true;
+    }
+    portEXIT_CRITICAL(&ringLock);
+}
+
+// Logs a sensor value when it differs from the last one; otherwise counts
+// the read. Returns whether an event is due.
+static bool changed(ChannelState& channel, int32_t value) {
+    if (value == channel.last && channel.unchanged < MAX_UNCHANGED) {
+        channel.unchanged++;
+        return false;
+    }
+    return true;
+}
+
+static void logged(ChannelState& channel, int32_t value) {
+    channel.last = value;
+    channel.unchanged = 0;
+}
+
+bool beginInputLog() {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        channels[i].last = UNKNOWN_VALUE;
+        channels[i].unchanged = 0;
+    }
+    periodStartMs = lastTickMs = lastKeyframeMs = startMs = millis();
+    tickRunOpen = false;
+    loggedSinceKeyframe = false;
+    if (playback != NULL) {
+        return true;
+    }
+
+    ring = (uint8_t*)malloc(INPUT_LOG_SIZE);
+    if (ring == NULL) {
+        Serial.println("ERROR: no memory for the input log, not recording");
+        return false;
+    }
+    recording = true;
+    return true;
+}
+
+void setInputPlayback(InputPlayback* source) {
+    playback = source;
+}
+
+void stopInputLog() {
+    portENTER_CRITICAL(&ringLock);
+    recording = false;
+    portEXIT_CRITICAL(&ringLock);
+}
+
+bool isInputLogRecording() {
+    return recording;
+}
+
+void inputTick(unsigned long now) {
+    uint16_t ms = min(now - lastTickMs, (unsigned long)0xFFFF);
+    portENTER_CRITICAL(&ringLock);
+    if (recording && tickRunOpen && ms == tickRunMs && tickRunCount < 0xFFFF) {
+        // Nothing happened in the last period, its run grows in place
+        tickRunCount++;
+        ring[(tickRunAt + 3) % INPUT_LOG_SIZE] = tickRunCount & 0xFF;
+        ring[(tickRunAt + 4) % INPUT_LOG_SIZE] = tickRunCount >> 8;
+    } else if (recording) {
+        uint8_t event[5] = {INPUT_TICK};
+        put16(put16(event + 1, ms), 1);
+        makeRoom(sizeof(event));
+        tickRunAt = head;
+        write(event, sizeof(event));
+        tickRunOpen = true;
+        tickRunMs = ms;
+        tickRunCount = 1;
+    }
+    portEXIT_CRITICAL(&ringLock);
+    lastTickMs = now;
+    periodStartMs = now;
+}
+
+unsigned long inputClock() {
+    ChannelState& channel = channels[CLOCK_CHANNEL];
+    if (playback != NULL) {
+        uint8_t payload[2];
+        if (playback->replay(INPUT_CLOCK, 0, payload, sizeof(payload)) == sizeof(payload)) {
+            logged(channel, get16(payload));
+        }
+        return periodStartMs + (channel.last == UNKNOWN_VALUE ? 0 : channel.last);
+    }
+
+    unsigned long now = millis();
+    int32_t offset = min(now - periodStartMs, (unsigned long)0xFFFF);
+    if (recording && changed(channel, offset)) {
+        uint8_t event[5] = {INPUT_CLOCK};
+        put16(put16(event + 1, channel.unchanged), offset);
+        append(event, sizeof(event));
+        logged(channel, offset);
+    }
+    return now;
+}
+
+int inputSwitch(int index, int level) {
+    ChannelState& channel = channels[SWITCH_CHANNELS + index];
+    if (playback != NULL) {
+        uint8_t payload[1];
+        if (playback->replay(INPUT_SWITCH, index, payload, sizeof(payload)) == sizeof(payload)) {
+            logged(channel, payload[0]);
+        }
+        return channel.last == UNKNOWN_VALUE ? level : channel.last;
+    }
+
+    if (recording && changed(channel, level)) {
+        uint8_t event[5] = {INPUT_SWITCH, (uint8_t)index};
+        put16(event + 2, channel.unchanged);
+        event[4] = level;
+        append(event, sizeof(event));
+        logged(channel, level);
+    }
+    return level;
+}
+
+int32_t inputServoRead(int id, int32_t position) {
+    ChannelState& channel = channels[SERVO_CHANNELS + id];
+    if (playback != NULL) {
+        uint8_t payload[2];
+        if (playback->replay(INPUT_SERVO_READ, id, payload, sizeof(payload)) == sizeof(payload)) {
+            logged(channel, (int16_t)get16(payload));
+        }
+        return channel.last == UNKNOWN_VALUE ? position : channel.last;
+    }
+
+    // Anything outside the servo range is a failed read either way
+    int32_t value = position < 0 || position > 0x7FFF ? -1 : position;
+    if (recording && changed(channel, value)) {
+        uint8_t event[6] = {INPUT_SERVO_READ, (uint8_t)id};
+        put16(put16(event + 2, channel.unchanged), (uint16_t)(int16_t)value);
+        append(event, sizeof(event));
+        logged(channel, value);
+    }
+    return position;
+}
+
+bool inputImu(bool updated, float* sample) {
+    ChannelState& channel = channels[IMU_CHANNEL];
+    const size_t size = 4 * sizeof(float);
+    if (playback != NULL) {
+        uint8_t payload[size];
+        if (playback->replay(INPUT_IMU, 0, payload, size) != (int)size) {
+            return false;
+        }
+        memcpy(sample, payload, size);
+        return true;
+    }
+
+    // Every new sample is logged, the count is of updates that had none
+    if (recording && (updated || channel.unchanged == MAX_UNCHANGED)) {
+        uint8_t event[3 + size] = {INPUT_IMU};
+        put16(event + 1, channel.unchanged);
+        memcpy(event + 3, sample, size);
+        append(event, sizeof(event));
+        channel.unchanged = 0;
+    } else if (recording) {
+        channel.unchanged++;
+    }
+    return updated;
+}
+
+bool inputImuStatus(bool connected) {
+    if (playback != NULL) {
+        uint8_t payload[1];
+        return playback->replay(INPUT_IMU_STATUS, 0, payload, sizeof(payload)) == sizeof(payload) ?
+               payload[0] != 0 : connected;
+    }
+
+    if (recording) {
+        uint8_t event[2] = {INPUT_IMU_STATUS, connected};
+        append(event, sizeof(event));
+    }
+    return connected;
+}
+
+size_t inputParameters(void* data, size_t size, size_t length) {
+    if (playback != NULL) {
+        int replayed = playback->replay(INPUT_PARAMS, 0, (uint8_t*)data, size);
+        return replayed >= 0 ? replayed : length;
+    }
+
+    length = min(length, min(size, (size_t)255));
+    if (recording) {
+        uint8_t event[2 + 255] = {INPUT_PARAMS, (uint8_t)length};
+        memcpy(event + 2, data, length);
+        append(event, 2 + length);
+    }
+    return length;
+}
+
+int inputBattery(int percentage) {
+    if (playback != NULL) {
+        return playback->batteryPercentage();
+    }
+
+    // Read from both cores, so the change check is made under the lock
+    // the append takes again
+    bool changed = false;
+    portENTER_CRITICAL(&ringLock);
+    if (percentage != lastBattery) {
+        lastBattery = percentage;
+        changed = true;
+    }
+    portEXIT_CRITICAL(&ringLock);
+    if (changed && recording) {
+        uint8_t event[2] = {INPUT_BATTERY, (uint8_t)constrain(percentage, 0, 255)};
+        append(event, sizeof(event));
+    }
+    return percentage;
+}
+
+void inputCommand(int clientId, const char* command) {
+    if (playback != NULL || !recording) {
+        return;
+    }
+    size_t length = min(strlen(command), (size_t)255);
+    uint8_t event[3 + 255] = {INPUT_COMMAND, (uint8_t)clientId, (uint8_t)length};
+    memcpy(event + 3, command, length);
+    append(event, 3 + length);
+}
+
+void inputServoMove(int id, int32_t position, int time) {
+    if (playback != NULL) {
+        playback->replayMove(id, position, time);
+        return;
+    }
+    if (recording) {
+        uint8_t event[6] = {INPUT_SERVO_MOVE, (uint8_t)id};
+        put16(put16(event + 2, (uint16_t)position), (uint16_t)time);
+        append(event, sizeof(event));
+    }
+}
+
+bool inputKeyframeDue(unsigned long now) {
+    return recording && loggedSinceKeyframe && now - lastKeyframeMs >= INPUT_KEYFRAME_MS;
+}
+
+void inputKeyframe(unsigned long now, const void* state, size_t length) {
+    size_t payload = KEYFRAME_STATE_AT + length;
+    if (!recording || payload > 0xFFFF) {
+        return;
+    }
+    lastKeyframeMs = now;
+
+    uint8_t start[3 + KEYFRAME_STATE_AT] = {INPUT_KEYFRAME};
+    put16(start + 1, payload);
+    uint8_t* out = put32(start + 3, now);
+    portENTER_CRITICAL(&ringLock);
+    *out++ = lastBattery < 0 ? UNKNOWN_BATTERY : lastBattery;
+    portEXIT_CRITICAL(&ringLock);
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        out = put16(put32(out, channels[i].last), channels[i].unchanged);
+    }
+
+    portENTER_CRITICAL(&ringLock);
+    if (recording) {
+        makeRoom(sizeof(start) + length);
+        write(start, sizeof(start));
+        write((const uint8_t*)state, length);
+        tickRunOpen = false;
+        loggedSinceKeyframe = false;
+    }
+    portEXIT_CRITICAL(&ringLock);
+}
+
+bool parseInputKeyframe(const uint8_t* payload, size_t length, InputKeyframe& keyframe) {
+    if (length < KEYFRAME_STATE_AT) {
+        return false;
+    }
+    keyframe.nowMs = get32(payload);
+    keyframe.battery = payload[4] == UNKNOWN_BATTERY ? -1 : payload[4];
+    const uint8_t* in = payload + KEYFRAME_CHANNELS_AT;
+    for (int i = 0; i < CHANNEL_COUNT; i++, in += 6) {
+        keyframe.last[i] = (int32_t)get32(in);
+        keyframe.unchanged[i] = get16(in + 4);
+    }
+    keyframe.state = payload + KEYFRAME_STATE_AT;
+    keyframe.stateLength = length - KEYFRAME_STATE_AT;
+    return true;
+}
+
+int inputChannelIndex(InputEventType type, int channel) {
+    switch (type) {
+        case INPUT_CLOCK:       return CLOCK_CHANNEL;
+        case INPUT_SWITCH:      return SWITCH_CHANNELS + channel;
+        case INPUT_SERVO_READ:  return SERVO_CHANNELS + channel;
+        case INPUT_IMU:         return IMU_CHANNEL;
+        default:                return -1;
+    }
+}
+
+void restoreInputChannels(const InputKeyframe& keyframe) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        channels[i].last = keyframe.last[i];
+        channels[i].unchanged = keyframe.unchanged[i];
+    }
+}
+
+size_t getInputLogSize() {
+    return sizeof(InputLogHeader) + used;
+}
+
+size_t readInputLog(size_t offset, uint8_t* data, size_t size) {
+    InputLogHeader header = {{'H', 'X', 'I', 'N'}, INPUT_LOG_VERSION, wrapped, 0, startMs, (uint32_t)used};
+    size_t copied = 0;
+
+    portENTER_CRITICAL(&ringLock);
+    for (; copied < size && offset < sizeof(header) + used; copied++, offset++) {
+        data[copied] = offset < sizeof(header) ? ((const uint8_t*)&header)[offset] :
+                       ringByte(offset - sizeof(header));
+    }
+    portEXIT_CRITICAL(&ringLock);
+    return copied;
+}
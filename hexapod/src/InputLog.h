@@ -0,0 +1,128 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <Arduino.h>
+#include "JointArena.h"
+
+// Flight recorder for everything the control code acts on: client
+// commands, the foot switches, IMU samples, battery readings, servo
+// position reads, the clock and the stored parameters. The servo moves
+// that came out are logged too, for a replay to be diffed against. Events
+// go into a byte ring from boot; once it is full the oldest are dropped.
+//
+// Inputs pass through the input* calls below. While recording they are
+// logged and handed back unchanged; with a playback attached (the host
+// replayer) the recorded value is handed back instead. A sensor is only
+// logged when its value changes, along with the number of unchanged reads
+// before it, which is enough to give every read the value it had. Control
+// periods in which nothing was logged only lengthen the run of the tick
+// before them.
+//
+// Once the ring has wrapped the boot is lost, so while the robot is at
+// rest the control task logs a keyframe every INPUT_KEYFRAME_MS: its own
+// state, and the channels' last values and counts. A replay of a wrapped
+// log starts from the oldest keyframe still in it.
+
+const int INPUT_LOG_SIZE = 65536;
+const int INPUT_LOG_CHUNK = 288;     // log bytes per INPUT_LOG reply
+const uint8_t INPUT_LOG_VERSION = 2;
+const unsigned long INPUT_KEYFRAME_MS = 10000;
+
+// Sensors logged on change, each with its own count of unchanged reads:
+// the clock, the foot switches, the servos and the IMU
+const int INPUT_CHANNEL_COUNT = 1 + LEG_COUNT + SERVO_COUNT + 1;
+
+enum InputEventType : uint8_t {
+    INPUT_TICK,         // control periods start: ms between them and how many in a row
+    INPUT_CLOCK,        // clock read by the control code: ms into the period
+    INPUT_SWITCH,       // foot switch level, channel is the switch index
+    INPUT_SERVO_READ,   // position read back, -1 for a failed read, channel is the servo
+    INPUT_IMU,          // yaw, pitch, roll and yaw rate after a new sample
+    INPUT_IMU_STATUS,   // whether the IMU came up
+    INPUT_PARAMS,       // parameter blob read from flash
+    INPUT_BATTERY,      // battery percentage, logged on change
+    INPUT_COMMAND,      // client id and command line
+    INPUT_SERVO_MOVE,   // output: servo id, position and time
+    INPUT_KEYFRAME,     // clock, battery, channels and control state, see InputKeyframe
+    INPUT_EVENT_TYPES
+};
+
+// Dump header, followed by the events oldest first
+struct InputLogHeader {
+    char magic[4];          // "HXIN"
+    uint8_t version;
+    uint8_t wrapped;        // the oldest events were dropped, so no replay from boot
+    uint16_t reserved;
+    uint32_t startMs;       // clock when recording started
+    uint32_t length;        // event bytes that follow
+};
+
+// A keyframe taken apart
+struct InputKeyframe {
+    unsigned long nowMs;
+    int battery;                // -1 when none was read yet
+    int32_t last[INPUT_CHANNEL_COUNT];
+    uint16_t unchanged[INPUT_CHANNEL_COUNT];
+    const uint8_t* state;       // the control task's, in the payload
+    size_t stateLength;
+};
+
+// Supplies the recorded values during a replay
+class InputPlayback {
+public:
+    virtual ~InputPlayback() {}
+
+    // Copies the value logged for this read of a channel into payload and
+    // returns its length, or -1 when the read was not logged because the
+    // value had not changed
+    virtual int replay(InputEventType type, int channel, uint8_t* payload, int size) = 0;
+
+    // Checks a move the replayed code made against the recorded one
+    virtual void replayMove(int id, int32_t position, int time) = 0;
+
+    virtual int batteryPercentage() = 0;
+};
+
+// Allocates the ring and starts recording; false when there is no memory
+bool beginInputLog();
+
+// Attaching a playback switches every tap from recording to replaying
+void setInputPlayback(InputPlayback* playback);
+
+// Ends recording for good, so what is pulled off is the run so far
+void stopInputLog();
+bool isInputLogRecording();
+
+// Taps. Each returns the value the control code should use.
+void inputTick(unsigned long now);
+unsigned long inputClock();
+int inputSwitch(int index, int level);
+int32_t inputServoRead(int id, int32_t position);
+bool inputImu(bool updated, float* sample);     // yaw, pitch, roll, yaw rate
+bool inputImuStatus(bool connected);
+size_t inputParameters(void* data, size_t size, size_t length);
+int inputBattery(int percentage);
+void inputCommand(int clientId, const char* command);
+void inputServoMove(int id, int32_t position, int time);
+
+// True when a keyframe is due: recording, INPUT_KEYFRAME_MS after the last
+// one and with anything but ticks logged since
+bool inputKeyframeDue(unsigned long now);
+void inputKeyframe(unsigned long now, const void* state, size_t length);
+
+// Replay side: reads a keyframe's payload, false if it is malformed
+bool parseInputKeyframe(const uint8_t* payload, size_t length, InputKeyframe& keyframe);
+// Index of a sensor's channel in a keyframe, -1 for events without one
+int inputChannelIndex(InputEventType type, int channel);
+// Starts the taps off with the channel values a keyframe holds
+void restoreInputChannels(const InputKeyframe& keyframe);
+
+// Copies up to size bytes of the dump (header, then events) starting at
+// offset; returns the bytes copied, 0 past the end
+size_t readInputLog(size_t offset, uint8_t* data, size_t size);
+size_t getInputLogSize();
+
+// Length of the event starting at data, or 0 if it is malformed or cut off
+size_t inputEventLength(const uint8_t* data, size_t available);
+
+#endif
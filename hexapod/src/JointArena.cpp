@@ -0,0 +1,27 @@
+#include "JointArena.h"
+
+#include <new>
+
+
+JointArena::JointArena() {
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        target[i] = 0;
+        unposed[i] = 0;
+        start[i] = 0;
+        commandMs[i] = 0;
+        durationMs[i] = 0;
+        sequence[i] = 0;
+        known[i] = false;
+        measured[i] = -1;
+        measuredMs[i] = 0;
+    }
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        contact[leg] = false;
+    }
+}
+
+void JointArena::begin(LX16ABus* bus) {
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        new (servoStorage[i]) LX16AServo(bus, i + 1);
+    }
+}
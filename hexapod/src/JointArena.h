@@ -0,0 +1,46 @@
+#ifndef JOINT_ARENA_H
+#define JOINT_ARENA_H
+
+#include <Arduino.h>
+#include <lx16a-servo.h>
+
+const int LEG_COUNT = 6;
+const int JOINTS_PER_LEG = 3;
+const int SERVO_COUNT = LEG_COUNT * JOINTS_PER_LEG;
+
+// Everything kept per joint and per leg, in one statically allocated block
+// laid out field by field so the per-tick loops walk contiguous arrays.
+// Joints are indexed leg * JOINTS_PER_LEG + joint (coxa, femur, tibia),
+// one less than the bus id. The shadow fields are ServoShadow's, which
+// keeps them consistent; the rest of the firmware reads them through it.
+struct JointArena {
+    JointArena();
+
+    // Builds the servo objects in place; they stay for the life of the arena
+    void begin(LX16ABus* bus);
+
+    LX16AServo& servo(int id) {
+        return *reinterpret_cast<LX16AServo*>(servoStorage[id]);
+    }
+
+    // Shadow of the last move of each joint
+    int32_t target[SERVO_COUNT];
+    int32_t unposed[SERVO_COUNT];
+    int32_t start[SERVO_COUNT];
+    unsigned long commandMs[SERVO_COUNT];
+    int durationMs[SERVO_COUNT];
+    uint32_t sequence[SERVO_COUNT];
+    bool known[SERVO_COUNT];
+
+    // Last position read back, -1 until a read succeeded
+    int32_t measured[SERVO_COUNT];
+    unsigned long measuredMs[SERVO_COUNT];
+
+    // Foot switch of each leg, refreshed every control tick
+    bool contact[LEG_COUNT];
+
+private:
+    alignas(LX16AServo) uint8_t servoStorage[SERVO_COUNT][sizeof(LX16AServo)];
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "LatencyStats.h"
+
+static const uint32_t BUCKET_LIMITS[LATENCY_BUCKET_COUNT] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, UINT32_MAX
+};
+
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+uint32_t LatencyHistogram::bucketLimit(int bucket) {
+    return BUCKET_LIMITS[bucket];
+}
+
+void LatencyHistogram::record(int64_t micros) {
+    // Clock sync is only as good as the last exchange, a stage can come
+    // out slightly negative
+    uint32_t value = micros < 0 ? 0 : micros > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)micros;
+
+    int bucket = 0;
+    while (value > BUCKET_LIMITS[bucket]) {
+        bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    if (value > maxMicros) {
+        maxMicros = value;
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        buckets[i] = 0;
+    }
+    count = 0;
+    maxMicros = 0;
+}
+
+uint32_t LatencyHistogram::percentileMicros(int percent) const {
+    uint32_t total = count;
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t wanted = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKET_COUNT - 1; i++) {
+        seen += buckets[i];
+        // A bucket's limit can lie above anything recorded in it
+        if (seen >= wanted) {
+            return min(BUCKET_LIMITS[i], maxMicros);
+        }
+    }
+    return maxMicros;
+}
+
+int LatencyHistogram::format(char* buffer, size_t size) const {
+    int length = snprintf(buffer, size, "%lu,%lu,", (unsigned long)count, (unsigned long)maxMicros);
+    for (int i = 0; i < LATENCY_BUCKET_COUNT && length < (int)size; i++) {
+        length += snprintf(buffer + length, size - length, i == 0 ? "%lu" : "/%lu", (unsigned long)buckets[i]);
+    }
+    return length;
+}
@@ -0,0 +1,36 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <Arduino.h>
+
+const int LATENCY_BUCKET_COUNT = 11;
+
+// Histogram of one latency stage over fixed buckets from 0.5 ms to 0.5 s,
+// the last bucket taking everything slower. Each histogram has a single
+// writer task; readers may see a count that is one sample behind.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t micros);
+    void reset();
+
+    uint32_t getCount() const { return count; }
+    uint32_t getMaxMicros() const { return maxMicros; }
+
+    // Upper bound of the bucket holding the given percentile, 0 when empty
+    uint32_t percentileMicros(int percent) const;
+
+    // "count,max,b0/b1/.../b10" with max in microseconds
+    int format(char* buffer, size_t size) const;
+
+    // Bucket upper bounds in microseconds, the last one is open ended
+    static uint32_t bucketLimit(int bucket);
+
+private:
+    volatile uint32_t buckets[LATENCY_BUCKET_COUNT];
+    volatile uint32_t count;
+    volatile uint32_t maxMicros;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "LegFaultMonitor.h"
+#include "Constants.h"
+#include "Logger.h"
+
+static const char* const FAULT_NAMES[] = {"ok", "no_reply", "tracking", "contact", "stalled"};
+
+
+LegFaultMonitor::LegFaultMonitor(ServoShadow& shadow, const bool* legContact, const TerrainMap& terrain)
+    : shadow(shadow), legContact(legContact), terrain(terrain) {
+    reset();
+}
+
+void LegFaultMonitor::reset() {
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        state.faults[leg] = LEG_OK;
+        state.faultServo[leg] = -1;
+        state.contactMisses[leg] = 0;
+    }
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        state.readFailures[id] = 0;
+        state.trackingErrors[id] = 0;
+    }
+    state.faultyLegs = 0;
+    state.lostLeg = -1;
+    contactSeen = 0;
+    cycleWatched = false;
+    state.readCursor = 0;
+    state.ticksToCheck = FAULT_CHECK_TICKS;
+}
+
+void LegFaultMonitor::update(unsigned long now) {
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        if (legContact[leg]) {
+            contactSeen |= 1 << leg;
+        }
+    }
+
+    if (--state.ticksToCheck > 0) {
+        return;
+    }
+    state.ticksToCheck = FAULT_CHECK_TICKS;
+
+    // The next joint of a working leg that has had time to arrive; joints
+    // still on their way are passed over until the next round
+    for (int tried = 0; tried < SERVO_COUNT; tried++) {
+        int id = state.readCursor;
+        state.readCursor = (state.readCursor + 1) % SERVO_COUNT;
+        if ((state.faultyLegs & (1 << (id / JOINTS_PER_LEG))) || !shadow.isKnown(id) ||
+            (long)(now - shadow.arrivalMs(id)) < FAULT_SETTLE_MS) {
+            continue;
+        }
+        checkJoint(id);
+        return;
+    }
+}
+
+void LegFaultMonitor::checkJoint(int id) {
+    int32_t position = shadow.read(id);
+    if (position < 0) {
+        if (++state.readFailures[id] >= FAULT_READ_LIMIT) {
+            markFaulty(id / JOINTS_PER_LEG, FAULT_NO_REPLY, id);
+        }
+        return;
+    }
+    state.readFailures[id] = 0;
+
+    int32_t error = position - shadow.target(id);
+    if (error > FAULT_TRACKING_TOLERANCE || error < -FAULT_TRACKING_TOLERANCE) {
+        if (++state.trackingErrors[id] >= FAULT_TRACKING_LIMIT) {
+            markFaulty(id / JOINTS_PER_LEG, FAULT_TRACKING, id);
+        }
+        return;
+    }
+    state.trackingErrors[id] = 0;
+}
+
+void LegFaultMonitor::beginCycle() {
+    contactSeen = 0;
+    cycleWatched = true;
+}
+
+void LegFaultMonitor::endCycle() {
+    if (!cycleWatched) {
+        return;
+    }
+    cycleWatched = false;
+
+    // Only a leg missing among feet that found the ground is judged; with
+    // more missing the switches or the floor are to blame, not the legs.
+    // Switches the terrain map gave up on take no part.
+    int working = 0;
+    int touched = 0;
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        if (!(state.faultyLegs & (1 << leg)) && terrain.isSwitchTrusted(leg * JOINTS_PER_LEG)) {
+            working++;
+            touched += (contactSeen >> leg) & 1;
+        }
+    }
+    if (touched < working - 1) {
+        return;
+    }
+
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        if (state.faultyLegs & (1 << leg)) {
+            continue;
+        }
+        if ((contactSeen & (1 << leg)) || !terrain.isSwitchTrusted(leg * JOINTS_PER_LEG)) {
+            state.contactMisses[leg] = 0;
+        } else if (++state.contactMisses[leg] >= FAULT_CONTACT_CYCLES && jointsFailing(leg)) {
+            markFaulty(leg, FAULT_CONTACT, -1);
+        }
+    }
+}
+
+// Whether a joint of the leg has failed a read back since it last passed
+bool LegFaultMonitor::jointsFailing(int leg) const {
+    for (int id = leg * JOINTS_PER_LEG; id < (leg + 1) * JOINTS_PER_LEG; id++) {
+        if (state.readFailures[id] > 0 || state.trackingErrors[id] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LegFaultMonitor::reportStalled(uint8_t legs) {
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        if ((legs & (1 << leg)) && !(state.faultyLegs & (1 << leg))) {
+            markFaulty(leg, FAULT_STALLED, -1);
+        }
+    }
+}
+
+void LegFaultMonitor::markFaulty(int leg, LegFault fault, int servo) {
+    state.faults[leg] = fault;
+    state.faultServo[leg] = servo;
+    state.faultyLegs |= 1 << leg;
+    if (state.lostLeg < 0) {
+        state.lostLeg = leg;
+    }
+    if (servo >= 0) {
+        logPrintf("Leg %d fault: %s, servo %d", leg * JOINTS_PER_LEG, FAULT_NAMES[fault], servo + 1);
+    } else {
+        logPrintf("Leg %d fault: %s", leg * JOINTS_PER_LEG, FAULT_NAMES[fault]);
+    }
+}
+
+int LegFaultMonitor::getFaultyLegCount() const {
+    int count = 0;
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        if (state.faultyLegs & (1 << leg)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+const char* LegFaultMonitor::faultName(LegFault fault) {
+    return FAULT_NAMES[fault];
+}
+
+int LegFaultMonitor::format(char* buffer, size_t size) const {
+    int length = snprintf(buffer, size, "lost=%d,legs=%u,faults=", state.lostLeg, state.faultyLegs);
+    bool first = true;
+    for (int leg = 0; leg < LEG_COUNT && length < (int)size; leg++) {
+        if (!(state.faultyLegs & (1 << leg))) {
+            continue;
+        }
+        int servo = state.faultServo[leg];
+        length += snprintf(buffer + length, size - length, "%s%d:%s:%d", first ? "" : ";", leg,
+                           FAULT_NAMES[state.faults[leg]], servo < 0 ? -1 : servo + 1);
+        first = false;
+    }
+    return length;
+}
@@ -0,0 +1,86 @@
+#ifndef LEG_FAULT_MONITOR_H
+#define LEG_FAULT_MONITOR_H
+
+#include <Arduino.h>
+#include "ServoShadow.h"
+#include "TerrainMap.h"
+
+enum LegFault : uint8_t {
+    LEG_OK,
+    FAULT_NO_REPLY,     // a servo stopped answering position reads
+    FAULT_TRACKING,     // a servo sits off the target it settled on
+    FAULT_CONTACT,      // the foot found no ground for whole cycles
+    FAULT_STALLED       // a posture sequence gave up on the leg
+};
+
+// What the monitor has found and counted so far, fixed width so a
+// keyframe holds it the same on the robot and the host
+struct LegFaultState {
+    LegFault faults[LEG_COUNT];
+    int8_t faultServo[LEG_COUNT];
+    uint8_t faultyLegs;
+    int8_t lostLeg;
+    uint8_t readFailures[SERVO_COUNT];
+    uint8_t trackingErrors[SERVO_COUNT];
+    uint8_t contactMisses[LEG_COUNT];
+    int32_t readCursor;
+    int32_t ticksToCheck;
+};
+
+// Watches the legs for faults that would make a gait stall or tip over.
+// One settled joint is read back every FAULT_CHECK_TICKS control ticks
+// and compared with what it was told; contact is judged per walking
+// cycle. Missed contact alone proves nothing, a broken switch looks the
+// same, so it only fails a leg whose switch the terrain map still trusts
+// and whose joints have also read back wrong. A faulty leg stays faulty
+// until reset. Runs on the control task.
+class LegFaultMonitor {
+public:
+    LegFaultMonitor(ServoShadow& shadow, const bool* legContact, const TerrainMap& terrain);
+
+    void reset();
+
+    // Every control tick, after the sensors were read
+    void update(unsigned long now);
+
+    // Around a walking cycle; a leg whose switch never closed in between
+    // while the others' did counts a missed cycle
+    void beginCycle();
+    void endCycle();
+
+    // Legs a posture sequence flagged as stalled, bit per leg
+    void reportStalled(uint8_t legs);
+
+    // Bit per leg (leg base / 3)
+    uint8_t getFaultyLegs() const { return state.faultyLegs; }
+    int getFaultyLegCount() const;
+    LegFault getFault(int leg) const { return state.faults[leg]; }
+
+    // The first leg that failed, -1 while all are fine
+    int getLostLeg() const { return state.lostLeg; }
+
+    // For keyframes of the input log
+    const LegFaultState& getState() const { return state; }
+    void restore(const LegFaultState& saved) { state = saved; }
+
+    // "lost=<leg>,legs=<bits>,faults=<leg>:<reason>:<bus id>;..." with
+    // bus id -1 for faults of the whole leg
+    int format(char* buffer, size_t size) const;
+
+    static const char* faultName(LegFault fault);
+
+private:
+    ServoShadow& shadow;
+    const bool* legContact;
+    const TerrainMap& terrain;
+
+    LegFaultState state;
+    uint8_t contactSeen;
+    bool cycleWatched;
+
+    void checkJoint(int id);
+    bool jointsFailing(int leg) const;
+    void markFaulty(int leg, LegFault fault, int servo);
+};
+
+#endif
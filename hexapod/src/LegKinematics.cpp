@@ -0,0 +1,143 @@
+#include "LegKinematics.h"
+#include "Constants.h"
+#include "ServoShadow.h"
+
+
+// Positive coxa angles swing the foot forward. The right side servos turn
+// the other way, which is why the gaits use COXA_FORWARD there.
+static float coxaDirection(int base) {
+    return base < 9 ? -1.0f : 1.0f;
+}
+
+FootPosition legForward(int base, int32_t coxa, int32_t femur, int32_t tibia) {
+    float coxaAngle = radians((coxa - COXA_DEFAULT) / 100.0f * coxaDirection(base));
+    float femurAngle = radians(FEMUR_STANCE_ANGLE + (femur - FEMUR_DOWN) / 100.0f);
+    float kneeAngle = radians(TIBIA_STANCE_ANGLE + (tibia - TIBIA_DOWN) / 100.0f);
+    float tibiaAngle = femurAngle - kneeAngle;
+
+    float reach = COXA_LENGTH + FEMUR_LENGTH * cos(femurAngle) + TIBIA_LENGTH * cos(tibiaAngle);
+
+    FootPosition foot;
+    foot.outward = reach * cos(coxaAngle);
+    foot.forward = reach * sin(coxaAngle);
+    foot.up = FEMUR_LENGTH * sin(femurAngle) + TIBIA_LENGTH * sin(tibiaAngle);
+    return foot;
+}
+
+bool legInverse(int base, const FootPosition& foot, JointTargets& targets) {
+    float coxaAngle = atan2(foot.forward, foot.outward);
+    float reach = sqrt(foot.outward * foot.outward + foot.forward * foot.forward) - COXA_LENGTH;
+    float distance = sqrt(reach * reach + foot.up * foot.up);
+
+    if (distance > FEMUR_LENGTH + TIBIA_LENGTH || distance < fabs(FEMUR_LENGTH - TIBIA_LENGTH)) {
+        return false;
+    }
+
+    // Knee above the foot: the femur is raised from the hip to foot line
+    float lift = acos((FEMUR_LENGTH * FEMUR_LENGTH + distance * distance - TIBIA_LENGTH * TIBIA_LENGTH) /
+                      (2 * FEMUR_LENGTH * distance));
+    float femurAngle = atan2(foot.up, reach) + lift;
+    float tibiaAngle = atan2(foot.up - FEMUR_LENGTH * sin(femurAngle),
+                             reach - FEMUR_LENGTH * cos(femurAngle));
+    float kneeAngle = femurAngle - tibiaAngle;
+
+    int32_t coxa = COXA_DEFAULT + (int32_t)lround(degrees(coxaAngle) * 100 * coxaDirection(base));
+    int32_t femur = FEMUR_DOWN + (int32_t)lround((degrees(femurAngle) - FEMUR_STANCE_ANGLE) * 100);
+    int32_t tibia = TIBIA_DOWN + (int32_t)lround((degrees(kneeAngle) - TIBIA_STANCE_ANGLE) * 100);
+
+    if (coxa < 0 || coxa > SERVO_POSITION_MAX || femur < 0 || femur > SERVO_POSITION_MAX ||
+        tibia < 0 || tibia > SERVO_POSITION_MAX) {
+        return false;
+    }
+
+    targets.coxa = coxa;
+    targets.femur = femur;
+    targets.tibia = tibia;
+    return true;
+}
+
+FootPosition legStanceFoot() {
+    return legForward(9, COXA_DEFAULT, FEMUR_DOWN, TIBIA_DOWN);
+}
+
+float legStroke(int32_t fromCoxa, int32_t toCoxa) {
+    FootPosition from = legForward(0, fromCoxa, FEMUR_DOWN, TIBIA_DOWN);
+    FootPosition to = legForward(0, toCoxa, FEMUR_DOWN, TIBIA_DOWN);
+    return fabs(to.forward - from.forward);
+}
+
+// Leg frame axes in the body frame. Forward is outward turned towards the
+// front of the body, which is the other way round on each side.
+static void legAxes(int base, float& outwardX, float& outwardY, float& forwardX, float& forwardY) {
+    float mountAngle = radians(LEG_MOUNT_ANGLE[base / 3]);
+    outwardX = cos(mountAngle);
+    outwardY = sin(mountAngle);
+    forwardX = coxaDirection(base) * outwardY;
+    forwardY = -coxaDirection(base) * outwardX;
+}
+
+BodyPoint legToBody(int base, const FootPosition& foot) {
+    int leg = base / 3;
+    float outwardX, outwardY, forwardX, forwardY;
+    legAxes(base, outwardX, outwardY, forwardX, forwardY);
+
+    BodyPoint point;
+    point.x = LEG_MOUNT_X[leg] + foot.outward * outwardX + foot.forward * forwardX;
+    point.y = LEG_MOUNT_Y[leg] + foot.outward * outwardY + foot.forward * forwardY;
+    point.z = foot.up;
+    return point;
+}
+
+FootPosition poseFoot(int base, const FootPosition& foot, const BodyPose& pose, bool inverse) {
+    int leg = base / 3;
+    float outwardX, outwardY, forwardX, forwardY;
+    legAxes(base, outwardX, outwardY, forwardX, forwardY);
+
+    BodyPoint point = legToBody(base, foot);
+    float x = point.x;
+    float y = point.y;
+    float z = point.z;
+
+    float cr = cos(radians(pose.roll)), sr = sin(radians(pose.roll));
+    float cp = cos(radians(pose.pitch)), sp = sin(radians(pose.pitch));
+    float cy = cos(radians(pose.yaw)), sy = sin(radians(pose.yaw));
+    float t;
+
+    if (!inverse) {
+        // The ground seen from the moved body: undo the translation, then
+        // yaw, pitch and roll
+        x -= pose.x;
+        y -= pose.y;
+        z -= pose.z;
+        t = cy * x + sy * y;
+        y = -sy * x + cy * y;
+        x = t;
+        t = cp * x + sp * z;
+        z = -sp * x + cp * z;
+        x = t;
+        t = cr * y + sr * z;
+        z = -sr * y + cr * z;
+        y = t;
+    } else {
+        t = cr * y - sr * z;
+        z = sr * y + cr * z;
+        y = t;
+        t = cp * x - sp * z;
+        z = sp * x + cp * z;
+        x = t;
+        t = cy * x - sy * y;
+        y = sy * x + cy * y;
+        x = t;
+        x += pose.x;
+        y += pose.y;
+        z += pose.z;
+    }
+
+    float dx = x - LEG_MOUNT_X[leg];
+    float dy = y - LEG_MOUNT_Y[leg];
+    FootPosition moved;
+    moved.outward = dx * outwardX + dy * outwardY;
+    moved.forward = dx * forwardX + dy * forwardY;
+    moved.up = z;
+    return moved;
+}
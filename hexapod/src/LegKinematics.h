@@ -0,0 +1,65 @@
+#ifndef LEG_KINEMATICS_H
+#define LEG_KINEMATICS_H
+
+#include <Arduino.h>
+
+// Foot position relative to a leg's coxa joint in mm: outward along the
+// neutral coxa direction, forward along the body and up
+struct FootPosition {
+    float outward;
+    float forward;
+    float up;
+};
+
+struct JointTargets {
+    int32_t coxa;
+    int32_t femur;
+    int32_t tibia;
+};
+
+// Point in the body frame in mm: x forward, y left, z up
+struct BodyPoint {
+    float x;
+    float y;
+    float z;
+};
+
+// Body offset from the standing pose: mm along the body (x forward, y
+// left, z up) and degrees. Positive roll lifts the left side, positive
+// pitch the nose and positive yaw turns counterclockwise.
+struct BodyPose {
+    float x;
+    float y;
+    float z;
+    float roll;
+    float pitch;
+    float yaw;
+};
+
+// Joint angles are anchored to the standing pose: FEMUR_DOWN puts the
+// femur at FEMUR_STANCE_ANGLE above level and TIBIA_DOWN bends the knee
+// by TIBIA_STANCE_ANGLE. The standing servo values therefore round trip
+// exactly even when the link lengths are only approximate.
+
+// Where the foot is for the given servo positions
+FootPosition legForward(int base, int32_t coxa, int32_t femur, int32_t tibia);
+
+// Servo positions that put the foot at the given position. Returns false
+// when the position is out of reach, leaving targets untouched.
+bool legInverse(int base, const FootPosition& foot, JointTargets& targets);
+
+// Foot position of the standing pose
+FootPosition legStanceFoot();
+
+// How far a standing foot moves along the body as its coxa turns from one
+// position to the other, in mm
+float legStroke(int32_t fromCoxa, int32_t toCoxa);
+
+// Foot position in the body frame, for a level body
+BodyPoint legToBody(int base, const FootPosition& foot);
+
+// Where a foot ends up in its leg frame when the body moves to the pose
+// while the foot stays put on the ground; inverse takes the pose out again
+FootPosition poseFoot(int base, const FootPosition& foot, const BodyPose& pose, bool inverse);
+
+#endif
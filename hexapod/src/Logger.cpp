@@ -0,0 +1,56 @@
+#include "Logger.h"
+
+#include <stdarg.h>
+
+struct LogMessage {
+    char text[LOG_MESSAGE_SIZE];
+};
+
+static QueueHandle_t logQueue = NULL;
+static TaskHandle_t logTaskHandle = NULL;
+static volatile unsigned long droppedLogCount = 0;
+
+
+static void logTask(void* parameter) {
+    LogMessage message;
+    for (;;) {
+        if (xQueueReceive(logQueue, &message, portMAX_DELAY) == pdTRUE) {
+            Serial.println(message.text);
+        }
+    }
+}
+
+void logPrintf(const char* format, ...) {
+    LogMessage message;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message.text, sizeof(message.text), format, args);
+    va_end(args);
+
+    if (logQueue == NULL) {
+        Serial.println(message.text);
+        return;
+    }
+    if (xQueueSend(logQueue, &message, 0) != pdTRUE) {
+        droppedLogCount++;
+    }
+}
+
+void startLogTask(int core, int priority) {
+    logQueue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(LogMessage));
+    if (logQueue != NULL && xTaskCreatePinnedToCore(logTask, "LogTask", LOG_TASK_STACK, NULL, priority,
+                                                   &logTaskHandle, core) != pdPASS) {
+        // Without the task messages keep going straight to Serial
+        vQueueDelete(logQueue);
+        logQueue = NULL;
+        logTaskHandle = NULL;
+    }
+}
+
+unsigned long getDroppedLogCount() {
+    return droppedLogCount;
+}
+
+TaskHandle_t getLogTask() {
+    return logTaskHandle;
+}
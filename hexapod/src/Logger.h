@@ -0,0 +1,22 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+
+const int LOG_MESSAGE_SIZE = 96;
+const int LOG_QUEUE_LENGTH = 32;
+const int LOG_TASK_STACK = 3072;
+
+// Formats a message and queues it for the log task. Never blocks: when
+// the queue is full the message is dropped and counted. Before the task
+// is started messages go straight to Serial.
+void logPrintf(const char* format, ...);
+
+void startLogTask(int core, int priority);
+
+unsigned long getDroppedLogCount();
+
+// NULL until the task is started
+TaskHandle_t getLogTask();
+
+#endif
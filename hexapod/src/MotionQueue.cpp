@@ -0,0 +1,28 @@
+#include "MotionQueue.h"
+
+
+MotionQueue::MotionQueue() : queue(NULL), abortRequested(false) {}
+
+void MotionQueue::begin() {
+    queue = xQueueCreate(MOTION_QUEUE_LENGTH, sizeof(MotionRequest));
+}
+
+bool MotionQueue::push(const MotionRequest& request) {
+    return queue != NULL && xQueueSend(queue, &request, 0) == pdTRUE;
+}
+
+bool MotionQueue::pop(MotionRequest& request) {
+    return queue != NULL && xQueueReceive(queue, &request, 0) == pdTRUE;
+}
+
+bool MotionQueue::takeAbort() {
+    if (!abortRequested) {
+        return false;
+    }
+    abortRequested = false;
+    return true;
+}
+
+int MotionQueue::pending() const {
+    return queue != NULL ? uxQueueMessagesWaiting(queue) : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef MOTION_QUEUE_H
+#define MOTION_QUEUE_H
+
+#include <Arduino.h>
+#include "Enums.h"
+
+const int MOTION_QUEUE_LENGTH = 8;
+
+// One scripted move: walk a distance, turn by an angle or run a posture
+struct MotionRequest {
+    uint32_t id;
+    int clientId;
+    RobotMode mode;
+    float amount;   // mm to walk or degrees to turn
+    float speed;    // gait speed scale, 0 keeps the current one
+};
+
+// Bounded hand-over of scripted moves from the network task to the
+// control task. Requests are only ever consumed by the control task,
+// which also drains the queue when an abort was asked for, so every
+// request gets exactly one final event.
+class MotionQueue {
+public:
+    MotionQueue();
+
+    void begin();
+
+    // Network task. push() never blocks and fails when the queue is full.
+    bool push(const MotionRequest& request);
+    void requestAbort() { abortRequested = true; }
+
+    // Control task
+    bool pop(MotionRequest& request);
+    bool takeAbort();
+
+    int pending() const;
+
+private:
+    QueueHandle_t queue;
+    volatile bool abortRequested;
+};
+
+#endif
@@ -0,0 +1,655 @@
+#include "NetworkServer.h"
+#include "WebSocket.h"
+
+
+NetworkServer::NetworkServer(uint16_t port, uint16_t webSocketPort)
+    : port(port), webSocketPort(webSocketPort), listenFd(-1), webSocketFd(-1), wakeFd(-1),
+      outbox(NULL), commandCallback(NULL), telemetryCount(0), lastPingMs(0) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        sessions[i].fd = -1;
+        sessions[i].length = 0;
+        sessions[i].txLength = 0;
+    }
+}
+
+int NetworkServer::openListener(uint16_t listenPort) {
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        Serial.println("ERROR: could not create server socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(listenPort);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(fd, MAX_CLIENTS) < 0) {
+        Serial.printf("ERROR: could not bind port %d\n", listenPort);
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// A loopback UDP socket in the select() set: posting to the outbox sends
+// it a byte, so queued lines go out at once instead of after the timeout
+int NetworkServer::openWakeSocket() {
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&wakeAddress, 0, sizeof(wakeAddress));
+    wakeAddress.sin_family = AF_INET;
+    wakeAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wakeAddress.sin_port = 0;
+
+    socklen_t length = sizeof(wakeAddress);
+    if (bind(fd, (struct sockaddr*)&wakeAddress, sizeof(wakeAddress)) < 0 ||
+        getsockname(fd, (struct sockaddr*)&wakeAddress, &length) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+bool NetworkServer::begin() {
+    listenFd = openListener(port);
+    webSocketFd = openListener(webSocketPort);
+    outbox = xQueueCreate(OUTBOX_LENGTH, sizeof(OutboxLine));
+    wakeFd = openWakeSocket();
+    if (wakeFd < 0) {
+        Serial.println("ERROR: could not open wake socket, posted lines wait for the next poll");
+    }
+
+    Serial.printf("Listening on port %d, WebSocket on port %d (%d client slots)\n",
+                  port, webSocketPort, MAX_CLIENTS);
+    return listenFd >= 0 && webSocketFd >= 0;
+}
+
+void NetworkServer::onCommand(CommandCallback callback) {
+    commandCallback = callback;
+}
+
+bool NetworkServer::onTelemetry(TelemetryCallback callback, int intervalMs) {
+    if (telemetryCount >= TELEMETRY_STREAMS) {
+        return false;
+    }
+    TelemetryStream& stream = telemetry[telemetryCount++];
+    stream.callback = callback;
+    stream.intervalMs = intervalMs;
+    stream.lastMs = 0;
+    return true;
+}
+
+void NetworkServer::poll(int timeoutMs) {
+    if (listenFd < 0 && webSocketFd < 0) {
+        vTaskDelay(timeoutMs / portTICK_PERIOD_MS);
+        return;
+    }
+
+    fd_set readSet;
+    fd_set writeSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    int maxFd = -1;
+
+    if (listenFd >= 0) {
+        FD_SET(listenFd, &readSet);
+        maxFd = listenFd;
+    }
+    if (webSocketFd >= 0) {
+        FD_SET(webSocketFd, &readSet);
+        if (webSocketFd > maxFd) maxFd = webSocketFd;
+    }
+    if (wakeFd >= 0) {
+        FD_SET(wakeFd, &readSet);
+        if (wakeFd > maxFd) maxFd = wakeFd;
+    }
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (sessions[i].fd >= 0) {
+            FD_SET(sessions[i].fd, &readSet);
+            if (sessions[i].txLength > 0) {
+                FD_SET(sessions[i].fd, &writeSet);
+            }
+            if (sessions[i].fd > maxFd) maxFd = sessions[i].fd;
+        }
+    }
+
+    // Wake up in time for the next telemetry frame while anyone listens
+    if (webSocketCount() > 0) {
+        for (int s = 0; s < telemetryCount; s++) {
+            long untilTelemetry = (long)telemetry[s].intervalMs - (long)(millis() - telemetry[s].lastMs);
+            if (untilTelemetry < 0) untilTelemetry = 0;
+            if (untilTelemetry < timeoutMs) timeoutMs = untilTelemetry;
+        }
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+    int ready = select(maxFd + 1, &readSet, &writeSet, NULL, &timeout);
+
+    if (ready > 0) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (sessions[i].fd >= 0 && FD_ISSET(sessions[i].fd, &writeSet)) {
+                flushClient(i);
+            }
+        }
+
+        // Service existing sessions before accepting, so a slot freed in
+        // this round can not be mistaken for a readable socket
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (sessions[i].fd >= 0 && FD_ISSET(sessions[i].fd, &readSet)) {
+                readClient(i);
+            }
+        }
+
+        if (listenFd >= 0 && FD_ISSET(listenFd, &readSet)) {
+            acceptClients(listenFd, SESSION_LINE);
+        }
+        if (webSocketFd >= 0 && FD_ISSET(webSocketFd, &readSet)) {
+            acceptClients(webSocketFd, SESSION_HANDSHAKE);
+        }
+        if (wakeFd >= 0 && FD_ISSET(wakeFd, &readSet)) {
+            uint8_t drain[16];
+            while (recv(wakeFd, drain, sizeof(drain), MSG_DONTWAIT) > 0) {}
+        }
+    }
+
+    flushOutbox();
+    serviceWebSockets();
+}
+
+bool NetworkServer::post(int clientId, const char* line) {
+    if (outbox == NULL) {
+        return false;
+    }
+    OutboxLine message;
+    message.clientId = clientId;
+    strncpy(message.text, line, sizeof(message.text) - 1);
+    message.text[sizeof(message.text) - 1] = '\0';
+    if (xQueueSend(outbox, &message, 0) != pdTRUE) {
+        return false;
+    }
+    if (wakeFd >= 0) {
+        uint8_t wake = 1;
+        sendto(wakeFd, &wake, 1, MSG_DONTWAIT, (struct sockaddr*)&wakeAddress, sizeof(wakeAddress));
+    }
+    return true;
+}
+
+void NetworkServer::flushOutbox() {
+    if (outbox == NULL) {
+        return;
+    }
+    OutboxLine message;
+    while (xQueueReceive(outbox, &message, 0) == pdTRUE) {
+        if (message.clientId < 0) {
+            broadcastLine(message.text);
+        } else {
+            sendLine(message.clientId, message.text);
+        }
+    }
+}
+
+void NetworkServer::acceptClients(int fd, SessionType type) {
+    for (;;) {
+        int clientFd = accept(fd, NULL, NULL);
+        if (clientFd < 0) {
+            return;
+        }
+
+        int slot = -1;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (sessions[i].fd < 0) {
+                slot = i;
+                break;
+            }
+        }
+
+        if (slot < 0) {
+            const char busy[] = "BUSY\n";
+            if (type == SESSION_LINE) {
+                send(clientFd, busy, sizeof(busy) - 1, MSG_DONTWAIT);
+            }
+            close(clientFd);
+            Serial.println("Rejected client: all sessions in use");
+            continue;
+        }
+
+        int noDelay = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL, 0) | O_NONBLOCK);
+
+        ClientSession& session = sessions[slot];
+        session.fd = clientFd;
+        session.type = type;
+        session.length = 0;
+        session.txLength = 0;
+        session.terminated = false;
+        session.handshake = 0;
+        session.webSocketKey[0] = '\0';
+        session.lastSeenMs = millis();
+        Serial.printf("New %s client connected (session %d)\n",
+                      type == SESSION_LINE ? "TCP" : "WebSocket", slot);
+    }
+}
+
+void NetworkServer::readClient(int clientId) {
+    ClientSession& session = sessions[clientId];
+    uint8_t chunk[64];
+
+    for (;;) {
+        int received = recv(session.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeClient(clientId);
+            return;
+        }
+        if (received < 0) {
+            break;
+        }
+
+        session.lastSeenMs = millis();
+
+        switch (session.type) {
+            case SESSION_LINE:
+                consumeLineBytes(clientId, chunk, received);
+                break;
+            case SESSION_HANDSHAKE:
+                consumeHandshakeBytes(clientId, chunk, received);
+                break;
+            case SESSION_WEBSOCKET:
+                consumeFrameBytes(clientId, chunk, received);
+                break;
+        }
+
+        if (session.fd < 0) {
+            return;
+        }
+    }
+
+    // The Android app writes commands without a trailing newline, so
+    // whatever is left once the socket is drained is a complete command.
+    // A client that has ended lines itself gets no such guessing, a line
+    // split across TCP segments waits for its newline.
+    if (session.type == SESSION_LINE && !session.terminated) {
+        dispatchLine(clientId);
+    }
+}
+
+void NetworkServer::consumeLineBytes(int clientId, const uint8_t* data, int length) {
+    ClientSession& session = sessions[clientId];
+
+    for (int i = 0; i < length && session.fd >= 0; i++) {
+        char c = data[i];
+        if (c == '\0') {
+            // A lone zero byte between commands is the keep-alive ping
+            if (session.length == 0) {
+                sendRaw(clientId, &data[i], 1);
+            }
+        } else if (c == '\n' || c == '\r') {
+            session.terminated = true;
+            dispatchLine(clientId);
+        } else if (c >= 32 && c <= 126) {
+            // An overlong line is counted but not kept, and dropped whole
+            if (session.length < CLIENT_BUFFER_SIZE - 1) {
+                session.buffer[session.length] = c;
+            }
+            if (session.length < CLIENT_BUFFER_SIZE) {
+                session.length++;
+            }
+        }
+    }
+}
+
+void NetworkServer::consumeHandshakeBytes(int clientId, const uint8_t* data, int length) {
+    ClientSession& session = sessions[clientId];
+    const char* keyHeader = "Sec-WebSocket-Key:";
+    const int keyHeaderLength = strlen(keyHeader);
+    const char* upgradeHeader = "Upgrade:";
+    const int upgradeHeaderLength = strlen(upgradeHeader);
+
+    for (int i = 0; i < length; i++) {
+        char c = data[i];
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            // Long headers are truncated, only the key line matters here
+            if (session.length < CLIENT_BUFFER_SIZE - 1) {
+                session.buffer[session.length++] = c;
+            }
+            continue;
+        }
+
+        if (session.length == 0) {
+            finishHandshake(clientId);
+            return;
+        }
+
+        session.buffer[session.length] = '\0';
+        if (!(session.handshake & HANDSHAKE_REQUEST_LINE)) {
+            session.handshake |= HANDSHAKE_REQUEST_LINE;
+            if (strncmp(session.buffer, "GET ", 4) == 0) {
+                session.handshake |= HANDSHAKE_GET;
+            }
+        } else if (strncasecmp(session.buffer, upgradeHeader, upgradeHeaderLength) == 0) {
+            const char* value = session.buffer + upgradeHeaderLength;
+            while (*value == ' ') value++;
+            if (strncasecmp(value, "websocket", 9) == 0) {
+                session.handshake |= HANDSHAKE_UPGRADE;
+            }
+        } else if (strncasecmp(session.buffer, keyHeader, keyHeaderLength) == 0) {
+            const char* key = session.buffer + keyHeaderLength;
+            while (*key == ' ') key++;
+            strncpy(session.webSocketKey, key, sizeof(session.webSocketKey) - 1);
+            session.webSocketKey[sizeof(session.webSocketKey) - 1] = '\0';
+        }
+        session.length = 0;
+    }
+}
+
+void NetworkServer::finishHandshake(int clientId) {
+    ClientSession& session = sessions[clientId];
+    char accept[32];
+
+    // Only a GET asking to upgrade to WebSocket is answered
+    if (!(session.handshake & HANDSHAKE_GET) || !(session.handshake & HANDSHAKE_UPGRADE) ||
+        session.webSocketKey[0] == '\0' ||
+        !webSocketAcceptKey(session.webSocketKey, accept, sizeof(accept))) {
+        const char badRequest[] = "HTTP/1.1 400 Bad Request\r\n\r\n";
+        sendRaw(clientId, (const uint8_t*)badRequest, sizeof(badRequest) - 1);
+        closeClient(clientId);
+        return;
+    }
+
+    char response[160];
+    int responseLength = snprintf(response, sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    sendRaw(clientId, (const uint8_t*)response, responseLength);
+
+    session.type = SESSION_WEBSOCKET;
+    session.length = 0;
+    Serial.printf("WebSocket handshake complete (session %d)\n", clientId);
+}
+
+void NetworkServer::consumeFrameBytes(int clientId, const uint8_t* data, int length) {
+    ClientSession& session = sessions[clientId];
+
+    // Takes in what fits and handles the frames that are complete, so the
+    // buffer only ever has to hold the frame still pending. A frame too
+    // big for it fails to parse once its header is in.
+    while (length > 0) {
+        int taken = min(length, CLIENT_BUFFER_SIZE - session.length);
+        memcpy(session.buffer + session.length, data, taken);
+        session.length += taken;
+        data += taken;
+        length -= taken;
+
+        if (!consumeFrames(clientId)) {
+            return;
+        }
+        if (session.length >= CLIENT_BUFFER_SIZE) {
+            closeClient(clientId);
+            return;
+        }
+    }
+}
+
+// Handles every complete frame at the start of the buffer; false once the
+// session was closed
+bool NetworkServer::consumeFrames(int clientId) {
+    ClientSession& session = sessions[clientId];
+
+    for (;;) {
+        WebSocketFrame frame;
+        int frameLength = webSocketParseFrame((uint8_t*)session.buffer, session.length,
+                                              CLIENT_BUFFER_SIZE, frame);
+        if (frameLength == 0) {
+            return true;
+        }
+        if (frameLength < 0 || !frame.final || frame.opcode == WS_CONTINUATION) {
+            Serial.printf("Unsupported WebSocket frame (session %d)\n", clientId);
+            sendFrame(clientId, WS_CLOSE, NULL, 0);
+            closeClient(clientId);
+            return false;
+        }
+
+        switch (frame.opcode) {
+            case WS_TEXT:
+            case WS_BINARY:
+                dispatchCommand(clientId, (char*)frame.payload, frame.length);
+                break;
+            case WS_PING:
+                sendFrame(clientId, WS_PONG, frame.payload, frame.length);
+                break;
+            case WS_PONG:
+                break;
+            case WS_CLOSE:
+                sendFrame(clientId, WS_CLOSE, NULL, 0);
+                closeClient(clientId);
+                return false;
+        }
+
+        if (session.fd < 0) {
+            return false;
+        }
+
+        session.length -= frameLength;
+        memmove(session.buffer, session.buffer + frameLength, session.length);
+    }
+}
+
+void NetworkServer::dispatchLine(int clientId) {
+    ClientSession& session = sessions[clientId];
+    int length = session.length;
+    session.length = 0;
+    if (length >= CLIENT_BUFFER_SIZE) {
+        Serial.printf("Dropped overlong line (session %d)\n", clientId);
+        return;
+    }
+    dispatchCommand(clientId, session.buffer, length);
+}
+
+void NetworkServer::dispatchCommand(int clientId, char* text, int length) {
+    // Strip everything outside printable ASCII, as the line protocol does
+    int kept = 0;
+    for (int i = 0; i < length; i++) {
+        if (text[i] >= 32 && text[i] <= 126) {
+            text[kept++] = text[i];
+        }
+    }
+
+    int start = 0;
+    int end = kept;
+    while (start < end && text[start] == ' ') start++;
+    while (end > start && text[end - 1] == ' ') end--;
+
+    if (end <= start || commandCallback == NULL) {
+        return;
+    }
+
+    // Frame payloads may sit right at the end of the buffer, so copy out
+    char command[CLIENT_BUFFER_SIZE];
+    int commandLength = end - start;
+    if (commandLength > CLIENT_BUFFER_SIZE - 1) {
+        commandLength = CLIENT_BUFFER_SIZE - 1;
+    }
+    memcpy(command, text + start, commandLength);
+    command[commandLength] = '\0';
+
+    commandCallback(clientId, command);
+}
+
+void NetworkServer::serviceWebSockets() {
+    if (webSocketCount() == 0) {
+        return;
+    }
+
+    unsigned long now = millis();
+
+    if (now - lastPingMs >= (unsigned long)WS_PING_INTERVAL_MS) {
+        lastPingMs = now;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (sessions[i].fd < 0 || sessions[i].type == SESSION_LINE) {
+                continue;
+            }
+            if (now - sessions[i].lastSeenMs > (unsigned long)WS_TIMEOUT_MS) {
+                Serial.printf("WebSocket session %d timed out\n", i);
+                closeClient(i);
+            } else if (sessions[i].type == SESSION_WEBSOCKET) {
+                sendFrame(i, WS_PING, NULL, 0);
+            }
+        }
+    }
+
+    for (int s = 0; s < telemetryCount; s++) {
+        TelemetryStream& stream = telemetry[s];
+        if (now - stream.lastMs < (unsigned long)stream.intervalMs) {
+            continue;
+        }
+        stream.lastMs = now;
+        char frame[MAX_MESSAGE_SIZE];
+        stream.callback(frame, sizeof(frame));
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (sessions[i].fd >= 0 && sessions[i].type == SESSION_WEBSOCKET) {
+                sendFrame(i, WS_TEXT, (const uint8_t*)frame, strlen(frame));
+            }
+        }
+    }
+}
+
+// A full socket takes what it can, the rest waits in the session until
+// select() reports the socket writable again. Bytes are never dropped
+// from the middle of the stream, which would corrupt WebSocket framing.
+bool NetworkServer::sendRaw(int clientId, const uint8_t* data, size_t length) {
+    if (clientId < 0 || clientId >= MAX_CLIENTS || sessions[clientId].fd < 0) {
+        return false;
+    }
+    ClientSession& session = sessions[clientId];
+
+    size_t sent = 0;
+    if (session.txLength == 0) {
+        int result = send(session.fd, data, length, MSG_DONTWAIT);
+        if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeClient(clientId);
+            return false;
+        }
+        if (result > 0) {
+            sent = result;
+        }
+    }
+
+    size_t remaining = length - sent;
+    if (remaining == 0) {
+        return true;
+    }
+    if (session.txLength + remaining > (size_t)CLIENT_TX_BUFFER_SIZE) {
+        Serial.printf("Client not reading, dropping session %d\n", clientId);
+        closeClient(clientId);
+        return false;
+    }
+    memcpy(session.txBuffer + session.txLength, data + sent, remaining);
+    session.txLength += remaining;
+    return true;
+}
+
+void NetworkServer::flushClient(int clientId) {
+    ClientSession& session = sessions[clientId];
+    int sent = send(session.fd, session.txBuffer, session.txLength, MSG_DONTWAIT);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeClient(clientId);
+        }
+        return;
+    }
+    session.txLength -= sent;
+    memmove(session.txBuffer, session.txBuffer + sent, session.txLength);
+}
+
+bool NetworkServer::sendFrame(int clientId, uint8_t opcode, const uint8_t* payload, size_t length) {
+    uint8_t framed[MAX_MESSAGE_SIZE + 4];
+    if (length > MAX_MESSAGE_SIZE) {
+        length = MAX_MESSAGE_SIZE;
+    }
+    size_t headerLength = webSocketFrameHeader(framed, opcode, length);
+    if (length > 0) {
+        memcpy(framed + headerLength, payload, length);
+    }
+    return sendRaw(clientId, framed, headerLength + length);
+}
+
+bool NetworkServer::sendLine(int clientId, const char* line) {
+    if (clientId < 0 || clientId >= MAX_CLIENTS || sessions[clientId].fd < 0) {
+        return false;
+    }
+
+    size_t length = strlen(line);
+    if (sessions[clientId].type == SESSION_WEBSOCKET) {
+        return sendFrame(clientId, WS_TEXT, (const uint8_t*)line, length);
+    }
+    if (sessions[clientId].type != SESSION_LINE) {
+        return false;
+    }
+
+    char framed[MAX_MESSAGE_SIZE + 2];
+    if (length > MAX_MESSAGE_SIZE) {
+        length = MAX_MESSAGE_SIZE;
+    }
+    memcpy(framed, line, length);
+    framed[length++] = '\r';
+    framed[length++] = '\n';
+    return sendRaw(clientId, (const uint8_t*)framed, length);
+}
+
+void NetworkServer::broadcastLine(const char* line) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (sessions[i].fd >= 0) {
+            sendLine(i, line);
+        }
+    }
+}
+
+void NetworkServer::closeClient(int clientId) {
+    ClientSession& session = sessions[clientId];
+    if (session.fd < 0) {
+        return;
+    }
+    close(session.fd);
+    session.fd = -1;
+    session.length = 0;
+    session.txLength = 0;
+    Serial.printf("Client disconnected (session %d)\n", clientId);
+}
+
+int NetworkServer::clientCount() {
+    int count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (sessions[i].fd >= 0) count++;
+    }
+    return count;
+}
+
+int NetworkServer::webSocketCount() {
+    int count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (sessions[i].fd >= 0 && sessions[i].type != SESSION_LINE) count++;
+    }
+    return count;
+}
@@ -0,0 +1,126 @@
+#ifndef NETWORK_SERVER_H
+#define NETWORK_SERVER_H
+
+#include <Arduino.h>
+#include <lwip/sockets.h>
+
+const int MAX_CLIENTS = 4;
+const int CLIENT_BUFFER_SIZE = 128;
+const int MAX_MESSAGE_SIZE = 512;
+// Bytes a session may have waiting for a full socket to drain. A client
+// that falls further behind than this is disconnected.
+const int CLIENT_TX_BUFFER_SIZE = 1536;
+
+const int OUTBOX_LENGTH = 16;
+const int OUTBOX_LINE_SIZE = 64;
+
+const int TELEMETRY_STREAMS = 2;
+
+const int WS_PING_INTERVAL_MS = 5000;
+const int WS_TIMEOUT_MS = 15000;
+
+typedef void (*CommandCallback)(int clientId, const char* command);
+typedef void (*TelemetryCallback)(char* buffer, size_t size);
+
+enum SessionType {
+    SESSION_LINE,
+    SESSION_HANDSHAKE,
+    SESSION_WEBSOCKET
+};
+
+struct TelemetryStream {
+    TelemetryCallback callback;
+    int intervalMs;
+    unsigned long lastMs;
+};
+
+struct OutboxLine {
+    int clientId;
+    char text[OUTBOX_LINE_SIZE];
+};
+
+// What the upgrade request of a WebSocket session has shown so far
+const uint8_t HANDSHAKE_REQUEST_LINE = 1;
+const uint8_t HANDSHAKE_GET = 2;
+const uint8_t HANDSHAKE_UPGRADE = 4;
+
+struct ClientSession {
+    int fd;
+    SessionType type;
+    int length;
+    char buffer[CLIENT_BUFFER_SIZE];
+    char webSocketKey[32];
+    uint8_t handshake;
+    unsigned long lastSeenMs;
+    // Set once a line session ends a command with a newline
+    bool terminated;
+    int txLength;
+    uint8_t txBuffer[CLIENT_TX_BUFFER_SIZE];
+};
+
+// Line based TCP server on top of lwIP sockets. A single select() call
+// waits on the listening sockets and every open session, so the calling
+// task sleeps until a client actually sends something.
+//
+// A second port speaks WebSocket: commands arrive as text or binary
+// frames, replies go back as text frames and each telemetry stream is
+// pushed to every WebSocket session at its own fixed interval.
+class NetworkServer {
+public:
+    NetworkServer(uint16_t port, uint16_t webSocketPort);
+
+    bool begin();
+
+    // Blocks for at most timeoutMs waiting for socket activity
+    void poll(int timeoutMs);
+
+    void onCommand(CommandCallback callback);
+    // Adds a telemetry stream, up to TELEMETRY_STREAMS
+    bool onTelemetry(TelemetryCallback callback, int intervalMs);
+
+    bool sendLine(int clientId, const char* line);
+
+    // Queues a line for the network task to send, for use from other
+    // tasks. Never blocks; returns false when the outbox is full. A
+    // clientId of -1 sends to every client.
+    bool post(int clientId, const char* line);
+
+    bool sendRaw(int clientId, const uint8_t* data, size_t length);
+    void broadcastLine(const char* line);
+
+    void closeClient(int clientId);
+    int clientCount();
+
+private:
+    uint16_t port;
+    uint16_t webSocketPort;
+    int listenFd;
+    int webSocketFd;
+    int wakeFd;
+    struct sockaddr_in wakeAddress;
+    QueueHandle_t outbox;
+    CommandCallback commandCallback;
+    TelemetryStream telemetry[TELEMETRY_STREAMS];
+    int telemetryCount;
+    unsigned long lastPingMs;
+    ClientSession sessions[MAX_CLIENTS];
+
+    int openListener(uint16_t listenPort);
+    int openWakeSocket();
+    void flushOutbox();
+    void acceptClients(int fd, SessionType type);
+    void readClient(int clientId);
+    void flushClient(int clientId);
+    void consumeLineBytes(int clientId, const uint8_t* data, int length);
+    void consumeHandshakeBytes(int clientId, const uint8_t* data, int length);
+    void consumeFrameBytes(int clientId, const uint8_t* data, int length);
+    bool consumeFrames(int clientId);
+    void finishHandshake(int clientId);
+    void dispatchLine(int clientId);
+    void dispatchCommand(int clientId, char* text, int length);
+    bool sendFrame(int clientId, uint8_t opcode, const uint8_t* payload, size_t length);
+    void serviceWebSockets();
+    int webSocketCount();
+};
+
+#endif
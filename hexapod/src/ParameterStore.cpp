@@ -0,0 +1,149 @@
+#include "ParameterStore.h"
+#include "InputLog.h"
+#include <Preferences.h>
+
+const char* PARAMETER_NAMESPACE = "hexapod";
+const char* PARAMETER_KEY = "params";
+
+// Bump when the stored layout changes so old blobs are ignored
+const uint32_t PARAMETER_VERSION = 2;
+
+struct StoredParameters {
+    uint32_t version;
+    GaitTiming timing;
+    GaitStride stride;
+    int32_t tunedBattery;
+};
+
+struct TimingParameter {
+    const char* name;
+    int GaitTiming::*field;
+};
+
+const TimingParameter TIMING_PARAMETERS[] = {
+    {"liftTime",         &GaitTiming::liftTime},
+    {"swingTime",        &GaitTiming::swingTime},
+    {"lowerTime",        &GaitTiming::lowerTime},
+    {"waveLiftTime",     &GaitTiming::waveLiftTime},
+    {"waveSwingTime",    &GaitTiming::waveSwingTime},
+    {"waveLowerTime",    &GaitTiming::waveLowerTime},
+    {"waveShiftTime",    &GaitTiming::waveShiftTime},
+    {"rotateLiftTime",   &GaitTiming::rotateLiftTime},
+    {"rotateSwingTime",  &GaitTiming::rotateSwingTime},
+    {"rotatePlantTime",  &GaitTiming::rotatePlantTime},
+    {"liftDelay",        &GaitTiming::liftDelay},
+    {"swingDelay",       &GaitTiming::swingDelay},
+    {"lowerDelay",       &GaitTiming::lowerDelay},
+    {"rotateLowerDelay", &GaitTiming::rotateLowerDelay},
+    {"waveDelay",        &GaitTiming::waveDelay},
+};
+
+const int TIMING_PARAMETER_COUNT = sizeof(TIMING_PARAMETERS) / sizeof(TIMING_PARAMETERS[0]);
+
+struct StrideParameter {
+    const char* name;
+    int GaitStride::*field;
+    int minimum;
+    int maximum;
+};
+
+// Coxa ends stay on their side of the middle, the lift clear of the stance
+const StrideParameter STRIDE_PARAMETERS[] = {
+    {"coxaForward",  &GaitStride::coxaForward,  9000,  12000},
+    {"coxaBackward", &GaitStride::coxaBackward, 12000, 15000},
+    {"femurLift",    &GaitStride::femurLift,    14000, 20000},
+    {"bodyPush",     &GaitStride::bodyPush,     0,     2000},
+};
+
+const int STRIDE_PARAMETER_COUNT = sizeof(STRIDE_PARAMETERS) / sizeof(STRIDE_PARAMETERS[0]);
+
+
+ParameterStore::ParameterStore() : timing(defaultGaitTiming()), stride(defaultGaitStride()), tunedBattery(-1) {}
+
+bool ParameterStore::load() {
+    Preferences preferences;
+    if (!preferences.begin(PARAMETER_NAMESPACE, true)) {
+        return false;
+    }
+
+    StoredParameters stored;
+    size_t length = preferences.getBytes(PARAMETER_KEY, &stored, sizeof(stored));
+    preferences.end();
+    length = inputParameters(&stored, sizeof(stored), length);
+
+    if (length != sizeof(stored) || stored.version != PARAMETER_VERSION) {
+        return false;
+    }
+    timing = stored.timing;
+    stride = stored.stride;
+    tunedBattery = stored.tunedBattery;
+    return true;
+}
+
+bool ParameterStore::save() {
+    Preferences preferences;
+    if (!preferences.begin(PARAMETER_NAMESPACE, false)) {
+        return false;
+    }
+
+    StoredParameters stored;
+    stored.version = PARAMETER_VERSION;
+    stored.timing = timing;
+    stored.stride = stride;
+    stored.tunedBattery = tunedBattery;
+    size_t written = preferences.putBytes(PARAMETER_KEY, &stored, sizeof(stored));
+    preferences.end();
+    return written == sizeof(stored);
+}
+
+void ParameterStore::resetDefaults() {
+    timing = defaultGaitTiming();
+    stride = defaultGaitStride();
+    tunedBattery = -1;
+}
+
+bool ParameterStore::set(const char* name, int value) {
+    for (int i = 0; i < TIMING_PARAMETER_COUNT; i++) {
+        if (strcmp(name, TIMING_PARAMETERS[i].name) == 0) {
+            timing.*TIMING_PARAMETERS[i].field = max(value, 0);
+            return true;
+        }
+    }
+    for (int i = 0; i < STRIDE_PARAMETER_COUNT; i++) {
+        const StrideParameter& parameter = STRIDE_PARAMETERS[i];
+        if (strcmp(name, parameter.name) == 0) {
+            stride.*parameter.field = constrain(value, parameter.minimum, parameter.maximum);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParameterStore::isKnown(const char* name) {
+    for (int i = 0; i < TIMING_PARAMETER_COUNT; i++) {
+        if (strcmp(name, TIMING_PARAMETERS[i].name) == 0) {
+            return true;
+        }
+    }
+    for (int i = 0; i < STRIDE_PARAMETER_COUNT; i++) {
+        if (strcmp(name, STRIDE_PARAMETERS[i].name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParameterStore::format(char* buffer, size_t size) const {
+    int used = 0;
+    for (int i = 0; i < TIMING_PARAMETER_COUNT && used < (int)size; i++) {
+        used += snprintf(buffer + used, size - used, "%s=%d,", TIMING_PARAMETERS[i].name,
+                         timing.*TIMING_PARAMETERS[i].field);
+    }
+    for (int i = 0; i < STRIDE_PARAMETER_COUNT && used < (int)size; i++) {
+        used += snprintf(buffer + used, size - used, "%s=%d,", STRIDE_PARAMETERS[i].name,
+                         stride.*STRIDE_PARAMETERS[i].field);
+    }
+    if (used < (int)size) {
+        snprintf(buffer + used, size - used, "tunedBattery=%d", tunedBattery);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PARAMETER_STORE_H
+#define PARAMETER_STORE_H
+
+#include <Arduino.h>
+#include "GaitTiming.h"
+
+
+// Runtime tunables that survive a reboot, kept in NVS. Values set here
+// take effect without reflashing; load() falls back to the compiled-in
+// defaults when nothing valid is stored.
+class ParameterStore {
+public:
+    ParameterStore();
+
+    bool load();
+    bool save();
+    void resetDefaults();
+
+    const GaitTiming& getGaitTiming() const { return timing; }
+    void setGaitTiming(const GaitTiming& values) { timing = values; }
+
+    const GaitStride& getGaitStride() const { return stride; }
+    void setGaitStride(const GaitStride& values) { stride = values; }
+
+    // Battery percentage when the timing was last tuned, -1 if never
+    int getTunedBattery() const { return tunedBattery; }
+    void setTunedBattery(int percentage) { tunedBattery = percentage; }
+
+    // Sets one parameter by name, clamped to its range; returns false for
+    // an unknown name
+    bool set(const char* name, int value);
+    static bool isKnown(const char* name);
+
+    // Writes "name=value,..." for every parameter
+    void format(char* buffer, size_t size) const;
+
+private:
+    GaitTiming timing;
+    GaitStride stride;
+    int tunedBattery;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef PHASED_MOTION_H
+#define PHASED_MOTION_H
+
+#include <Arduino.h>
+
+
+// A motion broken into timed phases. Each phase sends its servo commands
+// and says how long to wait before the next one, so the control task can
+// step it from a fixed-rate tick instead of blocking in delay().
+class PhasedMotion {
+public:
+    PhasedMotion() : phase(-1), phaseEndMs(0) {}
+
+    virtual ~PhasedMotion() {}
+
+    void start() {
+        phase = 0;
+    }
+
+    void abort() {
+        phase = -1;
+    }
+
+    bool isRunning() const {
+        return phase >= 0;
+    }
+
+    int currentPhase() const {
+        return phase;
+    }
+
+    // Runs every phase that is due, returns true once the motion is done
+    bool update(unsigned long now) {
+        if (phase < 0) {
+            return true;
+        }
+
+        bool due = phase == 0 || (long)(now - phaseEndMs) >= 0;
+        if (!due && !phaseSettled(now)) {
+            return false;
+        }
+
+        int duration = runPhase(phase);
+        if (duration < 0) {
+            phase = -1;
+            return true;
+        }
+
+        // Schedule from the previous deadline so tick quantization does
+        // not accumulate over a cycle; a phase that settled early starts
+        // the clock again from now
+        phaseEndMs = (due && phase > 0 ? phaseEndMs : now) + duration;
+        phase++;
+        return false;
+    }
+
+protected:
+    // Sends the commands of the given phase and returns how long it lasts
+    // in ms, or -1 when there are no phases left
+    virtual int runPhase(int phase) = 0;
+
+    // Polled every tick before the deadline; returning true ends the
+    // current phase early, for motions that can tell when they arrived
+    virtual bool phaseSettled(unsigned long now) {
+        return false;
+    }
+
+private:
+    int phase;
+    unsigned long phaseEndMs;
+};
+
+
+typedef int (*PhaseFunction)(int phase);
+
+// Adapts a plain phase function, used for the posture and dance routines
+class ScriptedMotion : public PhasedMotion {
+public:
+    ScriptedMotion(PhaseFunction function) : function(function) {}
+
+protected:
+    int runPhase(int phase) override {
+        return function(phase);
+    }
+
+private:
+    PhaseFunction function;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "PoseController.h"
+#include "Constants.h"
+
+
+static float approach(float value, float target, float step) {
+    if (target > value + step) return value + step;
+    if (target < value - step) return value - step;
+    return target;
+}
+
+PoseController::PoseController() : offsetX(0), offsetY(0), neutral(true) {
+    reset();
+    pose = target;
+}
+
+void PoseController::setTarget(const BodyPose& requested) {
+    target.x = constrain(requested.x, -BODY_POSE_MAX_SHIFT, BODY_POSE_MAX_SHIFT);
+    target.y = constrain(requested.y, -BODY_POSE_MAX_SHIFT, BODY_POSE_MAX_SHIFT);
+    target.z = constrain(requested.z, -BODY_POSE_MAX_HEIGHT, BODY_POSE_MAX_HEIGHT);
+    target.roll = constrain(requested.roll, -BODY_POSE_MAX_TILT, BODY_POSE_MAX_TILT);
+    target.pitch = constrain(requested.pitch, -BODY_POSE_MAX_TILT, BODY_POSE_MAX_TILT);
+    target.yaw = constrain(requested.yaw, -BODY_POSE_MAX_TILT, BODY_POSE_MAX_TILT);
+}
+
+void PoseController::reset() {
+    BodyPose zero = {0, 0, 0, 0, 0, 0};
+    target = zero;
+}
+
+void PoseController::setOffset(float x, float y) {
+    offsetX = x;
+    offsetY = y;
+}
+
+void PoseController::restore(const BodyPose& goal, const BodyPose& applied) {
+    target = goal;
+    pose = applied;
+    neutral = pose.x == 0 && pose.y == 0 && pose.z == 0 &&
+              pose.roll == 0 && pose.pitch == 0 && pose.yaw == 0;
+}
+
+bool PoseController::update(float seconds) {
+    BodyPose goal = target;
+    goal.x = constrain(goal.x + offsetX, -BODY_POSE_MAX_SHIFT, BODY_POSE_MAX_SHIFT);
+    goal.y = constrain(goal.y + offsetY, -BODY_POSE_MAX_SHIFT, BODY_POSE_MAX_SHIFT);
+    float shift = BODY_POSE_SPEED * seconds;
+    float turn = BODY_POSE_TURN_RATE * seconds;
+
+    BodyPose next;
+    next.x = approach(pose.x, goal.x, shift);
+    next.y = approach(pose.y, goal.y, shift);
+    next.z = approach(pose.z, goal.z, shift);
+    next.roll = approach(pose.roll, goal.roll, turn);
+    next.pitch = approach(pose.pitch, goal.pitch, turn);
+    next.yaw = approach(pose.yaw, goal.yaw, turn);
+
+    bool moved = memcmp(&next, &pose, sizeof(BodyPose)) != 0;
+    pose = next;
+    neutral = pose.x == 0 && pose.y == 0 && pose.z == 0 &&
+              pose.roll == 0 && pose.pitch == 0 && pose.yaw == 0;
+    return moved;
+}
+
+bool PoseController::transform(int base, const JointTargets& from, JointTargets& to, bool inverse) const {
+    // Skipping the round trip keeps unposed commands exact
+    if (neutral) {
+        to = from;
+        return true;
+    }
+    FootPosition foot = legForward(base, from.coxa, from.femur, from.tibia);
+    if (!legInverse(base, poseFoot(base, foot, pose, inverse), to)) {
+        to = from;
+        return false;
+    }
+    return true;
+}
+
+bool PoseController::apply(int base, const JointTargets& targets, JointTargets& posed) const {
+    return transform(base, targets, posed, false);
+}
+
+bool PoseController::remove(int base, const JointTargets& posed, JointTargets& targets) const {
+    return transform(base, posed, targets, true);
+}
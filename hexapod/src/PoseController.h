@@ -0,0 +1,55 @@
+#ifndef POSE_CONTROLLER_H
+#define POSE_CONTROLLER_H
+
+#include <Arduino.h>
+#include "LegKinematics.h"
+
+
+// Body pose laid over whatever the legs are doing. The client streams a
+// target pose; the control task moves the applied pose towards it at a
+// limited rate, and every gait or stance leg command is passed through
+// apply() so its foot stays where the gait wanted it on the ground while
+// the body shifts and tilts above.
+class PoseController {
+public:
+    PoseController();
+
+    // Clamped to the pose limits. Written from the network task; a torn
+    // read only mixes two consecutive frames of the stream.
+    void setTarget(const BodyPose& pose);
+    void reset();
+
+    // Body shift in mm laid on top of the client's pose and kept through
+    // reset(), for the five-leg stance. Set from the control task.
+    void setOffset(float x, float y);
+
+    // Steps the applied pose towards the target, true if it moved
+    bool update(float seconds);
+
+    const BodyPose& getPose() const { return pose; }
+    const BodyPose& getTarget() const { return target; }
+    float getOffsetX() const { return offsetX; }
+    float getOffsetY() const { return offsetY; }
+
+    // Puts the pose back as a keyframe of the input log held it
+    void restore(const BodyPose& goal, const BodyPose& applied);
+    bool isNeutral() const { return neutral; }
+
+    // Joint targets for a leg command with the pose applied. Returns false
+    // and the targets unchanged when the posed foot is out of reach.
+    bool apply(int base, const JointTargets& targets, JointTargets& posed) const;
+
+    // Takes the pose back out of posed joint positions
+    bool remove(int base, const JointTargets& posed, JointTargets& targets) const;
+
+private:
+    BodyPose target;
+    BodyPose pose;
+    float offsetX;
+    float offsetY;
+    bool neutral;
+
+    bool transform(int base, const JointTargets& from, JointTargets& to, bool inverse) const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "PostureController.h"
+#include "Logger.h"
+#include "InputLog.h"
+
+const int POSTURE_RELIEF_TIME = 420;
+
+
+PostureController::PostureController(ServoShadow& shadow, const bool* legContact)
+    : shadow(shadow), legContact(legContact), sequenceName(""), stages(NULL),
+      stageCount(0), stageIndex(0), pendingJoints(0), readCursor(0),
+      relieving(false), retriedLegs(0), stalledLegs(0), missingContactLegs(0),
+      stageCommandMs(0), sequenceStartMs(0), lastDurationMs(0) {}
+
+void PostureController::setSequence(const char* name, const PostureStage* sequence, int count) {
+    sequenceName = name;
+    stages = sequence;
+    stageCount = count;
+}
+
+int PostureController::legsInGroup(LegGroup group, int* legs) {
+    switch (group) {
+        case TRIPOD_1:
+            for (int i = 0; i < 3; i++) legs[i] = TRIPOD1_LEGS[i];
+            return 3;
+        case TRIPOD_2:
+            for (int i = 0; i < 3; i++) legs[i] = TRIPOD2_LEGS[i];
+            return 3;
+        case ALL_LEGS:
+        default:
+            for (int i = 0; i < 6; i++) legs[i] = i * 3;
+            return 6;
+    }
+}
+
+uint8_t PostureController::legsWithPendingJoints() {
+    uint8_t legs = 0;
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        if (pendingJoints & (1UL << id)) {
+            legs |= 1 << (id / 3);
+        }
+    }
+    return legs;
+}
+
+int PostureController::runPhase(int phase) {
+    if (phase == 0) {
+        stageIndex = 0;
+        pendingJoints = 0;
+        relieving = false;
+        retriedLegs = 0;
+        stalledLegs = 0;
+        missingContactLegs = 0;
+        sequenceStartMs = inputClock();
+        logPrintf("%s: starting", sequenceName);
+    } else if (relieving) {
+        // Relief lift is done, send the stalled stage again
+        relieving = false;
+        int duration = commandStage();
+        if (duration > 0) {
+            return duration;
+        }
+        finishStage();
+    } else {
+        // Reaching the deadline with joints still pending means they stalled
+        uint8_t stuck = legsWithPendingJoints();
+        uint8_t retry = stuck & ~retriedLegs;
+        if (retry != 0) {
+            retriedLegs |= retry;
+            return relieveLegs(retry);
+        }
+        if (stuck != 0) {
+            stalledLegs |= stuck;
+            for (int id = 0; id < SERVO_COUNT; id++) {
+                if (pendingJoints & (1UL << id)) {
+                    logPrintf("%s: leg %d stalled, servo %d at %ld, target %ld", sequenceName,
+                              (id / 3) * 3, id, (long)shadow.read(id), (long)shadow.target(id));
+                }
+            }
+        }
+        finishStage();
+    }
+
+    while (stageIndex < stageCount) {
+        int duration = commandStage();
+        if (duration > 0) {
+            return duration;
+        }
+        finishStage();
+    }
+
+    lastDurationMs = inputClock() - sequenceStartMs;
+    logPrintf("%s: complete in %lu ms", sequenceName, lastDurationMs);
+    return -1;
+}
+
+int PostureController::commandStage() {
+    const PostureStage& stage = stages[stageIndex];
+    unsigned long now = inputClock();
+    int legs[6];
+    int count = legsInGroup(stage.group, legs);
+
+    bool commanded = false;
+    pendingJoints = 0;
+    for (int i = 0; i < count; i++) {
+        int32_t targets[3] = {stage.coxa, stage.femur, stage.tibia};
+        for (int joint = 0; joint < 3; joint++) {
+            if (targets[joint] == KEEP) {
+                continue;
+            }
+            int id = legs[i] + joint;
+            // Already commanded there and given time to arrive
+            if (shadow.isTargeting(id, targets[joint], 0) &&
+                (long)(now - shadow.arrivalMs(id)) >= 0) {
+                continue;
+            }
+            shadow.move(id, targets[joint], stage.time);
+            // A leg already flagged as stalled is not waited for again
+            if (!(stalledLegs & (1 << (legs[i] / 3)))) {
+                pendingJoints |= 1UL << id;
+            }
+            commanded = true;
+        }
+    }
+
+    if (!commanded) {
+        return 0;
+    }
+
+    stageCommandMs = now;
+    logPrintf("%s: %s", sequenceName, stage.name);
+    return stage.time + POSTURE_STALL_MARGIN;
+}
+
+void PostureController::finishStage() {
+    const PostureStage& stage = stages[stageIndex];
+    pendingJoints = 0;
+
+    if (stage.expectContact) {
+        int legs[6];
+        int count = legsInGroup(stage.group, legs);
+        for (int i = 0; i < count; i++) {
+            if (!legContact[legs[i] / 3]) {
+                missingContactLegs |= 1 << (legs[i] / 3);
+                logPrintf("%s: leg %d has no ground contact", sequenceName, legs[i]);
+            }
+        }
+    }
+
+    stageIndex++;
+}
+
+int PostureController::relieveLegs(uint8_t legs) {
+    for (int leg = 0; leg < 6; leg++) {
+        if (legs & (1 << leg)) {
+            int base = leg * 3;
+            logPrintf("%s: leg %d not arriving, relief lift and retry", sequenceName, base);
+            shadow.move(base + 1, FEMUR_UP - 250, POSTURE_RELIEF_TIME);
+            shadow.move(base + 2, TIBIA_UP + 120, POSTURE_RELIEF_TIME);
+        }
+    }
+    pendingJoints = 0;
+    relieving = true;
+    return POSTURE_RELIEF_TIME + 20;
+}
+
+bool PostureController::phaseSettled(unsigned long now) {
+    if (relieving || pendingJoints == 0) {
+        return false;
+    }
+
+    // Joints can not beat the commanded move time, so only start reading
+    // positions near the end of the move
+    const PostureStage& stage = stages[stageIndex];
+    if (now - stageCommandMs < (unsigned long)(stage.time * POSTURE_ARRIVAL_PERCENT / 100)) {
+        return false;
+    }
+
+    int reads = 0;
+    int start = readCursor;
+    int next = start;
+    for (int i = 0; i < SERVO_COUNT && reads < POSTURE_READS_PER_TICK; i++) {
+        int id = (start + i) % SERVO_COUNT;
+        if (!(pendingJoints & (1UL << id))) {
+            continue;
+        }
+        reads++;
+        next = id + 1;
+
+        int32_t position = shadow.read(id);
+        int32_t error = position - shadow.target(id);
+        if (position >= 0 && error <= POSITION_TOLERANCE && error >= -POSITION_TOLERANCE) {
+            pendingJoints &= ~(1UL << id);
+        }
+    }
+    readCursor = next % SERVO_COUNT;
+
+    return pendingJoints == 0;
+}
@@ -0,0 +1,75 @@
+#ifndef POSTURE_CONTROLLER_H
+#define POSTURE_CONTROLLER_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "PhasedMotion.h"
+#include "ServoShadow.h"
+
+const int32_t KEEP = -1;
+
+enum LegGroup {
+    ALL_LEGS,
+    TRIPOD_1,
+    TRIPOD_2
+};
+
+struct PostureStage {
+    const char* name;
+    LegGroup group;
+    int32_t coxa;
+    int32_t femur;
+    int32_t tibia;
+    int time;
+    bool expectContact;
+};
+
+// Runs a posture transition as a list of stages. A stage ends as soon as
+// sparse position reads confirm every commanded joint has arrived, rather
+// than after a fixed worst-case delay. Joints that are already in place
+// are not commanded at all. A leg that does not arrive gets one relief
+// lift and a retry; if it is still stuck it is flagged and the sequence
+// carries on without waiting for it.
+class PostureController : public PhasedMotion {
+public:
+    PostureController(ServoShadow& shadow, const bool* legContact);
+
+    void setSequence(const char* name, const PostureStage* stages, int count);
+
+    // Bit per leg (leg base / 3) that stalled or ended without contact
+    uint8_t getStalledLegs() const { return stalledLegs; }
+    uint8_t getMissingContactLegs() const { return missingContactLegs; }
+
+    unsigned long getLastDurationMs() const { return lastDurationMs; }
+
+protected:
+    int runPhase(int phase) override;
+    bool phaseSettled(unsigned long now) override;
+
+private:
+    ServoShadow& shadow;
+    const bool* legContact;
+
+    const char* sequenceName;
+    const PostureStage* stages;
+    int stageCount;
+
+    int stageIndex;
+    uint32_t pendingJoints;
+    int readCursor;
+    bool relieving;
+    uint8_t retriedLegs;
+    uint8_t stalledLegs;
+    uint8_t missingContactLegs;
+    unsigned long stageCommandMs;
+    unsigned long sequenceStartMs;
+    unsigned long lastDurationMs;
+
+    int commandStage();
+    void finishStage();
+    int relieveLegs(uint8_t legs);
+    uint8_t legsWithPendingJoints();
+    int legsInGroup(LegGroup group, int* legs);
+};
+
+#endif
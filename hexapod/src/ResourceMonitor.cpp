@@ -0,0 +1,123 @@
+#include "ResourceMonitor.h"
+
+#include <esp_heap_caps.h>
+
+static TaskHandle_t countedTask = NULL;
+static volatile uint32_t allocationCount = 0;
+
+#ifdef RESOURCE_COUNT_ALLOCATIONS
+// Linked in place of malloc, calloc and realloc with -Wl,--wrap; Arduino
+// String, operator new and lwIP all come through here
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+static inline void countAllocation() {
+    if (countedTask != NULL && xTaskGetCurrentTaskHandle() == countedTask) {
+        allocationCount++;
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    countAllocation();
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    countAllocation();
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    countAllocation();
+    return __real_realloc(pointer, size);
+}
+}
+#endif
+
+
+ResourceMonitor::ResourceMonitor()
+    : taskCount(0), lastSampleMs(0), sampled(false), commandStartCount(0), lastCommandAllocations(0),
+      maxCommandAllocations(0), totalCommandAllocations(0), commands(0) {
+    heap = HeapUsage();
+}
+
+bool ResourceMonitor::watchTask(const char* name, TaskHandle_t handle, uint32_t stackBytes) {
+    // A NULL handle would read the stack of whoever samples
+    if (handle == NULL || taskCount >= MAX_WATCHED_TASKS) {
+        return false;
+    }
+    // Filled in before it is counted, the network task may be sampling
+    TaskStackUsage& task = tasks[taskCount];
+    task.name = name;
+    task.handle = handle;
+    task.stackBytes = stackBytes;
+    task.minFreeBytes = stackBytes;
+    taskCount++;
+    return true;
+}
+
+void ResourceMonitor::countAllocations(TaskHandle_t task) {
+    countedTask = task;
+}
+
+void ResourceMonitor::update(unsigned long now) {
+    if (!sampled || now - lastSampleMs >= RESOURCE_SAMPLE_MS) {
+        lastSampleMs = now;
+        sample();
+    }
+}
+
+void ResourceMonitor::sample() {
+    sampled = true;
+    heap.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    heap.minFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap.fragmentation = heap.freeBytes > 0 ? 100 - (uint64_t)heap.largestBlock * 100 / heap.freeBytes : 0;
+    if (heap.fragmentation > heap.maxFragmentation) {
+        heap.maxFragmentation = heap.fragmentation;
+    }
+
+    // ESP-IDF counts stacks in bytes
+    for (int i = 0; i < taskCount; i++) {
+        tasks[i].minFreeBytes = uxTaskGetStackHighWaterMark(tasks[i].handle);
+    }
+}
+
+void ResourceMonitor::beginCommand() {
+    commandStartCount = allocationCount;
+}
+
+void ResourceMonitor::endCommand() {
+    lastCommandAllocations = allocationCount - commandStartCount;
+    if (lastCommandAllocations > maxCommandAllocations) {
+        maxCommandAllocations = lastCommandAllocations;
+    }
+    totalCommandAllocations += lastCommandAllocations;
+    commands++;
+}
+
+int ResourceMonitor::format(char* buffer, size_t size) const {
+    int length = snprintf(buffer, size,
+                          "heap=%lu,largest=%lu,minHeap=%lu,frag=%u,maxFrag=%u,allocs=%lu/%lu/%lu/%lu,stack=",
+                          (unsigned long)heap.freeBytes, (unsigned long)heap.largestBlock,
+                          (unsigned long)heap.minFreeBytes, heap.fragmentation, heap.maxFragmentation,
+                          (unsigned long)lastCommandAllocations, (unsigned long)maxCommandAllocations,
+                          (unsigned long)totalCommandAllocations, (unsigned long)commands);
+    for (int i = 0; i < taskCount && length < (int)size; i++) {
+        length += snprintf(buffer + length, size - length, "%s%s:%lu/%lu", i == 0 ? "" : ";", tasks[i].name,
+                           (unsigned long)tasks[i].minFreeBytes, (unsigned long)tasks[i].stackBytes);
+    }
+    return length;
+}
+
+int ResourceMonitor::formatStackFree(char* buffer, size_t size) const {
+    int length = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < taskCount && length < (int)size; i++) {
+        length += snprintf(buffer + length, size - length, i == 0 ? "%lu" : "/%lu",
+                           (unsigned long)tasks[i].minFreeBytes);
+    }
+    return length;
+}
@@ -0,0 +1,72 @@
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#include <Arduino.h>
+
+const int MAX_WATCHED_TASKS = 4;
+const unsigned long RESOURCE_SAMPLE_MS = 1000;
+
+struct TaskStackUsage {
+    const char* name;
+    TaskHandle_t handle;
+    uint32_t stackBytes;
+    uint32_t minFreeBytes;      // high-water mark, stack never touched so far
+};
+
+struct HeapUsage {
+    uint32_t freeBytes;
+    uint32_t largestBlock;
+    uint32_t minFreeBytes;      // lowest free heap since boot
+    uint8_t fragmentation;      // percent of the free heap outside the largest block
+    uint8_t maxFragmentation;
+};
+
+// Heap and stack budget of the firmware. Samples are taken by the network
+// task, which is also the one whose allocations are counted: the firmware
+// build wraps malloc (see RESOURCE_COUNT_ALLOCATIONS in platformio.ini) and
+// every command handled is charged what it allocated on the way.
+class ResourceMonitor {
+public:
+    ResourceMonitor();
+
+    bool watchTask(const char* name, TaskHandle_t handle, uint32_t stackBytes);
+
+    // Allocations by this task are counted from here on
+    void countAllocations(TaskHandle_t task);
+
+    // Samples once RESOURCE_SAMPLE_MS went by since the last sample
+    void update(unsigned long now);
+    void sample();
+
+    // Around the handling of one command
+    void beginCommand();
+    void endCommand();
+
+    HeapUsage getHeap() const { return heap; }
+    int getTaskCount() const { return taskCount; }
+    const TaskStackUsage& getTask(int i) const { return tasks[i]; }
+    uint32_t getLastCommandAllocations() const { return lastCommandAllocations; }
+    uint32_t getMaxCommandAllocations() const { return maxCommandAllocations; }
+
+    // "heap=<free>,largest=<bytes>,minHeap=<bytes>,frag=<%>,maxFrag=<%>,
+    // allocs=<last>/<max>/<total>/<commands>,stack=<name>:<free>/<size>;..."
+    int format(char* buffer, size_t size) const;
+
+    // Stack high-water marks alone, "<free>/<free>/..." in watch order
+    int formatStackFree(char* buffer, size_t size) const;
+
+private:
+    TaskStackUsage tasks[MAX_WATCHED_TASKS];
+    volatile int taskCount;
+    HeapUsage heap;
+    unsigned long lastSampleMs;
+    bool sampled;
+
+    uint32_t commandStartCount;
+    uint32_t lastCommandAllocations;
+    uint32_t maxCommandAllocations;
+    uint32_t totalCommandAllocations;
+    uint32_t commands;
+};
+
+#endif
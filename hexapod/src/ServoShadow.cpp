@@ -0,0 +1,63 @@
+#include "ServoShadow.h"
+#include "InputLog.h"
+
+
+ServoShadow::ServoShadow(JointArena& jointArena) : arena(jointArena), moveCount(0) {}
+
+void ServoShadow::move(int id, int32_t target, int time, int32_t unposed) {
+    unsigned long now = inputClock();
+
+    arena.start[id] = arena.known[id] ? estimate(id, now) : target;
+    arena.target[id] = target;
+    arena.unposed[id] = unposed < 0 ? target : unposed;
+    arena.commandMs[id] = now;
+    arena.durationMs[id] = time;
+    arena.sequence[id] = ++moveCount;
+    arena.known[id] = true;
+
+    inputServoMove(id, target, time);
+    arena.servo(id).move_time(target, time);
+}
+
+int32_t ServoShadow::read(int id) {
+    int32_t position = inputServoRead(id, arena.servo(id).pos_read());
+    if (position < 0 || position > SERVO_POSITION_MAX) {
+        return -1;
+    }
+
+    arena.measured[id] = position;
+    arena.measuredMs[id] = inputClock();
+    return position;
+}
+
+void ServoShadow::sync() {
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        int32_t position = read(i);
+        if (position < 0) {
+            continue;
+        }
+        arena.target[i] = position;
+        arena.unposed[i] = position;
+        arena.start[i] = position;
+        arena.commandMs[i] = inputClock();
+        arena.durationMs[i] = 0;
+        arena.known[i] = true;
+    }
+}
+
+int32_t ServoShadow::estimate(int id, unsigned long now) const {
+    unsigned long elapsed = now - arena.commandMs[id];
+    int duration = arena.durationMs[id];
+    if (duration <= 0 || elapsed >= (unsigned long)duration) {
+        return arena.target[id];
+    }
+    return arena.start[id] + (arena.target[id] - arena.start[id]) * (int32_t)elapsed / duration;
+}
+
+bool ServoShadow::isTargeting(int id, int32_t position, int32_t tolerance) const {
+    if (!arena.known[id]) {
+        return false;
+    }
+    int32_t error = arena.target[id] - position;
+    return error <= tolerance && error >= -tolerance;
+}
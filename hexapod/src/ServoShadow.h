@@ -0,0 +1,52 @@
+#ifndef SERVO_SHADOW_H
+#define SERVO_SHADOW_H
+
+#include <Arduino.h>
+#include <lx16a-servo.h>
+#include "JointArena.h"
+
+// LX-16A positions are centidegrees over a 240 degree range
+const int32_t SERVO_POSITION_MAX = 24000;
+
+// Remembers what every servo was last told to do, so the control loop can
+// tell where a joint should be without a round trip on the servo bus.
+// Every move should go through here to keep the shadow truthful. The
+// state itself lives in the joint arena.
+class ServoShadow {
+public:
+    ServoShadow(JointArena& jointArena);
+
+    // Moves issued under a body pose also pass the target the joint
+    // would have without it; by default the two are the same
+    void move(int id, int32_t target, int time, int32_t unposed = -1);
+
+    // Reads a servo position and records it; returns -1 if the read failed
+    int32_t read(int id);
+
+    // Reads every servo once, used to seed the shadow at boot
+    void sync();
+
+    bool isKnown(int id) const { return arena.known[id]; }
+
+    // Counts every move; a joint whose sequence is above an earlier count
+    // was commanded since then
+    uint32_t getMoveCount() const { return moveCount; }
+    void restoreMoveCount(uint32_t count) { moveCount = count; }
+    uint32_t sequence(int id) const { return arena.sequence[id]; }
+    int32_t target(int id) const { return arena.target[id]; }
+    int32_t unposedTarget(int id) const { return arena.unposed[id]; }
+    unsigned long arrivalMs(int id) const { return arena.commandMs[id] + arena.durationMs[id]; }
+    int duration(int id) const { return arena.durationMs[id]; }
+
+    // Where the joint should be now, interpolated along its last move
+    int32_t estimate(int id, unsigned long now) const;
+
+    // True when the joint has been commanded to within tolerance of position
+    bool isTargeting(int id, int32_t position, int32_t tolerance) const;
+
+private:
+    JointArena& arena;
+    uint32_t moveCount;
+};
+
+#endif
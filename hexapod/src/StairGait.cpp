@@ -0,0 +1,271 @@
+#include "StairGait.h"
+#include "Constants.h"
+#include "Logger.h"
+
+// The leg in front of each leg on the same side, -1 for the front legs
+const int LEG_AHEAD[6] = {-1, 0, 3, -1, 9, 12};
+
+
+StairGait::StairGait(LX16ABus& bus, ServoShadow& servoShadow,
+                     TerrainMap& terrainMap, PoseController& bodyPose, ImuReader& imuReader)
+    : Gait(bus, servoShadow, terrainMap, bodyPose), imu(imuReader), bodyHeight(0), bodyPitch(0),
+      stanceUp(0), orderIndex(0), holdCount(0), holding(false), halted(false), stepsClimbed(0),
+      swingLeg(-1), plannedGround(0), swingHeight(0), watching(false), touched(false),
+      contactTicks(0), touchdownHeight(0) {
+    for (int i = 0; i < 6; i++) {
+        groundHeight[i] = 0;
+    }
+}
+
+bool StairGait::supports(GaitMotion candidate) {
+    return candidate == WALK_FORWARD;
+}
+
+void StairGait::begin(bool flat) {
+    if (flat) {
+        for (int i = 0; i < 6; i++) {
+            groundHeight[i] = 0;
+        }
+        bodyHeight = 0;
+        bodyPitch = 0;
+        orderIndex = 0;
+    }
+    stanceUp = legStanceFoot().up;
+    holdCount = 0;
+    halted = false;
+}
+
+bool StairGait::isOnStep() const {
+    for (int i = 1; i < 6; i++) {
+        if (fabs(groundHeight[i] - groundHeight[0]) > STAIR_LEVEL_TOLERANCE) {
+            return true;
+        }
+    }
+    return fabs(bodyPitch) > 1.0f;
+}
+
+// Foot height relative to its hip that puts it on the given ground
+float StairGait::footUp(int base, float ground) const {
+    float hip = bodyHeight + LEG_MOUNT_X[base / 3] * sin(radians(bodyPitch));
+    return stanceUp + ground - hip;
+}
+
+// Ground height under a foot. The IMU pitch is used when there is one, so
+// a body that tipped does not look like a step.
+float StairGait::groundUnder(int base, const FootPosition& foot) const {
+    float pitch = imu.isConnected() ? imu.getPitch() : bodyPitch;
+    float hip = bodyHeight + LEG_MOUNT_X[base / 3] * sin(radians(pitch));
+    return hip + foot.up - stanceUp;
+}
+
+bool StairGait::placeLeg(int base, int32_t coxa, float up, int time) {
+    FootPosition foot = legForward(base, coxa, FEMUR_DOWN, TIBIA_DOWN);
+    foot.up = up;
+
+    JointTargets targets;
+    if (!legInverse(base, foot, targets)) {
+        return false;
+    }
+    moveLeg(base, targets.coxa, targets.femur, targets.tibia, time);
+    return true;
+}
+
+bool StairGait::hasSupport(int swingBase) {
+    for (int base = 0; base < 18; base += 3) {
+        if (base != swingBase && !isLegOnGround(base)) {
+            logPrintf("Stairs: leg %d has no contact, holding", base);
+            return false;
+        }
+    }
+    if (imu.isConnected() && (fabs(imu.getPitch() - bodyPitch) > STAIR_PITCH_ALARM ||
+                              fabs(imu.getRoll()) > STAIR_PITCH_ALARM)) {
+        logPrintf("Stairs: body at pitch %.1f roll %.1f, planned %.1f, holding",
+                  imu.getPitch(), imu.getRoll(), bodyPitch);
+        return false;
+    }
+    return true;
+}
+
+void StairGait::planBody() {
+    float sum = 0;
+    for (int i = 0; i < 6; i++) {
+        sum += groundHeight[i];
+    }
+    bodyHeight = sum / 6;
+
+    float front = (groundHeight[0] + groundHeight[3]) / 2;
+    float rear = (groundHeight[2] + groundHeight[5]) / 2;
+    float span = LEG_MOUNT_X[0] - LEG_MOUNT_X[2];
+    float pitch = degrees(atan2(front - rear, span));
+    bodyPitch = constrain(pitch, -STAIR_MAX_BODY_PITCH, STAIR_MAX_BODY_PITCH);
+}
+
+// Every foot keeps its spot on the ground while the body moves forward
+// and settles to the planned height and pitch
+bool StairGait::shiftBody(int time) {
+    for (int base = 0; base < 18; base += 3) {
+        int32_t coxa = shadow.unposedTarget(base);
+        if (base != swingLeg) {
+            int32_t shift = isRightSide(base) ? STAIR_PUSH_DELTA : -STAIR_PUSH_DELTA;
+            coxa = constrain(coxa + shift, COXA_FORWARD, COXA_BACKWARD);
+        }
+        if (!placeLeg(base, coxa, footUp(base, groundHeight[base / 3]), time)) {
+            logPrintf("Stairs: leg %d can not reach its foothold", base);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Once all feet are on one level again the step is done and the profile
+// starts over from there
+void StairGait::rebaseIfLevel() {
+    float level = groundHeight[0];
+    for (int i = 1; i < 6; i++) {
+        if (fabs(groundHeight[i] - level) > STAIR_LEVEL_TOLERANCE) {
+            return;
+        }
+    }
+    if (fabs(level) < STAIR_EDGE_HEIGHT) {
+        return;
+    }
+
+    if (level > 0) {
+        stepsClimbed++;
+    }
+    logPrintf("Stairs: all feet %s %.0f mm, step %d done", level > 0 ? "up" : "down",
+              fabs(level), stepsClimbed);
+    for (int i = 0; i < 6; i++) {
+        groundHeight[i] -= level;
+    }
+    bodyHeight -= level;
+}
+
+int StairGait::halt(const char* reason) {
+    logPrintf("Stairs: halted, %s", reason);
+    halted = true;
+    watching = false;
+    return -1;
+}
+
+// Six phases per cycle, each cycle steps one leg
+int StairGait::runPhase(int phase) {
+    int base = STAIR_ORDER[orderIndex];
+    int leg = base / 3;
+
+    switch (phase) {
+        case 0: {
+            holding = !hasSupport(base);
+            if (holding) {
+                if (++holdCount >= STAIR_HOLD_RETRIES) {
+                    return halt("support did not come back");
+                }
+                return STAIR_HOLD_TIME;
+            }
+            holdCount = 0;
+            swingLeg = base;
+            touched = false;
+
+            // Clear the highest ground known in front of this foot; a
+            // front foot has nothing ahead of it and searches high
+            int ahead = LEG_AHEAD[leg];
+            plannedGround = ahead < 0 ? groundHeight[leg] : max(groundHeight[leg], groundHeight[ahead / 3]);
+            float clearance = ahead < 0 ? STAIR_SEARCH_HEIGHT : STAIR_CLEARANCE;
+
+            // Lift as high as the leg reaches, down to a plain step height
+            for (swingHeight = plannedGround + clearance; swingHeight >= plannedGround + STAIR_CLEARANCE / 2;
+                 swingHeight -= 10) {
+                if (placeLeg(base, shadow.unposedTarget(base), footUp(base, swingHeight), STAIR_LIFT_TIME)) {
+                    logPrintf("Stairs: lifting leg %d to %.0f mm", base, swingHeight);
+                    return phaseTime(STAIR_LIFT_TIME, timing.liftDelay);
+                }
+            }
+            return halt("swing leg can not clear the step");
+        }
+
+        case 1: {
+            if (holding) {
+                return -1;
+            }
+            int32_t coxa = isRightSide(base) ? COXA_FORWARD : COXA_BACKWARD;
+            if (!placeLeg(base, coxa, footUp(base, swingHeight), STAIR_SWING_TIME)) {
+                return halt("swing out of reach");
+            }
+            return phaseTime(STAIR_SWING_TIME, timing.swingDelay);
+        }
+
+        case 2:
+            if (!placeLeg(base, shadow.unposedTarget(base), footUp(base, plannedGround + STAIR_PRESHAPE_MARGIN),
+                          STAIR_LOWER_TIME)) {
+                return halt("can not reach down to the step");
+            }
+            contactTicks = 0;
+            watching = !isLegOnGround(base);
+            return phaseTime(STAIR_LOWER_TIME, timing.lowerDelay);
+
+        case 3: {
+            if (!watching) {
+                return 0;
+            }
+            // Search below the plan for a step down, as far as the leg goes
+            float bottom = plannedGround - STAIR_PROBE_DEPTH;
+            for (; bottom < plannedGround; bottom += 10) {
+                if (placeLeg(base, shadow.unposedTarget(base), footUp(base, bottom), STAIR_PROBE_TIME)) {
+                    return phaseTime(STAIR_PROBE_TIME, 0);
+                }
+            }
+            return 0;
+        }
+
+        case 4: {
+            float previous = groundHeight[leg];
+            float landed = touched ? touchdownHeight
+                                   : groundUnder(base, legForward(base, shadow.unposedTarget(base), shadow.unposedTarget(base + 1),
+                                                                  shadow.unposedTarget(base + 2)));
+            if (!touched) {
+                logPrintf("Stairs: leg %d found no ground, assuming %.0f mm", base, landed);
+            }
+            watching = false;
+            groundHeight[leg] = landed;
+
+            if (landed - previous > STAIR_EDGE_HEIGHT) {
+                logPrintf("Stairs: step edge up at leg %d, %.0f mm", base, landed - previous);
+            } else if (previous - landed > STAIR_EDGE_HEIGHT) {
+                logPrintf("Stairs: step edge down at leg %d, %.0f mm", base, previous - landed);
+            }
+
+            planBody();
+            if (!shiftBody(STAIR_SHIFT_TIME)) {
+                return halt("body shift out of reach");
+            }
+            return phaseTime(STAIR_SHIFT_TIME, timing.swingDelay);
+        }
+
+        default:
+            swingLeg = -1;
+            orderIndex = (orderIndex + 1) % 6;
+            rebaseIfLevel();
+            return -1;
+    }
+}
+
+bool StairGait::phaseSettled(unsigned long now) {
+    if (!watching) {
+        return false;
+    }
+
+    int base = swingLeg;
+    if (!isLegOnGround(base)) {
+        contactTicks = 0;
+        return false;
+    }
+    if (++contactTicks < TERRAIN_CONTACT_TICKS) {
+        return false;
+    }
+
+    JointTargets frozen = freezeLeg(base, now);
+    touchdownHeight = groundUnder(base, legForward(base, shadow.unposedTarget(base), frozen.femur, frozen.tibia));
+    touched = true;
+    watching = false;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef STAIR_GAIT_H
+#define STAIR_GAIT_H
+
+#include "Gait.h"
+#include "ImuReader.h"
+#include "LegKinematics.h"
+
+// Climbs steps one leg at a time, so five feet always carry the body.
+// Each cycle moves the next leg in STAIR_ORDER: it is lifted clear of the
+// highest ground known in front of it, swung forward, lowered until its
+// switch closes and its touchdown height recorded. The body then follows:
+// its height tracks the mean ground height and its pitch the slope
+// between front and rear feet, both placed through leg IK. A cycle only
+// starts while the other five legs have contact and the IMU agrees with
+// the planned body pitch.
+class StairGait : public Gait {
+public:
+    StairGait(LX16ABus& bus, ServoShadow& servoShadow,
+              TerrainMap& terrainMap, PoseController& bodyPose, ImuReader& imuReader);
+
+    bool supports(GaitMotion candidate) override;
+
+    // Called when climbing starts; a flat start forgets the step profile,
+    // otherwise the climb resumes from the pose it stopped in
+    void begin(bool flat);
+
+    // Set when the climb can not go on safely, the pose is held
+    bool isHalted() const { return halted; }
+
+    // True while the feet are on different levels and a flat stance
+    // would drop the body off the step
+    bool isOnStep() const;
+
+    int getStepsClimbed() const { return stepsClimbed; }
+    float getBodyPitch() const { return bodyPitch; }
+    float getBodyHeight() const { return bodyHeight; }
+
+protected:
+    int runPhase(int phase) override;
+    bool phaseSettled(unsigned long now) override;
+
+private:
+    ImuReader& imu;
+
+    // Ground under each foot in mm, relative to where the climb started
+    float groundHeight[6];
+    float bodyHeight;
+    float bodyPitch;
+    float stanceUp;
+
+    int orderIndex;
+    int holdCount;
+    bool holding;
+    bool halted;
+    int stepsClimbed;
+
+    // Leg currently stepping and what is known about its landing
+    int swingLeg;
+    float plannedGround;
+    float swingHeight;
+    bool watching;
+    bool touched;
+    int contactTicks;
+    float touchdownHeight;
+
+    bool hasSupport(int swingBase);
+    float footUp(int base, float ground) const;
+    float groundUnder(int base, const FootPosition& foot) const;
+    bool placeLeg(int base, int32_t coxa, float up, int time);
+    bool shiftBody(int time);
+    void planBody();
+    void rebaseIfLevel();
+    int halt(const char* reason);
+};
+
+#endif
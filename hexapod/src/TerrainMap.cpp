@@ -0,0 +1,72 @@
+#include "TerrainMap.h"
+#include "Constants.h"
+
+
+TerrainMap::TerrainMap() {
+    reset();
+}
+
+void TerrainMap::reset() {
+    for (int i = 0; i < 6; i++) {
+        height[i] = 0;
+        misses[i] = 0;
+    }
+}
+
+void TerrainMap::recordTouchdown(int base, int32_t femur) {
+    int leg = base / 3;
+    // Back into ground coordinates, the command included the body offset
+    int32_t measured = femur - FEMUR_DOWN + getBodyOffset();
+    measured = constrain(measured, -TERRAIN_MAX_HEIGHT, TERRAIN_MAX_HEIGHT);
+    height[leg] += (int32_t)(TERRAIN_GAIN * (measured - height[leg]));
+    misses[leg] = 0;
+}
+
+void TerrainMap::recordMiss(int base, int32_t femur) {
+    int leg = base / 3;
+    if (misses[leg] < TERRAIN_MISS_LIMIT) {
+        misses[leg]++;
+    }
+    if (!isSwitchTrusted(base)) {
+        height[leg] = 0;
+        return;
+    }
+    // The ground is at least this low, next time start probing from there
+    int32_t measured = femur - FEMUR_DOWN + getBodyOffset();
+    if (measured < height[leg]) {
+        height[leg] = constrain(measured, -TERRAIN_MAX_HEIGHT, TERRAIN_MAX_HEIGHT);
+    }
+}
+
+void TerrainMap::restore(int base, int32_t legHeight, uint8_t legMisses) {
+    height[base / 3] = legHeight;
+    misses[base / 3] = legMisses;
+}
+
+bool TerrainMap::isSwitchTrusted(int base) const {
+    return misses[base / 3] < TERRAIN_MISS_LIMIT;
+}
+
+int32_t TerrainMap::getBodyOffset() const {
+    int32_t sum = 0;
+    for (int i = 0; i < 6; i++) {
+        sum += height[i];
+    }
+    return sum / 6;
+}
+
+int32_t TerrainMap::stanceFemur(int base) const {
+    int32_t femur = FEMUR_DOWN + height[base / 3] - getBodyOffset();
+    return constrain(femur, FEMUR_DOWN - TERRAIN_MAX_REACH, FEMUR_UP);
+}
+
+int32_t TerrainMap::preshapeFemur(int base) const {
+    if (!isSwitchTrusted(base)) {
+        return stanceFemur(base);
+    }
+    return min(stanceFemur(base) + TERRAIN_PRESHAPE_MARGIN, FEMUR_UP);
+}
+
+int32_t TerrainMap::probeFemur(int base) const {
+    return max(stanceFemur(base) - TERRAIN_PROBE_RANGE, FEMUR_DOWN - TERRAIN_MAX_REACH);
+}
@@ -0,0 +1,48 @@
+#ifndef TERRAIN_MAP_H
+#define TERRAIN_MAP_H
+
+#include <Arduino.h>
+
+
+// Per-leg ground height estimate built from where each foot touched down.
+// Heights are femur centidegrees relative to FEMUR_DOWN, positive where
+// the ground is higher. The gaits lower each foot quickly to just above
+// its estimate and only probe slowly for the last bit, and the stance is
+// shifted by the mean height so the body keeps its clearance.
+class TerrainMap {
+public:
+    TerrainMap();
+
+    void reset();
+
+    // A foot touched down with the femur at the given position
+    void recordTouchdown(int base, int32_t femur);
+
+    // A foot reached the bottom of its probe without contact
+    void recordMiss(int base, int32_t femur);
+
+    // Switches that keep missing are ignored and the leg is placed blind
+    bool isSwitchTrusted(int base) const;
+
+    // Femur position to hold while the leg is in stance
+    int32_t stanceFemur(int base) const;
+
+    // Where the fast part of lowering stops, just above the estimate
+    int32_t preshapeFemur(int base) const;
+
+    // Lowest position the probe may reach
+    int32_t probeFemur(int base) const;
+
+    int32_t getHeight(int base) const { return height[base / 3]; }
+    uint8_t getMisses(int base) const { return misses[base / 3]; }
+
+    // Puts a leg's estimate back as a keyframe of the input log held it
+    void restore(int base, int32_t legHeight, uint8_t legMisses);
+    int32_t getBodyOffset() const;
+
+private:
+    int32_t height[6];
+    uint8_t misses[6];
+};
+
+#endif
@@ -1,200 +1,39 @@
 #include "TripodGait.h"
 
-
-TripodGait::TripodGait(LX16ABus& bus, LX16AServo** servoArray)
-    : Gait(bus, servoArray) {}
-
-int32_t TripodGait::applyCoxaOffset(int32_t basePosition, int leg) {
-    int32_t offset = isRightSide(leg) ? RIGHT_SIDE_COXA_OFFSET : LEFT_SIDE_COXA_OFFSET;
-    return basePosition + offset;
-}
-
-void TripodGait::move() {
-    Serial.println("Lifting Tripod 1");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, LIFT_TIME);
-    }
-    delay(LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Swinging Tripod 1 & Pushing Tripod 2");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_FORWARD : COXA_BACKWARD;
-        moveLeg(leg, coxa, FEMUR_UP, TIBIA_UP, MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_BACKWARD : COXA_FORWARD;
-        moveLeg(leg, coxa, FEMUR_DOWN, TIBIA_DOWN, MOVE_TIME);
-    }
-    delay(MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 1");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_DOWN, TIBIA_DOWN, LOWER_TIME);
-    }
-    delay(LOWER_TIME + 100);
-
-
-    Serial.println("Lifting Tripod 2");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, LIFT_TIME);
-    }
-    delay(LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Swinging Tripod 2 & Pushing Tripod 1");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_FORWARD : COXA_BACKWARD;
-        moveLeg(leg, coxa, FEMUR_UP, TIBIA_UP, MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_BACKWARD : COXA_FORWARD;
-        moveLeg(leg, coxa, FEMUR_DOWN, TIBIA_DOWN, MOVE_TIME);
-    }
-    delay(MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 2");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_DOWN, TIBIA_DOWN, LOWER_TIME);
-    }
-    delay(LOWER_TIME + 100);
-}
-
-void TripodGait::moveBackward() {
-    Serial.println("Lifting Tripod 1 (backward)");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, LIFT_TIME);
-    }
-    delay(LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Swinging Tripod 1 Backward & Pushing Tripod 2 Backward");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_BACKWARD : COXA_FORWARD;
-        moveLeg(leg, coxa, FEMUR_UP, TIBIA_UP, MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_FORWARD : COXA_BACKWARD;
-        moveLeg(leg, coxa, FEMUR_DOWN, TIBIA_DOWN, MOVE_TIME);
-    }
-    delay(MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 1 (backward)");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_DOWN, TIBIA_DOWN, LOWER_TIME);
-    }
-    delay(LOWER_TIME + 100);
-
-    Serial.println("Lifting Tripod 2 (backward)");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, LIFT_TIME);
-    }
-    delay(LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Swinging Tripod 2 Backward & Pushing Tripod 1 Backward");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_BACKWARD : COXA_FORWARD;
-        moveLeg(leg, coxa, FEMUR_UP, TIBIA_UP, MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int coxa = isRightSide(leg) ? COXA_FORWARD : COXA_BACKWARD;
-        moveLeg(leg, coxa, FEMUR_DOWN, TIBIA_DOWN, MOVE_TIME);
-    }
-    delay(MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 2 (backward)");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_DOWN, TIBIA_DOWN, LOWER_TIME);
-    }
-    delay(LOWER_TIME + 100);
+// TRIPOD1_LEGS, then TRIPOD2_LEGS
+constexpr uint8_t TRIPOD_GROUPS[] = {
+    legBit(0) | legBit(12) | legBit(6),
+    legBit(15) | legBit(3) | legBit(9)
+};
+
+// One tripod swings while the other pushes, then they swap. The swing
+// tripod is lowered onto its terrain estimate and then probes for ground
+// contact.
+constexpr StepPhase TRIPOD_WALK_STEP[] = {
+    {PHASE_LIFT,  false, &GaitTiming::liftTime,  &GaitTiming::liftDelay},
+    {PHASE_SWING, true,  &GaitTiming::swingTime, &GaitTiming::swingDelay},
+    {PHASE_LOWER, false, &GaitTiming::lowerTime, &GaitTiming::lowerDelay},
+    {PHASE_PROBE, false, NULL,                   NULL},
+};
+
+// Same alternation for turning; the swing tripod turns towards the new
+// heading while the stance tripod pushes the body round
+constexpr StepPhase TRIPOD_TURN_STEP[] = {
+    {PHASE_LIFT,  false, &GaitTiming::rotateLiftTime,  &GaitTiming::liftDelay},
+    {PHASE_SWING, true,  &GaitTiming::rotateSwingTime, &GaitTiming::swingDelay},
+    {PHASE_PLANT, false, &GaitTiming::rotatePlantTime, &GaitTiming::rotateLowerDelay},
+};
+
+constexpr GaitDescription TRIPOD_WALK = {"Tripod", TRIPOD_WALK_STEP, countOf(TRIPOD_WALK_STEP),
+                                       TRIPOD_GROUPS, countOf(TRIPOD_GROUPS)};
+constexpr GaitDescription TRIPOD_TURN = {"Tripod", TRIPOD_TURN_STEP, countOf(TRIPOD_TURN_STEP),
+                                       TRIPOD_GROUPS, countOf(TRIPOD_GROUPS)};
+
+
+TripodGait::TripodGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+                       PoseController& bodyPose)
+    : Gait(bus, servoShadow, terrainMap, bodyPose) {}
+
+const GaitDescription* TripodGait::describe(GaitMotion candidate) const {
+    return isTurn(candidate) ? &TRIPOD_TURN : &TRIPOD_WALK;
 }
-
-
-void TripodGait::rotateInPlace(Direction dir) {
-    Serial.println("Lifting Tripod 1 for rotation");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, ROTATE_LIFT_TIME);
-    }
-    delay(ROTATE_LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Rotating Tripod 1 & Pushing Tripod 2");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int32_t targetCoxa;
-        if (dir == LEFT) {
-            targetCoxa = COXA_ROTATE_FORWARD;
-        } else {
-            targetCoxa = COXA_ROTATE_BACKWARD;
-        }
-        moveLeg(leg, targetCoxa, FEMUR_UP, TIBIA_UP, ROTATE_MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int32_t pushCoxa;
-        if (dir == LEFT) {
-            pushCoxa = COXA_ROTATE_BACKWARD;
-        } else {
-            pushCoxa = COXA_ROTATE_FORWARD;
-        }
-        moveLeg(leg, pushCoxa, FEMUR_STANCE_ROTATE, TIBIA_STANCE_ROTATE, ROTATE_MOVE_TIME);
-    }
-    delay(ROTATE_MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 1");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_STANCE_ROTATE, TIBIA_STANCE_ROTATE, ROTATE_LOWER_TIME);
-    }
-    delay(ROTATE_LOWER_TIME + 100);
-
-    Serial.println("Lifting Tripod 2 for rotation");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, ROTATE_LIFT_TIME);
-    }
-    delay(ROTATE_LIFT_TIME + SHORT_DELAY);
-
-    Serial.println("Rotating Tripod 2 & Pushing Tripod 1");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        int32_t targetCoxa;
-        if (dir == LEFT) {
-            targetCoxa = COXA_ROTATE_FORWARD;
-        } else {
-            targetCoxa = COXA_ROTATE_BACKWARD;
-        }
-        moveLeg(leg, targetCoxa, FEMUR_UP, TIBIA_UP, ROTATE_MOVE_TIME);
-    }
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD1_LEGS[i];
-        int32_t pushCoxa;
-        if (dir == LEFT) {
-            pushCoxa = COXA_ROTATE_BACKWARD;
-        } else {
-            pushCoxa = COXA_ROTATE_FORWARD;
-        }
-        moveLeg(leg, pushCoxa, FEMUR_STANCE_ROTATE, TIBIA_STANCE_ROTATE, ROTATE_MOVE_TIME);
-    }
-    delay(ROTATE_MOVE_TIME + SHORT_DELAY);
-
-    Serial.println("Lowering Tripod 2");
-    for (int i = 0; i < 3; i++) {
-        int leg = TRIPOD2_LEGS[i];
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_STANCE_ROTATE, TIBIA_STANCE_ROTATE, ROTATE_LOWER_TIME);
-    }
-    delay(ROTATE_LOWER_TIME + 100);
-}
\ No newline at end of file
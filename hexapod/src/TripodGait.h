@@ -7,16 +7,11 @@
 
 class TripodGait : public Gait {
 public:
-    TripodGait(LX16ABus& bus, LX16AServo** servoArray);
+    TripodGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+               PoseController& bodyPose);
 
-    void move() override;
-    
-    void moveBackward() override;
-
-    void rotateInPlace(Direction dir);
-
-private:
-    int32_t applyCoxaOffset(int32_t basePosition, int leg);
+protected:
+    const GaitDescription* describe(GaitMotion candidate) const override;
 };
 
 #endif
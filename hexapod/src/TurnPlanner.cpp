@@ -0,0 +1,83 @@
+#include "TurnPlanner.h"
+#include "Constants.h"
+#include "Logger.h"
+
+// Weight of the latest cycle when updating the degrees per cycle estimate
+const float TURN_LEARN_RATE = 0.3f;
+
+
+static float wrapDegrees(float degrees) {
+    while (degrees > 180) degrees -= 360;
+    while (degrees < -180) degrees += 360;
+    return degrees;
+}
+
+TurnPlanner::TurnPlanner()
+    : active(false), useImu(false), reversed(false), angle(0), turned(0), lastYaw(0), lastStep(0),
+      degreesPerCycle(ROTATE_DEGREES_PER_CYCLE), stepsLeft(0) {}
+
+void TurnPlanner::begin(float yaw, float turnAngle, bool imu) {
+    active = true;
+    useImu = imu;
+    reversed = false;
+    angle = turnAngle;
+    turned = 0;
+    lastYaw = yaw;
+    lastStep = 0;
+    stepsLeft = (int)ceil(fabs(angle) / degreesPerCycle) + ROTATE_EXTRA_STEPS;
+
+    logPrintf("Turn %.1f deg: about %.1f cycles at %.1f deg/cycle", angle,
+              fabs(angle) / degreesPerCycle, degreesPerCycle);
+}
+
+float TurnPlanner::nextStep(float yaw) {
+    if (!active) {
+        return 0;
+    }
+
+    if (lastStep != 0) {
+        if (useImu) {
+            float measured = wrapDegrees(yaw - lastYaw);
+            turned += measured;
+
+            if (measured * lastStep < 0 && fabs(measured) > ROTATE_TOLERANCE) {
+                logPrintf("Turn aborted: a step of %.2f turned %.1f deg the other way", lastStep, measured);
+                reversed = true;
+                active = false;
+                lastStep = 0;
+                return 0;
+            }
+
+            // Only learn from steps big enough to measure reliably
+            float rate = measured / lastStep;
+            if (fabs(lastStep) >= 0.5f && rate > ROTATE_DEGREES_PER_CYCLE / 2 &&
+                rate < ROTATE_DEGREES_PER_CYCLE * 2) {
+                degreesPerCycle += TURN_LEARN_RATE * (rate - degreesPerCycle);
+            }
+        } else {
+            turned += lastStep * degreesPerCycle;
+        }
+    }
+    lastYaw = yaw;
+
+    float remaining = angle - turned;
+    float smallest = ROTATE_MIN_STEP * degreesPerCycle;
+
+    // Done once inside the tolerance, or when even the smallest step
+    // would overshoot by more than is left
+    if (fabs(remaining) <= ROTATE_TOLERANCE || fabs(remaining) < smallest / 2 || stepsLeft <= 0) {
+        logPrintf("Turn done: %.1f of %.1f deg, %.1f deg off", turned, angle, remaining);
+        active = false;
+        lastStep = 0;
+        return 0;
+    }
+
+    float step = constrain(remaining / degreesPerCycle, -1.0f, 1.0f);
+    if (fabs(step) < ROTATE_MIN_STEP) {
+        step = step > 0 ? ROTATE_MIN_STEP : -ROTATE_MIN_STEP;
+    }
+
+    stepsLeft--;
+    lastStep = step;
+    return step;
+}
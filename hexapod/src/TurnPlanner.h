@@ -0,0 +1,43 @@
+#ifndef TURN_PLANNER_H
+#define TURN_PLANNER_H
+
+#include <Arduino.h>
+
+
+// Plans a turn by a given angle as a series of rotate cycles. Full cycles
+// cover most of it and a partial last cycle the rest; after every cycle
+// the remainder is measured from IMU yaw and corrected until it is within
+// ROTATE_TOLERANCE. The degrees turned per cycle are learned as it goes,
+// since they depend on the floor. A cycle the IMU sees turning the other
+// way ends the plan rather than chasing the target further away.
+class TurnPlanner {
+public:
+    TurnPlanner();
+
+    // Angle in degrees, positive counterclockwise. Without the IMU the
+    // plan runs open loop from the per-cycle estimate.
+    void begin(float yaw, float angle, bool useImu);
+
+    // Called between cycles. Returns the next step as a signed fraction
+    // of a full rotate cycle, positive counterclockwise, or 0 when done.
+    float nextStep(float yaw);
+
+    bool isActive() const { return active; }
+    // Set when the last plan ended on a cycle that turned against its step
+    bool wasReversed() const { return reversed; }
+    float getRemaining() const { return angle - turned; }
+    float getDegreesPerCycle() const { return degreesPerCycle; }
+
+private:
+    bool active;
+    bool useImu;
+    bool reversed;
+    float angle;
+    float turned;
+    float lastYaw;
+    float lastStep;
+    float degreesPerCycle;
+    int stepsLeft;
+};
+
+#endif
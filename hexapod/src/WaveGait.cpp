@@ -1,59 +1,29 @@
 #include "WaveGait.h"
 #include "Constants.h"
 
-WaveGait::WaveGait(LX16ABus& bus, LX16AServo** servoArray)
-    : Gait(bus, servoArray) {}
+// One leg at a time, in the order of WAVE_ORDER
+constexpr uint8_t WAVE_GROUPS[] = {
+    legBit(0), legBit(3), legBit(6), legBit(9), legBit(12), legBit(15)
+};
+
+// Lift, swing, lower, probe for the ground, then shift the body over the
+// five legs that stayed down
+constexpr StepPhase WAVE_STEP[] = {
+    {PHASE_LIFT,  false, &GaitTiming::waveLiftTime,  &GaitTiming::waveDelay},
+    {PHASE_SWING, false, &GaitTiming::waveSwingTime, &GaitTiming::waveDelay},
+    {PHASE_LOWER, false, &GaitTiming::waveLowerTime, &GaitTiming::waveDelay},
+    {PHASE_PROBE, false, NULL,                       NULL},
+    {PHASE_SHIFT, false, &GaitTiming::waveShiftTime, &GaitTiming::waveDelay},
+};
+
+constexpr GaitDescription WAVE_WALK = {"Leg", WAVE_STEP, countOf(WAVE_STEP),
+                                     WAVE_GROUPS, countOf(WAVE_GROUPS)};
 
-void WaveGait::move() {
-    for (int step = 0; step < 6; step++) {
-        int leg = WAVE_ORDER[step];
-        Serial.printf("Lifting Leg %d\n", leg);
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, FAST_LIFT_TIME);
-        delay(FAST_LIFT_TIME + FAST_DELAY);
-        int coxa_target = isRightSide(leg) ? COXA_FORWARD : COXA_BACKWARD;
-        Serial.printf("Swinging Forward Leg %d\n", leg);
-        moveLeg(leg, coxa_target, FEMUR_UP, TIBIA_UP, FAST_MOVE_TIME);
-        delay(FAST_MOVE_TIME + FAST_DELAY);
-        Serial.printf("Lowering Leg %d\n", leg);
-        moveLeg(leg, coxa_target, FEMUR_DOWN, TIBIA_DOWN, FAST_LOWER_TIME);
-        delay(FAST_LOWER_TIME + FAST_DELAY);
-        Serial.println("Shifting body forward");
-        for (int j = 0; j < 6; j++) {
-            int support_leg = WAVE_ORDER[j];
-            if (support_leg != leg) {
-                int32_t current_coxa = servos[support_leg]->pos_read();
-                int32_t shift = isRightSide(support_leg) ? BODY_PUSH_DELTA : -BODY_PUSH_DELTA;
-                int32_t new_coxa = constrain(current_coxa + shift, COXA_FORWARD, COXA_BACKWARD);
-                moveLeg(support_leg, new_coxa, FEMUR_DOWN, TIBIA_DOWN, FAST_PUSH_TIME);
-            }
-        }
-        delay(FAST_PUSH_TIME + FAST_DELAY);
-    }
-}
 
-void WaveGait::moveBackward() {
-    for (int step = 0; step < 6; step++) {
-        int leg = WAVE_ORDER[step];
-        Serial.printf("Lifting Leg %d (backward)\n", leg);
-        moveLeg(leg, servos[leg]->pos_read(), FEMUR_UP, TIBIA_UP, FAST_LIFT_TIME);
-        delay(FAST_LIFT_TIME + FAST_DELAY);
-        int coxa_target = isRightSide(leg) ? COXA_BACKWARD : COXA_FORWARD;
-        Serial.printf("Swinging Backward Leg %d\n", leg);
-        moveLeg(leg, coxa_target, FEMUR_UP, TIBIA_UP, FAST_MOVE_TIME);
-        delay(FAST_MOVE_TIME + FAST_DELAY);
-        Serial.printf("Lowering Leg %d (backward)\n", leg);
-        moveLeg(leg, coxa_target, FEMUR_DOWN, TIBIA_DOWN, FAST_LOWER_TIME);
-        delay(FAST_LOWER_TIME + FAST_DELAY);
-        Serial.println("Shifting body backward");
-        for (int j = 0; j < 6; j++) {
-            int support_leg = WAVE_ORDER[j];
-            if (support_leg != leg) {
-                int32_t current_coxa = servos[support_leg]->pos_read();
-                int32_t shift = isRightSide(support_leg) ? -BODY_PUSH_DELTA : BODY_PUSH_DELTA;
-                int32_t new_coxa = constrain(current_coxa + shift, COXA_FORWARD, COXA_BACKWARD);
-                moveLeg(support_leg, new_coxa, FEMUR_DOWN, TIBIA_DOWN, FAST_PUSH_TIME);
-            }
-        }
-        delay(FAST_PUSH_TIME + FAST_DELAY);
-    }
-}
\ No newline at end of file
+WaveGait::WaveGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+                   PoseController& bodyPose)
+    : Gait(bus, servoShadow, terrainMap, bodyPose) {}
+
+const GaitDescription* WaveGait::describe(GaitMotion candidate) const {
+    return isTurn(candidate) ? NULL : &WAVE_WALK;
+}
@@ -5,14 +5,11 @@
 
 class WaveGait : public Gait {
 public:
-    WaveGait(LX16ABus& bus, LX16AServo** servoArray);
-
-    void move() override;
-    
-    void moveBackward() override;
-
-private:
+    WaveGait(LX16ABus& bus, ServoShadow& servoShadow, TerrainMap& terrainMap,
+             PoseController& bodyPose);
 
+protected:
+    const GaitDescription* describe(GaitMotion candidate) const override;
 };
 
 #endif
@@ -0,0 +1,82 @@
+#include "WebSocket.h"
+
+#include <mbedtls/sha1.h>
+#include <mbedtls/base64.h>
+
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+
+bool webSocketAcceptKey(const char* clientKey, char* accept, size_t acceptSize) {
+    char combined[96];
+    int combinedLength = snprintf(combined, sizeof(combined), "%s%s", clientKey, WEBSOCKET_GUID);
+    if (combinedLength <= 0 || combinedLength >= (int)sizeof(combined)) {
+        return false;
+    }
+
+    unsigned char digest[20];
+    if (mbedtls_sha1_ret((const unsigned char*)combined, combinedLength, digest) != 0) {
+        return false;
+    }
+
+    size_t written = 0;
+    if (mbedtls_base64_encode((unsigned char*)accept, acceptSize - 1, &written, digest, sizeof(digest)) != 0) {
+        return false;
+    }
+    accept[written] = '\0';
+    return true;
+}
+
+int webSocketParseFrame(uint8_t* buffer, size_t length, size_t capacity, WebSocketFrame& frame) {
+    if (length < 2) {
+        return 0;
+    }
+
+    bool masked = (buffer[1] & 0x80) != 0;
+    size_t payloadLength = buffer[1] & 0x7F;
+    size_t headerLength = 2;
+
+    // Clients must mask every frame, and 64-bit lengths never fit the pool
+    if (!masked || payloadLength == 127) {
+        return -1;
+    }
+
+    if (payloadLength == 126) {
+        if (length < 4) {
+            return 0;
+        }
+        payloadLength = ((size_t)buffer[2] << 8) | buffer[3];
+        headerLength = 4;
+    }
+
+    size_t frameLength = headerLength + 4 + payloadLength;
+    if (frameLength > capacity) {
+        return -1;
+    }
+    if (length < frameLength) {
+        return 0;
+    }
+
+    const uint8_t* mask = &buffer[headerLength];
+    uint8_t* payload = &buffer[headerLength + 4];
+    for (size_t i = 0; i < payloadLength; i++) {
+        payload[i] ^= mask[i % 4];
+    }
+
+    frame.opcode = buffer[0] & 0x0F;
+    frame.final = (buffer[0] & 0x80) != 0;
+    frame.payload = payload;
+    frame.length = payloadLength;
+    return frameLength;
+}
+
+size_t webSocketFrameHeader(uint8_t* header, uint8_t opcode, size_t payloadLength) {
+    header[0] = 0x80 | opcode;
+    if (payloadLength < 126) {
+        header[1] = payloadLength;
+        return 2;
+    }
+    header[1] = 126;
+    header[2] = (payloadLength >> 8) & 0xFF;
+    header[3] = payloadLength & 0xFF;
+    return 4;
+}
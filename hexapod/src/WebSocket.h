@@ -0,0 +1,33 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <Arduino.h>
+
+enum WebSocketOpcode {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA
+};
+
+struct WebSocketFrame {
+    uint8_t opcode;
+    bool final;
+    uint8_t* payload;
+    size_t length;
+};
+
+// Fills accept with the Sec-WebSocket-Accept value for the client's key
+bool webSocketAcceptKey(const char* clientKey, char* accept, size_t acceptSize);
+
+// Parses one client frame from the start of buffer and unmasks it in place.
+// Returns the number of bytes the frame occupies, 0 if more data is needed
+// and -1 if the frame is malformed or bigger than the buffer.
+int webSocketParseFrame(uint8_t* buffer, size_t length, size_t capacity, WebSocketFrame& frame);
+
+// Writes an unmasked server frame header, returns its size (2 or 4 bytes)
+size_t webSocketFrameHeader(uint8_t* header, uint8_t opcode, size_t payloadLength);
+
+#endif
@@ -4,34 +4,194 @@
 #include "Constants.h"
 #include "TripodGait.h"
 #include "WaveGait.h"
+#include "FiveLegGait.h"
 #include "Enums.h"
 #include "BatteryReader.h"
+#include "NetworkServer.h"
+#include "ControlLoop.h"
+#include "ImuReader.h"
+#include "Logger.h"
+#include "PhasedMotion.h"
+#include "PostureController.h"
+#include "JointArena.h"
+#include "ServoShadow.h"
+#include "HeadingHold.h"
+#include "TurnPlanner.h"
+#include "TerrainMap.h"
+#include "StairGait.h"
+#include "ParameterStore.h"
+#include "GaitTuner.h"
+#include "PoseController.h"
+#include "LegKinematics.h"
+#include "MotionQueue.h"
+#include "LatencyStats.h"
+#include "BootProfile.h"
+#include "InputLog.h"
+#include "ResourceMonitor.h"
+#include "LegFaultMonitor.h"
 
 #include <WiFi.h>
+#include <mbedtls/base64.h>
 
 #define WIRE_PORT Wire
 #define AD0_VAL 0
 
-ICM_20948_I2C myICM;
+ImuReader imuReader;
+HeadingHold headingHold;
+TurnPlanner turnPlanner;
 LX16ABus servoBus;
-LX16AServo* servos[18];
-
-TripodGait tripodGait(servoBus, servos);
-WaveGait waveGait(servoBus, servos);
+JointArena jointArena;
+ServoShadow servoShadow(jointArena);
+TerrainMap terrainMap;
+ParameterStore parameterStore;
+PoseController poseController;
+MotionQueue motionQueue;
+
+TripodGait tripodGait(servoBus, servoShadow, terrainMap, poseController);
+WaveGait waveGait(servoBus, servoShadow, terrainMap, poseController);
+StairGait stairGait(servoBus, servoShadow, terrainMap, poseController, imuReader);
+FiveLegGait fiveLegGait(servoBus, servoShadow, terrainMap, poseController);
+LegFaultMonitor legFaults(servoShadow, jointArena.contact, terrainMap);
 BatteryReader batteryReader(batteryPin);
 
-WiFiClient persistentClient;
-bool clientConnected = false;
-
 TaskHandle_t wifiTaskHandle = NULL;
 
-const int PORT = 8080;
+const int CONTROL_CORE = 1;
+const int CONTROL_TASK_PRIORITY = configMAX_PRIORITIES - 5;
+const int BACKGROUND_CORE = 0;
 
-WiFiServer server(PORT);
+ControlLoop controlLoop(CONTROL_RATE_HZ);
 
-GaitPattern currentGait = TRIPOD;
+const int PORT = 8080;
+const int WS_PORT = 81;
+const int TELEMETRY_INTERVAL_MS = 100;
+const int HEALTH_INTERVAL_MS = 1000;
+const int BATTERY_REFRESH_MS = 5000;
+const int WIFI_RETRY_MS = 10000;
+const int CONSOLE_POLL_MS = 50;
+const int WIFI_TASK_STACK = 8192;
+
+// Commands typed on the serial console are handled like a client's, with
+// replies printed back instead of sent
+const int SERIAL_CLIENT = MAX_CLIENTS;
+
+NetworkServer networkServer(PORT, WS_PORT);
+BootProfile bootProfile;
+ResourceMonitor resourceMonitor;
+
+// Set once servos and IMU are up; until then commands are not taken
+volatile bool actuationReady = false;
+bool wifiConnected = false;
+bool serverStarted = false;
+unsigned long wifiRetryMs = 0;
+
+char consoleLine[CLIENT_BUFFER_SIZE];
+int consoleLength = 0;
+
+int lastBatteryPercentage = -1;
+unsigned long lastBatteryReadMs = 0;
+
+volatile GaitPattern currentGait = TRIPOD;
  
-RobotMode currentMode = IDLE;
+volatile RobotMode currentMode = IDLE;
+
+bool laidDown = false;
+
+// Gait cadence from SPEED:<scale>, applied when the next cycle starts
+volatile float speedScale = 1.0f;
+
+// Set by a ROTATE:<degrees> command, picked up by the control task
+volatile float requestedTurn = 0;
+volatile bool turnRequested = false;
+
+// Motion being stepped by the control task and the mode that started it
+PhasedMotion* activeMotion = NULL;
+RobotMode motionMode = NONE;
+RobotMode lastTickMode = NONE;
+
+// Scripted move the control task is running from the motion queue
+MotionRequest queuedMotion;
+bool queuedRunning = false;
+// A queued move with its own speed runs at queuedSpeedScale and puts the
+// scale it found back afterwards, unless a client changed it meanwhile
+float speedBeforeQueued = 1.0f;
+float queuedSpeedScale = 0;
+// Cycles a queued walk still has to go, -1 while walking open ended
+int walkCyclesLeft = -1;
+
+// Where command latency goes: client to robot, waiting for the control
+// task to act, and the servo writes of that tick. The network histogram
+// is written by the network task, the other two by the control task.
+LatencyHistogram networkLatency;
+LatencyHistogram queueLatency;
+LatencyHistogram servoLatency;
+
+// Timestamps of the command being handled, on the network task; the
+// client send time is on the robot clock and -1 when not given
+int64_t incomingSentUs = -1;
+int64_t incomingReceivedUs = 0;
+int incomingClientId = -1;
+
+// Timestamps of the last mode command, handed to the control task
+volatile bool commandTimingPending = false;
+int64_t commandSentUs = -1;
+int64_t commandReceivedUs = 0;
+int commandClientId = -1;
+
+// Standing legs still to be re-sent since the body pose last moved
+uint8_t poseStaleLegs = 0;
+int poseLegCursor = 0;
+
+// Set by FAULT_RESET, picked up by the control task between motions
+volatile bool faultResetRequested = false;
+// Set by TERRAIN_RESET, the map is read and written by the gaits
+volatile bool terrainResetRequested = false;
+// Set by HEADING_HOLD_ON/OFF, the PID runs on the control task
+volatile bool headingHoldRequested = false;
+volatile bool headingHoldWanted = false;
+// The body is still leaning away from a leg that was just lost
+bool leaningFromLostLeg = false;
+
+// Parameter edits from clients. The network task queues them and the
+// control task applies them between motions, so a gait never starts from
+// a half written store. The network task saves and reports the copy the
+// control task publishes after each change.
+// Edits of one name replace each other, so a slot per parameter is plenty
+const int PARAMETER_EDIT_SLOTS = 24;
+
+struct ParameterEdit {
+    char name[24];
+    int value;
+};
+
+ParameterEdit parameterEdits[PARAMETER_EDIT_SLOTS];
+int parameterEditCount = 0;
+bool parameterResetRequested = false;
+bool parameterSaveRequested = false;
+ParameterStore publishedParameters;
+portMUX_TYPE parameterLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Auto-tune script: each stage runs its gait for a number of cycles at
+// nominal speed, walking and turning back to where it started
+struct TuneStage {
+    GaitPattern pattern;
+    GaitMotion motion;
+    int cycles;
+};
+
+const TuneStage TUNE_STAGES[] = {
+    {TRIPOD, WALK_FORWARD,  TUNE_CYCLES},
+    {TRIPOD, WALK_BACKWARD, TUNE_CYCLES},
+    {TRIPOD, TURN_LEFT,     TUNE_CYCLES / 2},
+    {TRIPOD, TURN_RIGHT,    TUNE_CYCLES / 2},
+    {WAVE,   WALK_FORWARD,  1},
+    {WAVE,   WALK_BACKWARD, 1},
+};
+const int TUNE_STAGE_COUNT = sizeof(TUNE_STAGES) / sizeof(TUNE_STAGES[0]);
+
+int tuneStage = 0;
+int tuneCyclesDone = 0;
+Gait* tuneGait = NULL;
 
 
 
@@ -47,418 +207,498 @@ void trimIncomingString(String& incoming) {
     incoming = cleanCommand;
 }
 
-
-// Helper function to get switch index from leg base servo ID
-int getSwitchIndexForLeg(int legBase) {
-    switch(legBase) {
-        case 0:  return 0;
-        case 3:  return 1;
-        case 6:  return 2;
-        case 9:  return 3;
-        case 12: return 4;
-        case 15: return 5;
-        default: return -1;
+// Puts one leg in the standing stance under the current body pose,
+// leaving joints that are already there alone
+void standLeg(int base, int time) {
+    // A lost leg is folded up out of the way instead
+    if (base / JOINTS_PER_LEG == fiveLegGait.getLostLeg()) {
+        int32_t folded[3] = {COXA_DEFAULT, FEMUR_UP, TIBIA_UP};
+        for (int joint = 0; joint < 3; joint++) {
+            if (servoShadow.target(base + joint) != folded[joint]) {
+                servoShadow.move(base + joint, folded[joint], time);
+            }
+        }
+        return;
     }
-}
 
-// Helper function to check if leg is on ground (debounced)
-bool isLegGrounded(int legBase) {
-    int switchIndex = getSwitchIndexForLeg(legBase);
-    if (switchIndex < 0) return false;
-    
-    int switchPin = SWITCH_PINS[switchIndex];
-    
-    // Take multiple readings and use majority vote for reliability
-    int pressedCount = 0;
-    const int READINGS = 5;
-    
-    for (int i = 0; i < READINGS; i++) {
-        if (digitalRead(switchPin) == 1) {
-            pressedCount++;
+    JointTargets stance = {COXA_DEFAULT, FEMUR_DOWN, TIBIA_DOWN};
+    JointTargets posed;
+    poseController.apply(base, stance, posed);
+
+    int32_t targets[3] = {posed.coxa, posed.femur, posed.tibia};
+    int32_t unposed[3] = {stance.coxa, stance.femur, stance.tibia};
+    for (int joint = 0; joint < 3; joint++) {
+        if (servoShadow.target(base + joint) != targets[joint]) {
+            servoShadow.move(base + joint, targets[joint], time, unposed[joint]);
         }
-        delayMicroseconds(200);
     }
-    
-    // Require at least 3 out of 5 readings to be HIGH
-    return pressedCount >= 3;
 }
 
 void initLegs() {
-    for (int i = 0; i < 18; i += 3) {
-        if(servos[i]->pos_read() != COXA_DEFAULT) {
-            servos[i]->move_time(COXA_DEFAULT, 200);
-        }
-        if(servos[i+1]->pos_read() != FEMUR_DOWN) {
-            servos[i+1]->move_time(FEMUR_DOWN, 200);
-        }
-        if(servos[i+2]->pos_read() != TIBIA_DOWN) {
-            servos[i+2]->move_time(TIBIA_DOWN, 200);
-        }
+    for (int i = 0; i < SERVO_COUNT; i += JOINTS_PER_LEG) {
+        standLeg(i, 200);
     }
+    poseStaleLegs = 0;
 }
 
-void moveForward() {
-    switch(currentGait) {
-        case TRIPOD: 
-            tripodGait.move();
-            break;
-        case WAVE:
-            waveGait.move();
-            break;
-        default:
-            tripodGait.move();
-            break;
+// Follows a moving body pose while standing. Only a couple of legs are
+// re-sent per tick so a streamed pose does not put all 18 servo writes
+// into one control period.
+void followPose() {
+    for (int sent = 0; sent < BODY_POSE_LEGS_PER_TICK && poseStaleLegs != 0; ) {
+        int leg = poseLegCursor;
+        poseLegCursor = (poseLegCursor + 1) % 6;
+        if (poseStaleLegs & (1 << leg)) {
+            poseStaleLegs &= ~(1 << leg);
+            standLeg(leg * 3, BODY_POSE_MOVE_TIME);
+            sent++;
+        }
     }
 }
 
-void moveBackward() {
+bool isFiveLegged() {
+    return fiveLegGait.getLostLeg() >= 0;
+}
+
+Gait* selectedGait() {
+    if (isFiveLegged()) {
+        return &fiveLegGait;
+    }
     switch(currentGait) {
         case TRIPOD: 
-            tripodGait.moveBackward();
-            break;
+            return &tripodGait;
         case WAVE:
-            waveGait.moveBackward();
-            break;
+            return &waveGait;
         default:
-            tripodGait.moveBackward();
-            break;
+            return &tripodGait;
     }
 }
 
-void layDown() {
-    Serial.println("Laying down posture (gentle, hold)");
-
-    // Gentler movement: slower timings and smaller deltas
-    const int32_t targetCoxa = COXA_DEFAULT;
-
-    // Soften femur/tibia targets for less aggressive tuck (avoid min() to silence -Wstrict-overflow)
-    const int32_t targetFemurStage1 = (FEMUR_UP - 500); // smaller initial raise
-    const int32_t targetFemurStage2 = FEMUR_UP - 250;                // less extreme final
-
-    const int32_t targetTibiaStage1 = TIBIA_UP + 120; // small bend
-    const int32_t targetTibiaStage2 = TIBIA_UP + 260; // moderate bend
+// The tripod turns the robot, or the five-leg gait once a leg is lost
+Gait* turningGait() {
+    return isFiveLegged() ? (Gait*)&fiveLegGait : (Gait*)&tripodGait;
+}
 
-    // Stage 1: ensure coxa are neutral
-    for (int base = 0; base < 18; base += 3) {
-        servos[base]->move_time(targetCoxa, 380);
+void moveTripod(const int legs[3], int32_t femur, int32_t tibia, int time) {
+    for (int i = 0; i < 3; i++) {
+        int base = legs[i];
+        servoShadow.move(base + 1, femur, time);
+        servoShadow.move(base + 2, tibia, time);
     }
-    delay(420);
+}
 
-    // Stage 2: gentle femur raise + slight tibia bend
-    for (int base = 0; base < 18; base += 3) {
-        servos[base + 1]->move_time(targetFemurStage1, 420);
-        servos[base + 2]->move_time(targetTibiaStage1, 420);
+// Lay down: neutral coxa, then tuck in two gentle steps
+const PostureStage LAY_DOWN_STAGES[] = {
+    {"neutralize coxa",            ALL_LEGS, COXA_DEFAULT, KEEP,            KEEP,            380, false},
+    {"raise femur, bend tibia",    ALL_LEGS, KEEP,         FEMUR_UP - 500,  TIBIA_UP + 120,  420, false},
+    {"finish tuck",                ALL_LEGS, KEEP,         FEMUR_UP - 250,  TIBIA_UP + 260,  520, false},
+};
+
+// Stand up: each tripod lifts, unbends and settles into stance while the
+// other one holds the body. Stuck legs get a relief lift from the
+// controller instead of the old unconditional leg 15 pre-lift.
+const PostureStage STAND_UP_STAGES[] = {
+    {"neutralize coxa",            ALL_LEGS, COXA_DEFAULT, KEEP,              KEEP,            380, false},
+    {"A1 lift femur, unbend tibia", TRIPOD_1, KEEP,        FEMUR_UP - 280,    TIBIA_UP + 110,  420, false},
+    {"A2 extend tibia",            TRIPOD_1, KEEP,         KEEP,              TIBIA_UP + 50,   440, false},
+    {"A3 approach stance",         TRIPOD_1, KEEP,         FEMUR_DOWN + 180,  TIBIA_DOWN,      480, false},
+    {"A4 femur stance",            TRIPOD_1, KEEP,         FEMUR_DOWN,        KEEP,            500, true},
+    {"B1 lift femur, unbend tibia", TRIPOD_2, KEEP,        FEMUR_UP - 280,    TIBIA_UP + 110,  420, false},
+    {"B2 extend tibia",            TRIPOD_2, KEEP,         KEEP,              TIBIA_UP + 50,   440, false},
+    {"B3 approach stance",         TRIPOD_2, KEEP,         FEMUR_DOWN + 180,  TIBIA_DOWN,      480, false},
+    {"B4 femur stance",            TRIPOD_2, KEEP,         FEMUR_DOWN,        KEEP,            500, true},
+    {"normalize stance",           ALL_LEGS, COXA_DEFAULT, FEMUR_DOWN,        TIBIA_DOWN,      200, true},
+};
+
+const int LAY_DOWN_STAGE_COUNT = sizeof(LAY_DOWN_STAGES) / sizeof(LAY_DOWN_STAGES[0]);
+const int STAND_UP_STAGE_COUNT = sizeof(STAND_UP_STAGES) / sizeof(STAND_UP_STAGES[0]);
+
+int dancePhase(int phase) {
+    // Move 1: Body Wave - Sequential leg lifts creating a wave effect
+    if (phase < 24) {
+        if (phase == 0) {
+            logPrintf("Let's dance!");
+            logPrintf("Dance move: Body Wave");
+        }
+        int legBase = WAVE_ORDER[(phase / 2) % 6];
+        if (phase % 2 == 0) {
+            // Lift leg
+            servoShadow.move(legBase + 1, FEMUR_UP - 200, 200);
+            servoShadow.move(legBase + 2, TIBIA_UP + 150, 200);
+            return 150;
+        }
+        // Lower leg
+        servoShadow.move(legBase + 1, FEMUR_DOWN, 200);
+        servoShadow.move(legBase + 2, TIBIA_DOWN, 200);
+        return 100;
     }
-    delay(450);
+    phase -= 24;
 
-    // Stage 3: finish tuck with moderate femur/tibia targets
-    for (int base = 0; base < 18; base += 3) {
-        servos[base + 1]->move_time(targetFemurStage2, 520);
-        servos[base + 2]->move_time(targetTibiaStage2, 520);
+    // Move 2: Twist - Alternating coxa rotations
+    if (phase < 8) {
+        if (phase == 0) {
+            logPrintf("Dance move: Twist");
+        }
+        bool twistRight = phase % 2 == 0;
+        for (int base = 0; base < 18; base += 3) {
+            int32_t target = ((base % 6 == 0) == twistRight) ? COXA_FORWARD : COXA_BACKWARD;
+            servoShadow.move(base, target, 300);
+        }
+        return 350;
     }
-    delay(540);
-
-    Serial.println("Lay down complete");
-}
-
-void standUp() {
-    Serial.println("Standing up from laid posture (tripod-staged)");
-
-    const int32_t targetCoxa = COXA_DEFAULT;
+    if (phase == 8) {
+        // Reset coxa to default
+        for (int base = 0; base < 18; base += 3) {
+            servoShadow.move(base, COXA_DEFAULT, 300);
+        }
+        return 350;
+    }
+    phase -= 9;
 
-    // Step 0: neutralize all coxa to avoid sweeping
-    for (int base = 0; base < 18; base += 3) {
-        servos[base]->move_time(targetCoxa, 380);
+    // Move 3: Bounce - All legs up and down together
+    if (phase < 10) {
+        if (phase == 0) {
+            logPrintf("Dance move: Bounce");
+        }
+        for (int base = 0; base < 18; base += 3) {
+            if (phase % 2 == 0) {
+                servoShadow.move(base + 1, FEMUR_UP - 300, 200);
+                servoShadow.move(base + 2, TIBIA_UP + 200, 200);
+            } else {
+                servoShadow.move(base + 1, FEMUR_DOWN, 200);
+                servoShadow.move(base + 2, TIBIA_DOWN, 200);
+            }
+        }
+        return 250;
     }
-    delay(400);
+    phase -= 10;
 
-    // Helper lambdas for grouped moves
-    auto moveTripod = [&](const int legs[3], int32_t femur, int32_t tibia, int time) {
-        for (int i = 0; i < 3; i++) {
-            int base = legs[i];
-            servos[base + 1]->move_time(femur, time);
-            servos[base + 2]->move_time(tibia, time);
+    // Move 4: Tripod Rock - Alternating tripod groups up/down
+    if (phase < 12) {
+        if (phase == 0) {
+            logPrintf("Dance move: Tripod Rock");
         }
-    };
+        switch (phase % 3) {
+            case 0:
+                // Lift tripod 1
+                moveTripod(TRIPOD1_LEGS, FEMUR_UP - 250, TIBIA_UP + 180, 250);
+                break;
+            case 1:
+                // Lower tripod 1, lift tripod 2
+                moveTripod(TRIPOD1_LEGS, FEMUR_DOWN, TIBIA_DOWN, 250);
+                moveTripod(TRIPOD2_LEGS, FEMUR_UP - 250, TIBIA_UP + 180, 250);
+                break;
+            default:
+                // Lower tripod 2
+                moveTripod(TRIPOD2_LEGS, FEMUR_DOWN, TIBIA_DOWN, 250);
+                break;
+        }
+        return 300;
+    }
+    phase -= 12;
 
-    auto moveTripodFemurOnly = [&](const int legs[3], int32_t femur, int time) {
-        for (int i = 0; i < 3; i++) {
-            int base = legs[i];
-            servos[base + 1]->move_time(femur, time);
+    // Move 5: Shimmy - Rapid alternating coxa movements
+    if (phase < 8) {
+        if (phase == 0) {
+            logPrintf("Dance move: Shimmy");
+        }
+        int32_t offset = (phase % 2 == 0) ? 150 : -150;
+        for (int base = 0; base < 18; base += 3) {
+            servoShadow.move(base, COXA_DEFAULT + offset, 120);
         }
-    };
+        return 150;
+    }
+    if (phase == 8) {
+        // Reset to default position
+        for (int base = 0; base < 18; base += 3) {
+            servoShadow.move(base, COXA_DEFAULT, 300);
+        }
+        return 350;
+    }
+    phase -= 9;
 
-    auto moveTripodTibiaOnly = [&](const int legs[3], int32_t tibia, int time) {
-        for (int i = 0; i < 3; i++) {
-            int base = legs[i];
-            servos[base + 2]->move_time(tibia, time);
+    // Move 6: Finale - Big wave and bow
+    if (phase < 6) {
+        if (phase == 0) {
+            logPrintf("Dance move: Finale");
         }
-    };
+        int legBase = WAVE_ORDER[phase];
+        servoShadow.move(legBase + 1, FEMUR_UP - 150, 180);
+        servoShadow.move(legBase + 2, TIBIA_UP + 120, 180);
+        // The last leg of the wave holds a little longer
+        return phase == 5 ? 120 + 200 : 120;
+    }
 
-    // Conservative targets
-    const int32_t femurLift = (FEMUR_UP - 280);
-    const int32_t tibiaUnbend1 = (TIBIA_UP + 110);
-    const int32_t tibiaUnbend2 = (TIBIA_UP + 50);
-    const int32_t femurApproach = (FEMUR_DOWN + 180);
-    const int32_t tibiaStance = TIBIA_DOWN;
-    const int32_t femurStance = FEMUR_DOWN;
+    switch (phase - 6) {
+        case 0:
+            // All legs down
+            for (int base = 0; base < 18; base += 3) {
+                servoShadow.move(base + 1, FEMUR_DOWN, 400);
+                servoShadow.move(base + 2, TIBIA_DOWN, 400);
+            }
+            return 450;
+
+        case 1:
+            // Bow - tilt forward
+            for (int base = 0; base < 18; base += 3) {
+                // Front legs (0, 3) slightly up, back legs (12, 15) down more
+                if (base == 0 || base == 3) {
+                    servoShadow.move(base + 1, FEMUR_DOWN - 200, 500);
+                } else if (base == 12 || base == 15) {
+                    servoShadow.move(base + 1, FEMUR_DOWN + 200, 500);
+                }
+            }
+            return 800;
 
-    // Tripod 1 staged stand-up (15, 12, 6)
-    // Targeted relief for leg 15 first (known sticky)
-    servos[15 + 1]->move_time(FEMUR_UP - 250, 420);
-    servos[15 + 2]->move_time(TIBIA_UP + 120, 420);
-    delay(440);
+        case 2:
+            // Return to normal stance
+            initLegs();
+            logPrintf("Dance complete!");
+            return 0;
 
-    // Stage A1: lift femur and unbend tibia
-    moveTripod(TRIPOD1_LEGS, femurLift, tibiaUnbend1, 420);
-    delay(440);
-    // Stage A2: more tibia extension while keeping femur high
-    moveTripodTibiaOnly(TRIPOD1_LEGS, tibiaUnbend2, 440);
-    delay(460);
-    // Stage A3: lower femur towards stance and extend tibia to stance
-    moveTripod(TRIPOD1_LEGS, femurApproach, tibiaStance, 480);
-    delay(500);
-    // Stage A4: finalize femur stance
-    moveTripodFemurOnly(TRIPOD1_LEGS, femurStance, 500);
-    delay(520);
+        default:
+            return -1;
+    }
+}
 
-    // Tripod 2 staged stand-up (0, 3, 9)
-    // Stage B1: lift femur and unbend tibia
-    moveTripod(TRIPOD2_LEGS, femurLift, tibiaUnbend1, 420);
-    delay(440);
-    // Stage B2: more tibia extension while keeping femur high
-    moveTripodTibiaOnly(TRIPOD2_LEGS, tibiaUnbend2, 440);
-    delay(460);
-    // Stage B3: lower femur towards stance and extend tibia to stance
-    moveTripod(TRIPOD2_LEGS, femurApproach, tibiaStance, 480);
-    delay(500);
-    // Stage B4: finalize femur stance
-    moveTripodFemurOnly(TRIPOD2_LEGS, femurStance, 500);
-    delay(520);
-
-    // Small final normalization to exact stance for all legs
-    initLegs();
+PostureController postureController(servoShadow, jointArena.contact);
+GaitTuner gaitTuner(servoShadow, jointArena.contact);
+ScriptedMotion danceMotion(dancePhase);
 
-    Serial.println("Stand up complete");
+int getBatteryPercentage() {
+    return inputBattery(batteryReader.getPercentage());
 }
 
-void rotateLeft() {
-    tripodGait.rotateInPlace(RIGHT);  
+void sendReply(int clientId, const char* line) {
+    if (clientId == SERIAL_CLIENT) {
+        Serial.println(line);
+        return;
+    }
+    networkServer.sendLine(clientId, line);
 }
 
-void rotateRight() {
-    tripodGait.rotateInPlace(LEFT);
+// Same for the control task, which must not block on a socket or the UART
+bool postReply(int clientId, const char* line) {
+    if (clientId == SERIAL_CLIENT) {
+        logPrintf("%s", line);
+        return true;
+    }
+    return networkServer.post(clientId, line);
 }
 
-void rotateBackward() {
-    rotateLeft();
-    rotateLeft();
+// Mode changes from a client take over from any scripted moves
+void commandMode(RobotMode mode) {
+    motionQueue.requestAbort();
+    commandSentUs = incomingSentUs;
+    commandReceivedUs = incomingReceivedUs;
+    commandClientId = incomingClientId;
+    commandTimingPending = true;
+    currentMode = mode;
 }
 
-
-
-void rotate(Direction direction) {
-    switch(direction) {
-        case BACKWARD:
-            rotateBackward();
-            break;
-            
-        case LEFT:
-            rotateLeft();
-            break;
-            
-        case RIGHT:
-            rotateRight();
+struct QueuedMotionName {
+    const char* name;
+    RobotMode mode;
+    bool needsAmount;
+};
+
+const QueuedMotionName QUEUED_MOTIONS[] = {
+    {"FORWARD",  MOVE_FORWARD,    true},
+    {"BACKWARD", MOVE_BACKWARD,   true},
+    {"ROTATE",   ROTATE_TO_ANGLE, true},
+    {"STAND_UP", STAND_UP,        false},
+    {"LAY_DOWN", LAY_DOWN,        false},
+    {"DANCE",    DANCE,           false},
+};
+
+// QUEUE:<id>,<motion>[,<amount>[,<speed>]]. FORWARD and BACKWARD take a
+// distance in mm, ROTATE degrees counterclockwise; STAND_UP, LAY_DOWN and
+// DANCE take no amount. Answered with an ACCEPTED or REJECTED event.
+void queueMotion(int clientId, const String& arguments) {
+    MotionRequest request = {0, clientId, IDLE, 0, 0};
+    unsigned long id = 0;
+    char name[16] = "";
+    int fields = sscanf(arguments.c_str(), "%lu,%15[A-Z_],%f,%f", &id, name, &request.amount, &request.speed);
+    request.id = id;
+
+    const char* error = fields < 2 ? "syntax" : "unknown motion";
+    for (size_t i = 0; fields >= 2 && i < sizeof(QUEUED_MOTIONS) / sizeof(QUEUED_MOTIONS[0]); i++) {
+        if (strcmp(name, QUEUED_MOTIONS[i].name) == 0) {
+            request.mode = QUEUED_MOTIONS[i].mode;
+            error = QUEUED_MOTIONS[i].needsAmount && fields < 3 ? "missing amount" : NULL;
             break;
+        }
+    }
+    if (error == NULL && !motionQueue.push(request)) {
+        error = "queue full";
     }
-}
 
+    char reply[64];
+    if (error != NULL) {
+        snprintf(reply, sizeof(reply), "EVENT:REJECTED:%lu:%s", id, error);
+    } else {
+        snprintf(reply, sizeof(reply), "EVENT:ACCEPTED:%lu", id);
+    }
+    sendReply(clientId, reply);
+}
 
-void moveLeft() {
-    rotate(LEFT);
-    currentMode = IDLE;
+// Network task: false when the control task has not caught up yet
+bool queueParameterEdit(const char* name, int value) {
+    bool queued = false;
+    portENTER_CRITICAL(&parameterLock);
+    int slot = 0;
+    while (slot < parameterEditCount && strcmp(parameterEdits[slot].name, name) != 0) {
+        slot++;
+    }
+    if (slot < PARAMETER_EDIT_SLOTS) {
+        parameterEditCount = max(parameterEditCount, slot + 1);
+        ParameterEdit& edit = parameterEdits[slot];
+        strncpy(edit.name, name, sizeof(edit.name) - 1);
+        edit.name[sizeof(edit.name) - 1] = '\0';
+        edit.value = value;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&parameterLock);
+    return queued;
 }
 
-void moveRight() {
-    rotate(RIGHT);
-    currentMode = IDLE;
+// Network task; edits still pending are overridden by the defaults
+void requestParameterReset() {
+    portENTER_CRITICAL(&parameterLock);
+    parameterEditCount = 0;
+    parameterResetRequested = true;
+    portEXIT_CRITICAL(&parameterLock);
 }
 
-void stopMoving() {
-    currentMode = IDLE;
+// Control task: hands a copy of the store to the network task, to be
+// saved to flash there when asked
+void publishParameters(bool save) {
+    portENTER_CRITICAL(&parameterLock);
+    publishedParameters = parameterStore;
+    parameterSaveRequested = parameterSaveRequested || save;
+    portEXIT_CRITICAL(&parameterLock);
 }
 
-void dance() {
-    Serial.println("Let's dance!");
-    
-    // Move 1: Body Wave - Sequential leg lifts creating a wave effect
-    Serial.println("Dance move: Body Wave");
-    for (int wave = 0; wave < 2; wave++) {
-        for (int i = 0; i < 6; i++) {
-            int legBase = WAVE_ORDER[i];
-            // Lift leg
-            servos[legBase + 1]->move_time(FEMUR_UP - 200, 200);
-            servos[legBase + 2]->move_time(TIBIA_UP + 150, 200);
-            delay(150);
-            // Lower leg
-            servos[legBase + 1]->move_time(FEMUR_DOWN, 200);
-            servos[legBase + 2]->move_time(TIBIA_DOWN, 200);
-            delay(100);
-        }
-    }
-    
-    // Move 2: Twist - Alternating coxa rotations
-    Serial.println("Dance move: Twist");
-    for (int twist = 0; twist < 4; twist++) {
-        // Twist right
-        for (int base = 0; base < 18; base += 3) {
-            int32_t target = (base % 6 == 0) ? COXA_FORWARD : COXA_BACKWARD;
-            servos[base]->move_time(target, 300);
-        }
-        delay(350);
-        
-        // Twist left
-        for (int base = 0; base < 18; base += 3) {
-            int32_t target = (base % 6 == 0) ? COXA_BACKWARD : COXA_FORWARD;
-            servos[base]->move_time(target, 300);
-        }
-        delay(350);
-    }
-    
-    // Reset coxa to default
-    for (int base = 0; base < 18; base += 3) {
-        servos[base]->move_time(COXA_DEFAULT, 300);
+// Control task, between motions
+void applyParameterEdits() {
+    ParameterEdit edits[PARAMETER_EDIT_SLOTS];
+    portENTER_CRITICAL(&parameterLock);
+    int count = parameterEditCount;
+    bool reset = parameterResetRequested;
+    memcpy(edits, parameterEdits, count * sizeof(ParameterEdit));
+    parameterEditCount = 0;
+    parameterResetRequested = false;
+    portEXIT_CRITICAL(&parameterLock);
+    if (count == 0 && !reset) {
+        return;
     }
-    delay(350);
-    
-    // Move 3: Bounce - All legs up and down together
-    Serial.println("Dance move: Bounce");
-    for (int bounce = 0; bounce < 5; bounce++) {
-        // All legs up
-        for (int base = 0; base < 18; base += 3) {
-            servos[base + 1]->move_time(FEMUR_UP - 300, 200);
-            servos[base + 2]->move_time(TIBIA_UP + 200, 200);
-        }
-        delay(250);
-        
-        // All legs down
-        for (int base = 0; base < 18; base += 3) {
-            servos[base + 1]->move_time(FEMUR_DOWN, 200);
-            servos[base + 2]->move_time(TIBIA_DOWN, 200);
-        }
-        delay(250);
+
+    if (reset) {
+        parameterStore.resetDefaults();
     }
-    
-    // Move 4: Tripod Rock - Alternating tripod groups up/down
-    Serial.println("Dance move: Tripod Rock");
-    for (int rock = 0; rock < 4; rock++) {
-        // Lift tripod 1
-        for (int i = 0; i < 3; i++) {
-            int base = TRIPOD1_LEGS[i];
-            servos[base + 1]->move_time(FEMUR_UP - 250, 250);
-            servos[base + 2]->move_time(TIBIA_UP + 180, 250);
-        }
-        delay(300);
-        
-        // Lower tripod 1, lift tripod 2
-        for (int i = 0; i < 3; i++) {
-            int base = TRIPOD1_LEGS[i];
-            servos[base + 1]->move_time(FEMUR_DOWN, 250);
-            servos[base + 2]->move_time(TIBIA_DOWN, 250);
-        }
-        for (int i = 0; i < 3; i++) {
-            int base = TRIPOD2_LEGS[i];
-            servos[base + 1]->move_time(FEMUR_UP - 250, 250);
-            servos[base + 2]->move_time(TIBIA_UP + 180, 250);
-        }
-        delay(300);
-        
-        // Lower tripod 2
-        for (int i = 0; i < 3; i++) {
-            int base = TRIPOD2_LEGS[i];
-            servos[base + 1]->move_time(FEMUR_DOWN, 250);
-            servos[base + 2]->move_time(TIBIA_DOWN, 250);
-        }
-        delay(300);
-    }
-    
-    // Move 5: Shimmy - Rapid alternating coxa movements
-    Serial.println("Dance move: Shimmy");
-    for (int shimmy = 0; shimmy < 8; shimmy++) {
-        // Quick shift
-        for (int base = 0; base < 18; base += 3) {
-            int32_t offset = (shimmy % 2 == 0) ? 150 : -150;
-            servos[base]->move_time(COXA_DEFAULT + offset, 120);
-        }
-        delay(150);
+    for (int i = 0; i < count; i++) {
+        parameterStore.set(edits[i].name, edits[i].value);
     }
-    
-    // Reset to default position
-    for (int base = 0; base < 18; base += 3) {
-        servos[base]->move_time(COXA_DEFAULT, 300);
+    publishParameters(true);
+}
+
+// Network task: the NVS write blocks, it is kept off the control core
+void saveParameters() {
+    portENTER_CRITICAL(&parameterLock);
+    bool save = parameterSaveRequested;
+    ParameterStore published = publishedParameters;
+    parameterSaveRequested = false;
+    portEXIT_CRITICAL(&parameterLock);
+    if (save && !published.save()) {
+        Serial.println("ERROR: could not save the parameters");
     }
-    delay(350);
-    
-    // Move 6: Finale - Big wave and bow
-    Serial.println("Dance move: Finale");
-    
-    // Big body wave
-    for (int i = 0; i < 6; i++) {
-        int legBase = WAVE_ORDER[i];
-        servos[legBase + 1]->move_time(FEMUR_UP - 150, 180);
-        servos[legBase + 2]->move_time(TIBIA_UP + 120, 180);
-        delay(120);
-    }
-    delay(200);
-    
-    // All legs down
-    for (int base = 0; base < 18; base += 3) {
-        servos[base + 1]->move_time(FEMUR_DOWN, 400);
-        servos[base + 2]->move_time(TIBIA_DOWN, 400);
-    }
-    delay(450);
-    
-    // Bow - tilt forward
-    for (int base = 0; base < 18; base += 3) {
-        // Front legs (0, 3) slightly up, back legs (12, 15) down more
-        if (base == 0 || base == 3) {
-            servos[base + 1]->move_time(FEMUR_DOWN - 200, 500);
-        } else if (base == 12 || base == 15) {
-            servos[base + 1]->move_time(FEMUR_DOWN + 200, 500);
-        }
-    }
-    delay(800);
-    
-    // Return to normal stance
-    initLegs();
-    
-    Serial.println("Dance complete!");
-    currentMode = IDLE;
 }
 
-int getBatteryPercentage() {
-    return batteryReader.getPercentage();
+// GET_INPUT_LOG[:<offset>] is answered with INPUT_LOG:<offset>,<size>,<base64>
+// holding the next piece of the input log dump, empty past its end. The
+// first request ends the recording so the pieces fit together.
+void sendInputLog(int clientId, long offset) {
+    if (isInputLogRecording()) {
+        stopInputLog();
+        logPrintf("Input log: recording stopped for the dump");
+    }
+
+    uint8_t chunk[INPUT_LOG_CHUNK];
+    size_t length = offset < 0 ? 0 : readInputLog(offset, chunk, sizeof(chunk));
+    char reply[MAX_MESSAGE_SIZE];
+    int header = snprintf(reply, sizeof(reply), "INPUT_LOG:%ld,%lu,", offset, (unsigned long)getInputLogSize());
+    size_t written = 0;
+    mbedtls_base64_encode((unsigned char*)reply + header, sizeof(reply) - header, &written, chunk, length);
+    reply[header + written] = '\0';
+    sendReply(clientId, reply);
 }
 
-void handleIncoming(String incoming) {
+void handleIncoming(int clientId, String incoming) {
     if (incoming.indexOf("STOP") != -1) {
-        currentMode = IDLE;
+        // On a step the climbing pose is held, a flat stance would drop
+        // the body off it
+        commandMode(stairGait.isOnStep() ? NONE : IDLE);
+    } else if (incoming.indexOf("QUEUE:") != -1) {
+        // Checked early, the motion names inside are commands themselves
+        queueMotion(clientId, incoming.substring(incoming.indexOf("QUEUE:") + 6));
+        return;
+    } else if (incoming.indexOf("SPEED:") != -1) {
+        float scale = incoming.substring(incoming.indexOf("SPEED:") + 6).toFloat();
+        speedScale = constrain(scale, MIN_SPEED_SCALE, MAX_SPEED_SCALE);
+    } else if (incoming.indexOf("POSE:") != -1) {
+        // Streamed at up to 50 Hz, so it is not acknowledged
+        BodyPose pose;
+        const char* values = incoming.c_str() + incoming.indexOf("POSE:") + 5;
+        if (sscanf(values, "%f,%f,%f,%f,%f,%f", &pose.x, &pose.y, &pose.z,
+                   &pose.roll, &pose.pitch, &pose.yaw) != 6) {
+            Serial.println("Bad pose: " + incoming);
+            sendReply(clientId, "ERROR");
+            return;
+        }
+        poseController.setTarget(pose);
+        return;
+    } else if (incoming.indexOf("POSE_RESET") != -1) {
+        poseController.reset();
+    } else if (incoming.indexOf("ROTATE:") != -1) {
+        float angle = incoming.substring(incoming.indexOf("ROTATE:") + 7).toFloat();
+        requestedTurn = angle;
+        turnRequested = true;
+        commandMode(ROTATE_TO_ANGLE);
+    } else if (incoming.indexOf("TURN_AROUND") != -1) {
+        requestedTurn = 180;
+        turnRequested = true;
+        commandMode(ROTATE_TO_ANGLE);
     } else if (incoming.indexOf("FORWARD") != -1) {
-        currentMode = MOVE_FORWARD;
+        commandMode(MOVE_FORWARD);
     } else if (incoming.indexOf("BACKWARD") != -1) {
-        currentMode = MOVE_BACKWARD;
+        commandMode(MOVE_BACKWARD);
     } else if (incoming.indexOf("LEFT") != -1) {
-        moveLeft();
+        commandMode(ROTATE_LEFT);
     } else if (incoming.indexOf("RIGHT") != -1) {
-        moveRight();
+        commandMode(ROTATE_RIGHT);
+    } else if (incoming.indexOf("STAND_UP") != -1) {
+        commandMode(STAND_UP);
     } else if (incoming.indexOf("STAND") != -1) {
-        currentMode = IDLE;
+        // From the laid posture snapping straight to stance is too harsh
+        commandMode(laidDown ? STAND_UP : IDLE);
     } else if (incoming.indexOf("LAY_DOWN") != -1) {
-        currentMode = LAY_DOWN;
+        commandMode(LAY_DOWN);
     } else if (incoming.indexOf("DANCE") != -1) {
-        currentMode = DANCE;
+        commandMode(DANCE);
     } else if (incoming.indexOf("BALANCE") != -1) {
-        currentMode = BALANCE;
+        commandMode(BALANCE);
+    } else if (incoming.indexOf("HEADING_HOLD_ON") != -1) {
+        if (!imuReader.isConnected()) {
+            Serial.println("Heading hold needs the IMU, staying off");
+        }
+        headingHoldWanted = imuReader.isConnected();
+        headingHoldRequested = true;
+    } else if (incoming.indexOf("HEADING_HOLD_OFF") != -1) {
+        headingHoldWanted = false;
+        headingHoldRequested = true;
+    } else if (incoming.indexOf("TERRAIN_RESET") != -1) {
+        // Taken up by the control task between motions
+        terrainResetRequested = true;
     } else if (incoming.indexOf("TRIPOD_GAIT") != -1) {
         currentGait = TRIPOD;
     } else if (incoming.indexOf("WAVE_GAIT") != -1) {
@@ -466,193 +706,1004 @@ void handleIncoming(String incoming) {
     } else if (incoming.indexOf("RIPPLE_GAIT") != -1) {
         currentGait = RIPPLE;
     } else if (incoming.indexOf("STAIRCASE_MODE") != -1) {
-        // Implement staircase mode
+        commandMode(STAIRCASE);
     } else if (incoming.indexOf("GET_BATTERY") != -1) {
         int percentage = getBatteryPercentage();
         String response = "BATTERY:" + String(percentage);
-        
-        if (clientConnected && persistentClient.connected()) {
-            persistentClient.println(response);
-            Serial.println("Sent battery response: " + response);
-        }
+        sendReply(clientId, response.c_str());
+        Serial.println("Sent battery response: " + response);
         return; // Don't send "OK" response for battery requests
-    } else if (incoming.indexOf("STAND_UP") != -1) {
-        currentMode = STAND_UP;
+    } else if (incoming.indexOf("GET_CONTROL_STATS") != -1) {
+        ControlLoopStats stats = controlLoop.getStats();
+        char response[128];
+        snprintf(response, sizeof(response),
+                 "CONTROL:ticks=%lu,overruns=%lu,missed=%lu,lastUs=%u,maxUs=%u,jitterUs=%u",
+                 stats.ticks, stats.overruns, stats.missedTicks, stats.lastTickMicros,
+                 stats.maxTickMicros, stats.maxJitterMicros);
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("AUTO_TUNE") != -1) {
+        commandMode(AUTO_TUNE);
+    } else if (incoming.indexOf("GET_PARAMS") != -1) {
+        char response[MAX_MESSAGE_SIZE];
+        int length = snprintf(response, sizeof(response), "PARAMS:");
+        portENTER_CRITICAL(&parameterLock);
+        ParameterStore published = publishedParameters;
+        portEXIT_CRITICAL(&parameterLock);
+        published.format(response + length, sizeof(response) - length);
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("RESET_PARAMS") != -1) {
+        // Checked before SET_PARAM, which it contains
+        requestParameterReset();
+    } else if (incoming.indexOf("SET_PARAM:") != -1) {
+        String assignment = incoming.substring(incoming.indexOf("SET_PARAM:") + 10);
+        int equals = assignment.indexOf('=');
+        String name = assignment.substring(0, equals);
+        if (equals < 0 || !ParameterStore::isKnown(name.c_str())) {
+            Serial.println("Unknown parameter: " + assignment);
+            sendReply(clientId, "ERROR");
+            return;
+        }
+        if (!queueParameterEdit(name.c_str(), assignment.substring(equals + 1).toInt())) {
+            Serial.println("Parameter edits pending, dropped: " + assignment);
+            sendReply(clientId, "ERROR");
+            return;
+        }
+    } else if (incoming.indexOf("GET_LATENCY") != -1) {
+        const char* const names[] = {"net", "queue", "servo"};
+        const LatencyHistogram* const stages[] = {&networkLatency, &queueLatency, &servoLatency};
+        char response[MAX_MESSAGE_SIZE];
+        int length = snprintf(response, sizeof(response), "LATENCY:");
+        for (int i = 0; i < 3 && length < (int)sizeof(response); i++) {
+            length += snprintf(response + length, sizeof(response) - length, "%s%s=", i == 0 ? "" : ";", names[i]);
+            if (length < (int)sizeof(response)) {
+                length += stages[i]->format(response + length, sizeof(response) - length);
+            }
+        }
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("LATENCY_RESET") != -1) {
+        networkLatency.reset();
+        queueLatency.reset();
+        servoLatency.reset();
+    } else if (incoming.indexOf("GET_BOOT") != -1) {
+        char response[160];
+        int length = snprintf(response, sizeof(response), "BOOT:");
+        bootProfile.format(response + length, sizeof(response) - length);
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("GET_RESOURCES") != -1) {
+        char response[MAX_MESSAGE_SIZE];
+        int length = snprintf(response, sizeof(response), "RESOURCES:");
+        resourceMonitor.sample();
+        resourceMonitor.format(response + length, sizeof(response) - length);
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("GET_FAULTS") != -1) {
+        char response[MAX_MESSAGE_SIZE];
+        int length = snprintf(response, sizeof(response), "FAULTS:");
+        legFaults.format(response + length, sizeof(response) - length);
+        sendReply(clientId, response);
+        return;
+    } else if (incoming.indexOf("FAULT_RESET") != -1) {
+        // Taken up by the control task between motions
+        faultResetRequested = true;
+        sendReply(clientId, "OK");
+        return;
+    } else if (incoming.indexOf("GET_INPUT_LOG") != -1) {
+        int colon = incoming.indexOf("GET_INPUT_LOG:");
+        sendInputLog(clientId, colon < 0 ? 0 : incoming.substring(colon + 14).toInt());
+        return;
     } else if (incoming.indexOf("PING") != -1) {
         Serial.println("Keep-alive ping received");
-        return;
     } else {
         Serial.println("Unknown command: " + incoming);
     }
+
+    sendReply(clientId, "OK");
 }
 
-void wifiListenTask(void* parameter) {
-    for (;;) {
-        WiFiClient newClient = server.available();
-        if (newClient) {
-            Serial.println("New client connected");
-            
-            if (newClient.connected()) {
-                if (newClient.available()) {
-                    String incoming = newClient.readStringUntil('\n');
-                    incoming.trim();
-                    
-                    while (incoming.length() > 0 && incoming.charAt(0) == '\0') {
-                        incoming = incoming.substring(1);
-                    }
-                    
-                    Serial.println("Received: " + incoming);
-                    
-                    if (incoming.indexOf("GET_BATTERY") != -1) {
-                        int percentage = getBatteryPercentage();
-                        String response = "BATTERY:" + String(percentage);
-                        newClient.println(response);
-                        Serial.println("Sent battery response: " + response);
-                        newClient.flush();
-                        delay(10); 
-                        newClient.stop(); 
-                    } else if (incoming.length() > 0) {
-                        handleIncoming(incoming);
-                        newClient.println("OK");
-                        
-                        // This becomes the persistent client for movement commands
-                        if (!clientConnected) {
-                            persistentClient = newClient;
-                            clientConnected = true;
-                            Serial.println("Client set as persistent");
-                        } else {
-                            newClient.stop(); // Close if we already have a persistent client
-                        }
-                    }
-                }
-            }
+// Telemetry frames are cut at the buffer size; says so once per frame kind
+void checkFrameLength(const char* name, int length, size_t size, bool& reported) {
+    if (length >= (int)size && !reported) {
+        reported = true;
+        Serial.printf("ERROR: %s frame needs %d bytes, only %u fit\n", name, length, (unsigned)size);
+    }
+}
+
+void buildTelemetry(char* buffer, size_t size) {
+    // Reading the ADC is slow, so the stream reports a cached value
+    if (lastBatteryPercentage < 0 || millis() - lastBatteryReadMs >= BATTERY_REFRESH_MS) {
+        lastBatteryPercentage = getBatteryPercentage();
+        lastBatteryReadMs = millis();
+    }
+
+    int contacts = 0;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        if (jointArena.contact[i]) contacts |= 1 << i;
+    }
+
+    ControlLoopStats stats = controlLoop.getStats();
+    BodyPose pose = poseController.getPose();
+    int length = snprintf(buffer, size,
+             "TELEMETRY:t=%lu,mode=%d,gait=%d,battery=%d,clients=%d,contacts=%d,"
+             "yaw=%.1f,pitch=%.1f,roll=%.1f,ticks=%lu,overruns=%lu,maxTickUs=%u,"
+             "stalled=%d,noContact=%d,hold=%d,headingErr=%.1f,trim=%ld,"
+             "ground=%ld/%ld/%ld/%ld/%ld/%ld,steps=%d,bodyPitch=%.1f,speed=%.2f,"
+             "pose=%.0f/%.0f/%.0f/%.1f/%.1f/%.1f,queued=%d",
+             millis(), currentMode, currentGait, lastBatteryPercentage,
+             networkServer.clientCount(), contacts,
+             imuReader.getYaw(), imuReader.getPitch(), imuReader.getRoll(),
+             stats.ticks, stats.overruns, stats.maxTickMicros,
+             postureController.getStalledLegs(), postureController.getMissingContactLegs(),
+             headingHold.isEnabled(), headingHold.getError(), (long)headingHold.getTrim(),
+             (long)terrainMap.getHeight(0), (long)terrainMap.getHeight(3), (long)terrainMap.getHeight(6),
+             (long)terrainMap.getHeight(9), (long)terrainMap.getHeight(12), (long)terrainMap.getHeight(15),
+             stairGait.getStepsClimbed(), stairGait.getBodyPitch(), speedScale,
+             pose.x, pose.y, pose.z, pose.roll, pose.pitch, pose.yaw,
+             motionQueue.pending() + (queuedRunning ? 1 : 0));
+    static bool truncated = false;
+    checkFrameLength("TELEMETRY", length, size, truncated);
+}
+
+// Slower moving state, pushed once a second beside the telemetry stream
+void buildHealth(char* buffer, size_t size) {
+    HeapUsage heap = resourceMonitor.getHeap();
+    char stackFree[48];
+    resourceMonitor.formatStackFree(stackFree, sizeof(stackFree));
+    int length = snprintf(buffer, size,
+             "HEALTH:t=%lu,latNet=%lu/%lu/%lu,latQueue=%lu/%lu/%lu,latServo=%lu/%lu/%lu,"
+             "heap=%lu/%lu/%u,stackFree=%s,allocs=%lu/%lu,lostLeg=%d,faultLegs=%u",
+             millis(),
+             (unsigned long)networkLatency.percentileMicros(50), (unsigned long)networkLatency.percentileMicros(95),
+             (unsigned long)networkLatency.getMaxMicros(),
+             (unsigned long)queueLatency.percentileMicros(50), (unsigned long)queueLatency.percentileMicros(95),
+             (unsigned long)queueLatency.getMaxMicros(),
+             (unsigned long)servoLatency.percentileMicros(50), (unsigned long)servoLatency.percentileMicros(95),
+             (unsigned long)servoLatency.getMaxMicros(),
+             (unsigned long)heap.freeBytes, (unsigned long)heap.largestBlock, heap.fragmentation,
+             stackFree, (unsigned long)resourceMonitor.getLastCommandAllocations(),
+             (unsigned long)resourceMonitor.getMaxCommandAllocations(),
+             fiveLegGait.getLostLeg(), legFaults.getFaultyLegs());
+    static bool truncated = false;
+    checkFrameLength("HEALTH", length, size, truncated);
+}
+
+// TIME_SYNC:<t1> is answered with TIME:<t1>,<t2>,<t3>: the client's send
+// time echoed, then the robot's receive and reply times in microseconds.
+// From those and its own receive time the client works out the clock
+// offset and round trip, NTP style.
+void answerTimeSync(int clientId, const char* clientTime, int64_t receivedUs) {
+    char reply[80];
+    snprintf(reply, sizeof(reply), "TIME:%s,%lld,%lld", clientTime, (long long)receivedUs,
+             (long long)esp_timer_get_time());
+    sendReply(clientId, reply);
+}
+
+void onClientCommand(int clientId, const char* command) {
+    int64_t receivedUs = esp_timer_get_time();
+    resourceMonitor.beginCommand();
+    if (strncmp(command, "TIME_SYNC:", 10) == 0) {
+        answerTimeSync(clientId, command + 10, receivedUs);
+        resourceMonitor.endCommand();
+        return;
+    }
+
+    inputCommand(clientId, command);
+
+    // The pose stream would drown everything else on the console
+    if (strncmp(command, "POSE:", 5) != 0) {
+        Serial.printf("Received (session %d): %s\n", clientId, command);
+    }
+
+    // A trailing @<us> is the client's send time, already converted to
+    // the robot clock with the offset from TIME_SYNC
+    String text(command);
+    incomingSentUs = -1;
+    const char* at = strrchr(command, '@');
+    if (at != NULL) {
+        incomingSentUs = strtoll(at + 1, NULL, 10);
+        text = text.substring(0, at - command);
+        networkLatency.record(receivedUs - incomingSentUs);
+    }
+    incomingReceivedUs = receivedUs;
+    incomingClientId = clientId;
+    handleIncoming(clientId, text);
+    resourceMonitor.endCommand();
+}
+
+// WiFi associates in the background while the robot boots and comes back
+// on its own after a dropout. The servers open once actuation is ready.
+void superviseWifi() {
+    bool connected = WiFi.status() == WL_CONNECTED;
+    unsigned long now = millis();
+
+    if (connected && !wifiConnected) {
+        if (!bootProfile.isFinished(BOOT_WIFI)) {
+            bootProfile.finish(BOOT_WIFI);
         }
+        logPrintf("WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
+    } else if (!connected && wifiConnected) {
+        logPrintf("WiFi lost, reconnecting");
+        wifiRetryMs = now;
+    } else if (!connected && now - wifiRetryMs >= (unsigned long)WIFI_RETRY_MS) {
+        // Auto reconnect gives up after some disconnect reasons
+        WiFi.reconnect();
+        wifiRetryMs = now;
+    }
+    wifiConnected = connected;
 
-        if (clientConnected && persistentClient.connected()) {
-            if (persistentClient.available()) {
-                String incoming = persistentClient.readStringUntil('\n');
-                incoming.trim();
-                
-                while (incoming.length() > 0 && incoming.charAt(0) == '\0') {
-                    incoming = incoming.substring(1);
-                }
+    if (connected && actuationReady && !serverStarted) {
+        serverStarted = true;
+        if (!networkServer.begin()) {
+            logPrintf("ERROR: network server did not start");
+        }
+    }
+}
 
-                if (incoming.length() > 0) {
-                    handleIncoming(incoming);
-                    persistentClient.println("OK");
-                }
-            }
-            
-            if (persistentClient.available() == 1) {
-                byte pingByte = persistentClient.read();
-                if (pingByte == 0) {
-                    persistentClient.write((uint8_t)0);
-                }
+void readConsole() {
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c != '\n' && c != '\r') {
+            // An overlong line is dropped whole
+            if (consoleLength < CLIENT_BUFFER_SIZE - 1) {
+                consoleLine[consoleLength] = c;
             }
+            consoleLength++;
+            continue;
         }
+        if (consoleLength > 0 && consoleLength < CLIENT_BUFFER_SIZE) {
+            consoleLine[consoleLength] = '\0';
+            onClientCommand(SERIAL_CLIENT, consoleLine);
+        }
+        consoleLength = 0;
+    }
+}
 
-        if (clientConnected && !persistentClient.connected()) {
-            clientConnected = false;
-            persistentClient.stop();
-            Serial.println("Persistent client disconnected");
+void wifiListenTask(void* parameter) {
+    for (;;) {
+        superviseWifi();
+        // Console lines are handled here too, so every command runs on
+        // this one task
+        if (actuationReady) {
+            readConsole();
         }
+        resourceMonitor.update(millis());
+        saveParameters();
+        // Sleeps in select() until a client connects or sends data
+        networkServer.poll(CONSOLE_POLL_MS);
+    }
+}
+
+void initImu() {
+    bootProfile.start(BOOT_IMU);
+    WIRE_PORT.begin();
+    WIRE_PORT.setClock(400000);
+    imuReader.begin(WIRE_PORT, AD0_VAL);
+    bootProfile.finish(BOOT_IMU);
+}
 
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+// Brings up I2C and the IMU on the background core while the control core
+// talks to the servos
+void imuInitTask(void* parameter) {
+    initImu();
+    xTaskNotifyGive((TaskHandle_t)parameter);
+    vTaskDelete(NULL);
+}
+
+void readSensors() {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        jointArena.contact[i] = inputSwitch(i, digitalRead(SWITCH_PINS[i])) == 1;
     }
+    imuReader.update();
 }
 
-void setup() {
-    Serial.begin(115200);
-    delay(1000); 
-    while (!Serial) {}
+// Mode to fall back to once the motion started by the given mode is done
+RobotMode modeAfterMotion(RobotMode mode) {
+    switch (mode) {
+        case ROTATE_LEFT:
+        case ROTATE_RIGHT:
+        case STAND_UP:
+        case DANCE:
+            return IDLE;
+        case LAY_DOWN:
+            return NONE;
+        default:
+            return mode;
+    }
+}
 
-    WiFi.begin(SSID, PASSWORD);
+void startMotion(PhasedMotion* motion, RobotMode mode, unsigned long now) {
+    activeMotion = motion;
+    motionMode = mode;
+    motion->start();
+    motion->update(now);
+}
 
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        Serial.print(".");
+void startGait(Gait* gait, GaitMotion motion, RobotMode mode, unsigned long now) {
+    float speed = speedScale;
+    if (isFiveLegged()) {
+        speed = min(speed, FIVE_LEG_SPEED_SCALE);
     }
+    // The stair gait holds legs up searching for steps, its cycles say
+    // nothing about contact
+    if (gait != &stairGait) {
+        legFaults.beginCycle();
+    }
+    gait->setMotion(motion);
+    gait->setSpeed(speed);
+    gait->setTiming(parameterStore.getGaitTiming());
+    gait->setStride(parameterStore.getGaitStride());
+    startMotion(gait, mode, now);
+}
 
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
+void finishAutoTune() {
+    GaitTiming before = parameterStore.getGaitTiming();
+    GaitTiming tuned = gaitTuner.result(before);
+    parameterStore.setGaitTiming(tuned);
+    parameterStore.setTunedBattery(getBatteryPercentage());
+    publishParameters(true);
+
+    logPrintf("Auto-tune: lift %d->%d, swing %d->%d, lower %d->%d, rotate lower %d->%d, wave %d->%d ms",
+              before.liftDelay, tuned.liftDelay, before.swingDelay, tuned.swingDelay,
+              before.lowerDelay, tuned.lowerDelay, before.rotateLowerDelay, tuned.rotateLowerDelay,
+              before.waveDelay, tuned.waveDelay);
+    logPrintf("Auto-tune: samples %d/%d/%d/%d/%d at battery %d%%",
+              gaitTuner.getSampleCount(TUNE_LIFT), gaitTuner.getSampleCount(TUNE_SWING),
+              gaitTuner.getSampleCount(TUNE_LOWER), gaitTuner.getSampleCount(TUNE_ROTATE_LOWER),
+              gaitTuner.getSampleCount(TUNE_WAVE), parameterStore.getTunedBattery());
+    currentMode = IDLE;
+}
 
-    server.begin();
+// Runs the next cycle of the tune script, at nominal speed so the
+// margins measured are the ones the scaled cadence builds on
+void startTuneCycle(bool entered, unsigned long now) {
+    if (entered) {
+        tuneStage = 0;
+        tuneCyclesDone = 0;
+        gaitTuner.begin();
+        logPrintf("Auto-tune: starting");
+    }
 
-    WIRE_PORT.begin();
-    WIRE_PORT.setClock(400000);
+    while (tuneStage < TUNE_STAGE_COUNT && tuneCyclesDone >= TUNE_STAGES[tuneStage].cycles) {
+        tuneStage++;
+        tuneCyclesDone = 0;
+    }
+    if (tuneStage >= TUNE_STAGE_COUNT) {
+        finishAutoTune();
+        return;
+    }
 
-    servoBus.beginOnePinMode(&Serial2, 15);
-    servoBus.debug(false);
+    const TuneStage& stage = TUNE_STAGES[tuneStage];
+    Gait* gait = stage.pattern == WAVE ? (Gait*)&waveGait : (Gait*)&tripodGait;
+    tuneGait = gait;
+    tripodGait.setTurnAmplitude(1.0f);
+    gait->setStrideTrim(0);
+    gait->setMotion(stage.motion);
+    gait->setSpeed(1.0f);
+    gait->setTiming(parameterStore.getGaitTiming());
+    gait->setStride(parameterStore.getGaitStride());
+    tuneCyclesDone++;
+    startMotion(gait, AUTO_TUNE, now);
+}
 
-    Serial.println("Hexapod Starting...");
+void postMotionEvent(const MotionRequest& request, const char* event, const char* reason = NULL) {
+    char line[OUTBOX_LINE_SIZE];
+    if (reason != NULL) {
+        snprintf(line, sizeof(line), "EVENT:%s:%lu:%s", event, (unsigned long)request.id, reason);
+    } else {
+        snprintf(line, sizeof(line), "EVENT:%s:%lu", event, (unsigned long)request.id);
+    }
+    if (!postReply(request.clientId, line)) {
+        logPrintf("Outbox full, dropped %s", line);
+    }
+}
 
-    for (int i = 0; i < 18; i++) {
-        servos[i] = new LX16AServo(&servoBus, i + 1);
+// Reports how the running queued move ended and drops its speed
+void finishQueuedMotion(const char* event, const char* reason = NULL) {
+    postMotionEvent(queuedMotion, event, reason);
+    queuedRunning = false;
+    walkCyclesLeft = -1;
+    if (queuedSpeedScale > 0 && speedScale == queuedSpeedScale) {
+        speedScale = speedBeforeQueued;
     }
+    queuedSpeedScale = 0;
+}
 
-    for (int i = 0; i < 6; i++) {
-        pinMode(SWITCH_PINS[i], INPUT);
+// Runs the next cycle of a planned turn, or returns to idle once the
+// planner is within tolerance
+void startTurnStep(unsigned long now) {
+    if (turnRequested) {
+        turnRequested = false;
+        turnPlanner.begin(imuReader.getYaw(), requestedTurn, imuReader.isConnected());
     }
-    Serial.println("Switch pins initialized for ground detection (digital mode)");
 
-    initLegs();
+    float step = turnPlanner.nextStep(imuReader.getYaw());
+    if (step == 0) {
+        if (turnPlanner.wasReversed() && queuedRunning && queuedMotion.mode == ROTATE_TO_ANGLE) {
+            finishQueuedMotion("ABORTED", "turned the wrong way");
+        }
+        currentMode = IDLE;
+        return;
+    }
 
-    // Initialize gyroscope
-    myICM.begin(WIRE_PORT, AD0_VAL);
-    
-    
-    if (myICM.status != ICM_20948_Stat_Ok) {
-        Serial.println("ERROR: ICM-20948 not connected!");
-    } else {
-        Serial.println("OK");
+    Gait* gait = turningGait();
+    gait->setTurnAmplitude(fabs(step));
+    startGait(gait, step > 0 ? TURN_LEFT : TURN_RIGHT, ROTATE_TO_ANGLE, now);
+}
+
+// Closes the timing of the last mode command once the control task has
+// acted on it. Clients that sent a timestamp get the full breakdown.
+void recordCommandLatency(int64_t executedUs, int64_t commandedUs) {
+    if (!commandTimingPending) {
+        return;
     }
+    commandTimingPending = false;
+    queueLatency.record(executedUs - commandReceivedUs);
+    servoLatency.record(commandedUs - executedUs);
+
+    if (commandSentUs >= 0) {
+        char line[OUTBOX_LINE_SIZE];
+        snprintf(line, sizeof(line), "EVENT:LATENCY:%lld,%lld,%lld,%lld", (long long)commandSentUs,
+                 (long long)commandReceivedUs, (long long)executedUs, (long long)commandedUs);
+        postReply(commandClientId, line);
+    }
+}
 
-    delay(1500);
-    
-    Serial.println("Ready to walk!");
+void startQueuedMotion(const MotionRequest& request) {
+    queuedMotion = request;
+    queuedRunning = true;
+    if (request.speed > 0) {
+        speedBeforeQueued = speedScale;
+        queuedSpeedScale = constrain(request.speed, MIN_SPEED_SCALE, MAX_SPEED_SCALE);
+        speedScale = queuedSpeedScale;
+    }
 
-    // Start background task to listen to WiFi
-    xTaskCreatePinnedToCore(
-        wifiListenTask,     // Function to run
-        "WiFiTask",         // Task name
-        8192,               // Stack size
-        NULL,               // Parameters
-        1,                  // Priority
-        &wifiTaskHandle,    // Handle
-        0                   // Core
-    );
+    if (request.mode == MOVE_FORWARD || request.mode == MOVE_BACKWARD) {
+        GaitStride stride = parameterStore.getGaitStride();
+        float strokes = isFiveLegged() ? FIVE_LEG_CYCLE_STROKES :
+                        currentGait == WAVE ? WAVE_CYCLE_STROKES : TRIPOD_CYCLE_STROKES;
+        float perCycle = strokes * legStroke(stride.coxaForward, stride.coxaBackward);
+        walkCyclesLeft = max(1, (int)lround(fabs(request.amount) / perCycle));
+    } else if (request.mode == ROTATE_TO_ANGLE) {
+        requestedTurn = request.amount;
+        turnRequested = true;
+    }
 
-    
+    currentMode = request.mode;
+    postMotionEvent(request, "STARTED");
 }
 
-void loop() {
-    switch (currentMode) {
+// Called between motions: reports how the running scripted move ended and
+// starts the next one once the robot is idle
+void updateMotionQueue() {
+    if (motionQueue.takeAbort()) {
+        if (queuedRunning) {
+            finishQueuedMotion("ABORTED", "interrupted");
+        }
+        MotionRequest dropped;
+        while (motionQueue.pop(dropped)) {
+            postMotionEvent(dropped, "ABORTED", "cleared");
+        }
+    }
+
+    if (queuedRunning) {
+        // Every queued mode leaves itself once its move is done
+        if (currentMode == queuedMotion.mode) {
+            return;
+        }
+        finishQueuedMotion("COMPLETED");
+    }
+
+    MotionRequest next;
+    if ((currentMode == IDLE || currentMode == NONE) && motionQueue.pop(next)) {
+        startQueuedMotion(next);
+    }
+}
+
+// Counts down a queued walk; false once its distance is covered
+bool takeWalkCycle() {
+    if (walkCyclesLeft < 0) {
+        return true;
+    }
+    if (walkCyclesLeft == 0) {
+        walkCyclesLeft = -1;
+        currentMode = IDLE;
+        return false;
+    }
+    walkCyclesLeft--;
+    return true;
+}
+
+bool isWalking(RobotMode mode) {
+    return mode == MOVE_FORWARD || mode == MOVE_BACKWARD;
+}
+
+// Starts the next walk cycle with the current heading correction. The
+// heading to hold is taken when walking begins, so reversing keeps the line.
+void startWalk(GaitMotion motion, RobotMode mode, RobotMode previous, unsigned long now) {
+    if (!isWalking(previous)) {
+        headingHold.begin(imuReader.getYaw());
+    }
+    Gait* gait = selectedGait();
+    gait->setStrideTrim(headingHold.getTrim());
+    startGait(gait, motion, mode, now);
+}
+
+// Between motions: carries out what clients asked of state the control
+// task owns
+void applyClientRequests() {
+    if (terrainResetRequested) {
+        terrainResetRequested = false;
+        terrainMap.reset();
+        logPrintf("Terrain map cleared");
+    }
+    if (headingHoldRequested) {
+        headingHoldRequested = false;
+        headingHold.setEnabled(headingHoldWanted);
+    }
+}
+
+// Modes that can still run with the legs that are left
+bool modeAllowed(RobotMode mode) {
+    int faulty = legFaults.getFaultyLegCount();
+    if (faulty == 0) {
+        return true;
+    }
+    switch (mode) {
+        case IDLE:
+        case NONE:
+        case BALANCE:
+        case LAY_DOWN:
+        case STAND_UP:
+            return true;
+        case DANCE:
+        case STAIRCASE:
+        case AUTO_TUNE:
+            return false;
+        default:
+            // The five-leg gait walks and turns on one leg short, no fewer
+            return faulty == 1;
+    }
+}
+
+// Between motions: takes up a leg the fault monitor gave up on, leaning
+// the body away from it before the five-leg gait takes over. True while
+// the tick is spent on that.
+bool adaptToLegFaults(bool poseMoving) {
+    if (faultResetRequested) {
+        faultResetRequested = false;
+        legFaults.reset();
+        fiveLegGait.setLostLeg(-1);
+        poseController.setOffset(0, 0);
+        leaningFromLostLeg = false;
+        poseStaleLegs = 0x3F;
+        logPrintf("Leg faults cleared");
+    }
+
+    int lost = legFaults.getLostLeg();
+    if (lost >= 0 && fiveLegGait.getLostLeg() < 0) {
+        fiveLegGait.setLostLeg(lost);
+        float mountX = LEG_MOUNT_X[lost];
+        float mountY = LEG_MOUNT_Y[lost];
+        float mount = sqrtf(mountX * mountX + mountY * mountY);
+        poseController.setOffset(-FIVE_LEG_BODY_SHIFT * mountX / mount, -FIVE_LEG_BODY_SHIFT * mountY / mount);
+
+        char line[OUTBOX_LINE_SIZE];
+        snprintf(line, sizeof(line), "EVENT:LEG_LOST:%d:%s", lost,
+                 LegFaultMonitor::faultName(legFaults.getFault(lost)));
+        networkServer.post(-1, line);
+        logPrintf("Leg %d lost, walking on five", lost * JOINTS_PER_LEG);
+
+        // Lying down there is nothing to fold or lean yet
+        if (!laidDown) {
+            initLegs();
+            leaningFromLostLeg = true;
+            return true;
+        }
+    }
+
+    if (leaningFromLostLeg) {
+        if (poseMoving || poseStaleLegs != 0) {
+            followPose();
+            return true;
+        }
+        leaningFromLostLeg = false;
+    }
+
+    RobotMode mode = currentMode;
+    if (!modeAllowed(mode)) {
+        if (queuedRunning && queuedMotion.mode == mode) {
+            finishQueuedMotion("ABORTED", "leg lost");
+        }
+        logPrintf("Mode %d refused, %d legs lost", mode, legFaults.getFaultyLegCount());
+        currentMode = legFaults.getFaultyLegCount() > 1 ? NONE : IDLE;
+    }
+    return false;
+}
+
+// One control period: sample the sensors, then step whatever is moving.
+// Like the old blocking routines, a motion always runs to its end before
+// a new mode takes effect.
+void stepControl(unsigned long now) {
+    readSensors();
+    if (motionMode != AUTO_TUNE) {
+        legFaults.update(now);
+    }
+
+    // Gaits pick the pose up with each phase they command; standing legs
+    // are re-sent below
+    bool poseMoving = poseController.update(1.0f / CONTROL_RATE_HZ);
+    if (poseMoving) {
+        poseStaleLegs = 0x3F;
+    }
+
+    if (activeMotion != NULL && isWalking(motionMode)) {
+        headingHold.update(imuReader.getYaw());
+    }
+
+    if (activeMotion != NULL) {
+        if (!activeMotion->update(now)) {
+            return;
+        }
+        activeMotion = NULL;
+        legFaults.endCycle();
+
+        if (motionMode == LAY_DOWN) {
+            laidDown = true;
+        } else if (motionMode == STAND_UP) {
+            laidDown = false;
+            legFaults.reportStalled(postureController.getStalledLegs());
+        }
+
+        RobotMode next = modeAfterMotion(motionMode);
+        if (next != motionMode && currentMode == motionMode) {
+            currentMode = next;
+        }
+    }
+
+    updateMotionQueue();
+    applyParameterEdits();
+    applyClientRequests();
+    if (adaptToLegFaults(poseMoving)) {
+        return;
+    }
+
+    RobotMode mode = currentMode;
+    RobotMode previous = lastTickMode;
+    bool entered = mode != previous;
+    lastTickMode = mode;
+    int64_t executedUs = esp_timer_get_time();
+
+    switch (mode) {
         case MOVE_FORWARD:
-            moveForward();
+            if (takeWalkCycle()) {
+                startWalk(WALK_FORWARD, mode, previous, now);
+            }
             break;
         case MOVE_BACKWARD:
-            moveBackward();
+            if (takeWalkCycle()) {
+                startWalk(WALK_BACKWARD, mode, previous, now);
+            }
             break;
-        case IDLE:
-            initLegs();
+        case ROTATE_LEFT:
+            turningGait()->setTurnAmplitude(1.0f);
+            startGait(turningGait(), TURN_LEFT, mode, now);
+            break;
+        case ROTATE_RIGHT:
+            turningGait()->setTurnAmplitude(1.0f);
+            startGait(turningGait(), TURN_RIGHT, mode, now);
+            break;
+        case ROTATE_TO_ANGLE:
+            startTurnStep(now);
+            break;
+        case STAIRCASE:
+            if (entered) {
+                // Resuming after a stop keeps the step profile
+                stairGait.begin(previous != NONE);
+            }
+            if (stairGait.isHalted()) {
+                currentMode = NONE;
+                break;
+            }
+            startGait(&stairGait, WALK_FORWARD, mode, now);
             break;
         case LAY_DOWN:
-            layDown();
-            currentMode = NONE;
+            postureController.setSequence("Lay down", LAY_DOWN_STAGES, LAY_DOWN_STAGE_COUNT);
+            startMotion(&postureController, mode, now);
             break;
         case STAND_UP:
-            standUp();
-            currentMode = IDLE;
+            postureController.setSequence("Stand up", STAND_UP_STAGES, STAND_UP_STAGE_COUNT);
+            startMotion(&postureController, mode, now);
             break;
         case DANCE:
-            dance();
+            startMotion(&danceMotion, mode, now);
+            break;
+        case AUTO_TUNE:
+            startTuneCycle(entered, now);
             break;
         case BALANCE:
         case NONE:
             break;
+        case IDLE:
         default:
-            initLegs();
+            if (entered) {
+                initLegs();
+            }
+            followPose();
             break;
     }
-     
-}
\ No newline at end of file
+
+    recordCommandLatency(executedUs, esp_timer_get_time());
+}
+
+// Control state at rest, as input log keyframes hold it. Fixed width
+// fields, so a keyframe from the robot is restored by the host replayer.
+// The gaits and motions start afresh with every cycle and are left out.
+struct ControlKeyframe {
+    int32_t target[SERVO_COUNT];
+    int32_t unposed[SERVO_COUNT];
+    int32_t start[SERVO_COUNT];
+    uint32_t commandMs[SERVO_COUNT];
+    int32_t durationMs[SERVO_COUNT];
+    uint32_t sequence[SERVO_COUNT];
+    int32_t measured[SERVO_COUNT];
+    uint32_t measuredMs[SERVO_COUNT];
+    uint32_t knownJoints;
+    uint32_t moveCount;
+    int32_t terrainHeight[LEG_COUNT];
+    uint8_t terrainMisses[LEG_COUNT];
+    uint8_t gait;
+    uint8_t motionMode;
+    BodyPose poseTarget;
+    BodyPose pose;
+    float poseOffset[2];
+    float imu[4];
+    float speed;
+    GaitTiming timing;
+    GaitStride stride;
+    int32_t tunedBattery;
+    LegFaultState faults;
+    int8_t fiveLegLost;
+    uint8_t imuConnected;
+    uint8_t laidDown;
+    uint8_t headingHoldOn;
+    uint8_t poseStaleLegs;
+    uint8_t poseLegCursor;
+};
+
+ControlKeyframe keyframe;
+
+// Standing between motions with nothing handed over and nothing queued,
+// where a keyframe holds all a replay needs
+bool atRest() {
+    return activeMotion == NULL && currentMode == IDLE && lastTickMode == IDLE && motionMode != AUTO_TUNE &&
+           !queuedRunning && motionQueue.pending() == 0 && !turnRequested && !faultResetRequested &&
+           !leaningFromLostLeg && parameterEditCount == 0 && !parameterResetRequested && !terrainResetRequested &&
+           !headingHoldRequested;
+}
+
+void logKeyframe(unsigned long now) {
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        keyframe.target[id] = jointArena.target[id];
+        keyframe.unposed[id] = jointArena.unposed[id];
+        keyframe.start[id] = jointArena.start[id];
+        keyframe.commandMs[id] = jointArena.commandMs[id];
+        keyframe.durationMs[id] = jointArena.durationMs[id];
+        keyframe.sequence[id] = jointArena.sequence[id];
+        keyframe.measured[id] = jointArena.measured[id];
+        keyframe.measuredMs[id] = jointArena.measuredMs[id];
+    }
+    keyframe.knownJoints = 0;
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        keyframe.knownJoints |= (uint32_t)jointArena.known[id] << id;
+    }
+    keyframe.moveCount = servoShadow.getMoveCount();
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        keyframe.terrainHeight[leg] = terrainMap.getHeight(leg * JOINTS_PER_LEG);
+        keyframe.terrainMisses[leg] = terrainMap.getMisses(leg * JOINTS_PER_LEG);
+    }
+    keyframe.gait = currentGait;
+    keyframe.motionMode = motionMode;
+    keyframe.poseTarget = poseController.getTarget();
+    keyframe.pose = poseController.getPose();
+    keyframe.poseOffset[0] = poseController.getOffsetX();
+    keyframe.poseOffset[1] = poseController.getOffsetY();
+    keyframe.imu[0] = imuReader.getYaw();
+    keyframe.imu[1] = imuReader.getPitch();
+    keyframe.imu[2] = imuReader.getRoll();
+    keyframe.imu[3] = imuReader.getYawRate();
+    keyframe.speed = speedScale;
+    keyframe.timing = parameterStore.getGaitTiming();
+    keyframe.stride = parameterStore.getGaitStride();
+    keyframe.tunedBattery = parameterStore.getTunedBattery();
+    keyframe.faults = legFaults.getState();
+    keyframe.fiveLegLost = fiveLegGait.getLostLeg();
+    keyframe.imuConnected = imuReader.isConnected();
+    keyframe.laidDown = laidDown;
+    keyframe.headingHoldOn = headingHold.isEnabled();
+    keyframe.poseStaleLegs = poseStaleLegs;
+    keyframe.poseLegCursor = poseLegCursor;
+    inputKeyframe(now, &keyframe, sizeof(keyframe));
+}
+
+// Called by the host replayer in place of the boot it can not replay;
+// false for a keyframe from another build
+bool restoreKeyframe(const uint8_t* data, size_t length) {
+    if (length != sizeof(keyframe)) {
+        return false;
+    }
+    memcpy(&keyframe, data, sizeof(keyframe));
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        jointArena.target[id] = keyframe.target[id];
+        jointArena.unposed[id] = keyframe.unposed[id];
+        jointArena.start[id] = keyframe.start[id];
+        jointArena.commandMs[id] = keyframe.commandMs[id];
+        jointArena.durationMs[id] = keyframe.durationMs[id];
+        jointArena.sequence[id] = keyframe.sequence[id];
+        jointArena.known[id] = (keyframe.knownJoints >> id) & 1;
+        jointArena.measured[id] = keyframe.measured[id];
+        jointArena.measuredMs[id] = keyframe.measuredMs[id];
+    }
+    servoShadow.restoreMoveCount(keyframe.moveCount);
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+        terrainMap.restore(leg * JOINTS_PER_LEG, keyframe.terrainHeight[leg], keyframe.terrainMisses[leg]);
+    }
+    currentGait = (GaitPattern)keyframe.gait;
+    motionMode = (RobotMode)keyframe.motionMode;
+    poseController.restore(keyframe.poseTarget, keyframe.pose);
+    poseController.setOffset(keyframe.poseOffset[0], keyframe.poseOffset[1]);
+    imuReader.restore(keyframe.imuConnected, keyframe.imu);
+    speedScale = keyframe.speed;
+    parameterStore.setGaitTiming(keyframe.timing);
+    parameterStore.setGaitStride(keyframe.stride);
+    parameterStore.setTunedBattery(keyframe.tunedBattery);
+    publishParameters(false);
+    legFaults.restore(keyframe.faults);
+    fiveLegGait.setLostLeg(keyframe.fiveLegLost);
+    laidDown = keyframe.laidDown;
+    headingHold.setEnabled(keyframe.headingHoldOn);
+    poseStaleLegs = keyframe.poseStaleLegs;
+    poseLegCursor = keyframe.poseLegCursor;
+
+    activeMotion = NULL;
+    currentMode = IDLE;
+    lastTickMode = IDLE;
+    walkCyclesLeft = -1;
+    leaningFromLostLeg = false;
+    return true;
+}
+
+void controlTick(unsigned long now) {
+    inputTick(now);
+    if (inputKeyframeDue(now) && atRest()) {
+        logKeyframe(now);
+    }
+    if (motionMode != AUTO_TUNE && currentMode != AUTO_TUNE) {
+        stepControl(now);
+        return;
+    }
+
+    // While tuning, each phase start hands the joints it commanded to
+    // the tuner to be timed
+    int phaseBefore = activeMotion != NULL ? activeMotion->currentPhase() : -1;
+    PhasedMotion* motionBefore = activeMotion;
+    gaitTuner.beforeTick();
+
+    stepControl(now);
+
+    if (activeMotion == NULL || motionMode != AUTO_TUNE) {
+        return;
+    }
+    int phase = activeMotion->currentPhase();
+    bool started = activeMotion != motionBefore || phase != phaseBefore;
+    gaitTuner.afterTick(started ? GaitTuner::categoryOf(tuneGait->stepAt(phase - 1)) : TUNE_NONE, now);
+}
+
+void setup() {
+    Serial.begin(115200);
+
+    // Before anything is read, so the log can be replayed from boot
+    beginInputLog();
+
+    // Association takes seconds, it runs in the background from here on
+    bootProfile.start(BOOT_WIFI);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(SSID, PASSWORD);
+
+    // Logging and networking live on core 0, control owns core 1
+    startLogTask(BACKGROUND_CORE, 1);
+
+    motionQueue.begin();
+    networkServer.onCommand(onClientCommand);
+    networkServer.onTelemetry(buildTelemetry, TELEMETRY_INTERVAL_MS);
+    networkServer.onTelemetry(buildHealth, HEALTH_INTERVAL_MS);
+
+    // Start background task to listen to WiFi
+    xTaskCreatePinnedToCore(
+        wifiListenTask,     // Function to run
+        "WiFiTask",         // Task name
+        WIFI_TASK_STACK,    // Stack size
+        NULL,               // Parameters
+        1,                  // Priority
+        &wifiTaskHandle,    // Handle
+        BACKGROUND_CORE     // Core
+    );
+
+    // Stack margins, and the allocations of the network path
+    resourceMonitor.watchTask("WiFiTask", wifiTaskHandle, WIFI_TASK_STACK);
+    resourceMonitor.watchTask("LogTask", getLogTask(), LOG_TASK_STACK);
+    resourceMonitor.countAllocations(wifiTaskHandle);
+
+    bool imuTaskStarted = xTaskCreatePinnedToCore(imuInitTask, "ImuInit", 4096, xTaskGetCurrentTaskHandle(),
+                                                  1, NULL, BACKGROUND_CORE) == pdPASS;
+
+    Serial.println("Hexapod Starting...");
+
+    bootProfile.start(BOOT_SERVOS);
+    servoBus.beginOnePinMode(&Serial2, 15);
+    servoBus.debug(false);
+
+    jointArena.begin(&servoBus);
+
+    for (int i = 0; i < 6; i++) {
+        pinMode(SWITCH_PINS[i], INPUT);
+    }
+    Serial.println("Switch pins initialized for ground detection (digital mode)");
+
+    if (!parameterStore.load()) {
+        Serial.println("No stored parameters, using defaults");
+    }
+    publishParameters(false);
+
+    servoShadow.sync();
+    initLegs();
+    bootProfile.finish(BOOT_SERVOS);
+
+    if (imuTaskStarted) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    } else {
+        initImu();
+    }
+
+    if (!imuReader.isConnected()) {
+        Serial.println("ERROR: ICM-20948 not connected!");
+    } else {
+        Serial.println("OK");
+    }
+
+    // The gyro bias is measured standing still, so wait for the stance
+    // moves to finish rather than a fixed delay
+    bootProfile.start(BOOT_SETTLE);
+    unsigned long settledMs = millis();
+    for (int id = 0; id < SERVO_COUNT; id++) {
+        if ((long)(servoShadow.arrivalMs(id) - settledMs) > 0) {
+            settledMs = servoShadow.arrivalMs(id);
+        }
+    }
+    settledMs += BOOT_SETTLE_MS;
+    while ((long)(settledMs - millis()) > 0) {
+        delay(10);
+    }
+    bootProfile.finish(BOOT_SETTLE);
+
+    bootProfile.start(BOOT_CALIBRATE);
+    imuReader.calibrate();
+    bootProfile.finish(BOOT_CALIBRATE);
+
+    controlLoop.begin(controlTick, CONTROL_CORE, CONTROL_TASK_PRIORITY);
+    resourceMonitor.watchTask("ControlTask", controlLoop.getTaskHandle(), CONTROL_TASK_STACK);
+    bootProfile.markReady();
+    actuationReady = true;
+
+    char report[160];
+    bootProfile.format(report, sizeof(report));
+    Serial.printf("Ready to walk! Boot: %s\n", report);
+}
+
+void loop() {
+    // All control runs in the control task; free the Arduino loop task
+    vTaskDelete(NULL);
+}